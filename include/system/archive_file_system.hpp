@@ -0,0 +1,71 @@
+#pragma once
+#include "system/file_system.hpp"
+
+namespace oic {
+
+	//!A read only file system for a ZIP archive
+	//The archive is mounted as the virtual tree (~/); it doesn't have local files
+	//The central directory is parsed once, stored entries are read without copying and deflated entries are
+	//decompressed when they're opened
+	//ZIP64 archives are supported, encrypted entries and other compression methods aren't
+	class ArchiveFileSystem : public FileSystem {
+
+	public:
+
+		//!Mount an archive that's stored in another file system
+		//The archive is mapped (if possible) and stays open until the file system is destroyed
+		ArchiveFileSystem(FileSystem *source, const String &path);
+
+		//!Mount an archive in memory; the memory has to stay valid until the file system is destroyed
+		ArchiveFileSystem(ListRef<const u8> archive);
+
+		~ArchiveFileSystem();
+
+		File *open(const FileInfo &info, ns maxTimeout, ns retryTimeout) final override;
+
+		//!If the archive could be parsed
+		inline bool valid() const { return isValid; }
+
+		const FileInfo local(const String &path) const final override;
+		bool hasLocal(const String&) const final override { return false; }
+		bool hasLocalRegion(const String&, FileSize, FileSize) const final override { return false; }
+
+		List<String> localDirectories(const String&) const final override { return {}; }
+		List<String> localFileObjects(const String&) const final override { return {}; }
+		List<String> localFiles(const String&) const final override { return {}; }
+
+	protected:
+
+		bool makeLocal(const String&, bool) final override { return false; }
+		bool delLocal(const String&) final override { return false; }
+		bool writeTempLocal(const String&, const u8*, FileSize, String&) final override { return false; }
+		bool replaceLocal(const String&, const String&) final override { return false; }
+
+		//!Parse the central directory into the virtual files
+		void initFiles() final override;
+
+		//The archive doesn't change
+
+		void startFileWatcher(const String&) final override {}
+		void endFileWatcher(const String&) final override {}
+
+	private:
+
+		struct Entry {
+			FileSize localHeader, compressedSize;
+			u16 method;
+		};
+
+		FileSystem *source{};
+		File *file{};
+
+		ListRef<const u8> archive;
+
+		//!The entries of all files, referenced by the dataExt of the files
+		List<Entry> entries;
+
+		bool isValid{};
+
+	};
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "system/file_system.hpp"
+#include <condition_variable>
+#include <deque>
+#include <future>
+
+namespace oic {
+
+	//!A read that can be submitted to AsyncFileIO
+	//The file is read from the path, unless a file is specified
+	//The destination has to stay allocated until the request is completed
+	struct FileRequest {
+
+		String path{};
+		File *file{};
+
+		u8 *destination{};
+		FileSize size{}, offset{};
+
+		void *userData{};
+	};
+
+	//!The result of a FileRequest
+	struct FileCompletion {
+
+		//!The id returned by submit (+ the index in the batch)
+		u64 id{};
+
+		void *userData{};
+
+		//!The time between submitting and completing the request
+		ns latency{};
+
+		bool success{};
+	};
+
+	//!Statistics of an AsyncFileIO
+	struct AsyncFileStats {
+
+		usz submitted{}, completed{}, failed{};
+
+		//!Requests that are submitted but not completed yet
+		usz queueDepth{}, maxQueueDepth{};
+
+		ns totalLatency{}, maxLatency{};
+
+		inline ns averageLatency() const { return completed ? totalLatency / completed : 0; }
+	};
+
+	//!Reads batches of files without blocking the submitting thread
+	//Completions are pushed to a queue that can be polled or waited on
+	//The default implementation uses a thread pool; platforms can handle requests natively (e.g. io_uring)
+	class AsyncFileIO {
+
+	public:
+
+		//!Create the most efficient implementation for the platform
+		//@param[in] threads The number of threads used for requests that can't be handled natively
+		static AsyncFileIO *create(FileSystem *fs, usz threads = 4);
+
+		AsyncFileIO(FileSystem *fs, usz threads = 4);
+		virtual ~AsyncFileIO();
+
+		AsyncFileIO(const AsyncFileIO&) = delete;
+		AsyncFileIO(AsyncFileIO&&) = delete;
+		AsyncFileIO &operator=(const AsyncFileIO&) = delete;
+		AsyncFileIO &operator=(AsyncFileIO&&) = delete;
+
+		//!Submit a batch of reads
+		//@return u64 id The id of the first request, the others follow sequentially
+		u64 submit(ListRef<const FileRequest> requests);
+
+		//!Move all completed requests into the list, without waiting
+		//@return usz count The number of completions that were added
+		usz poll(List<FileCompletion> &completions);
+
+		//!Wait until at least minCount requests are completed and move them into the list
+		//@return usz count The number of completions that were added
+		usz wait(List<FileCompletion> &completions, usz minCount = 1);
+
+		AsyncFileStats getStats() const;
+
+	protected:
+
+		//!Submit a request to the native implementation
+		//@return bool handled If false, the request is handled by the thread pool
+		virtual bool submitNative(const FileRequest &, u64, ns) { return false; }
+
+		//!Called after all requests of a batch are passed to submitNative
+		virtual void flushNative() {}
+
+		//!Finish a request; can be called from any thread
+		void complete(u64 id, void *userData, ns start, bool success);
+
+		FileSystem *fs;
+
+	private:
+
+		struct Pending {
+			FileRequest request;
+			u64 id;
+			ns start;
+		};
+
+		static void work(AsyncFileIO *io);
+
+		List<std::future<void>> workers;
+
+		std::deque<Pending> pending;
+		std::mutex pendingMutex;
+		std::condition_variable pendingCondition;
+
+		List<FileCompletion> completions;
+		mutable std::mutex completionMutex;
+		std::condition_variable completionCondition;
+
+		//!Local files can't be read by multiple threads at once
+		std::mutex fileMutexes[16];
+
+		AsyncFileStats stats;
+		u64 nextId{};
+		bool running{ true };
+
+	};
+
+}
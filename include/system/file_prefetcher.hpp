@@ -0,0 +1,107 @@
+#pragma once
+#include "system/file_system.hpp"
+#include <condition_variable>
+#include <future>
+
+namespace oic {
+
+	//!Statistics of a FilePrefetcher
+	struct PrefetchStats {
+
+		//!The accesses in the manifest
+		usz records{};
+
+		//!Accesses read into the cache, hinted to the OS, or skipped because they were already read
+		usz prefetched{}, hinted{}, skipped{};
+
+		//!Reads that were (or weren't) copied from the cache
+		usz hits{}, misses{};
+
+		FileSize cachedBytes{}, maxCachedBytes{};
+	};
+
+	//!Replays the accesses of a manifest ahead of the reads of a file system
+	//A manifest is an access trace (see FileSystem::startAccessTrace) that's saved to a file
+	//
+	//The accesses are handled in order by a few background threads (so multiple reads are in flight):
+	//Local files are hinted to the OS (e.g. posix_fadvise) if possible, so they're in the page cache when they're read
+	//Other files (and local files that can't be hinted) are read into a cache of at most budget bytes
+	//Reads that are in the cache are copied from it and release the cached region; while the cache is full, prefetching waits
+	//Regions that are read before they're prefetched are skipped; other regions of the same file are still prefetched
+	//The regions of a file are dropped when it changes (see FileSystem::invalidate)
+	class FilePrefetcher {
+
+	public:
+
+		//!Save an access trace as a manifest
+		static bool saveManifest(FileSystem *fs, const String &path, const List<FileAccessRecord> &records);
+
+		//!Load the access trace of a manifest
+		static bool loadManifest(FileSystem *fs, const String &path, List<FileAccessRecord> &records);
+
+		//!Start prefetching the accesses
+		FilePrefetcher(FileSystem *fs, List<FileAccessRecord> records, FileSize budget, usz threads = 4);
+		~FilePrefetcher();
+
+		FilePrefetcher(const FilePrefetcher&) = delete;
+		FilePrefetcher(FilePrefetcher&&) = delete;
+		FilePrefetcher &operator=(const FilePrefetcher&) = delete;
+		FilePrefetcher &operator=(FilePrefetcher&&) = delete;
+
+		//!Copy the regions of a (resolved) path from the cache
+		//@return bool success False if any region wasn't prefetched; nothing is copied then
+		bool take(const String &path, ListRef<const IoRegion> regions);
+
+		//!Drop the cached regions of a (resolved) path that changed; recursive also drops the ones of its children
+		//Regions that are being read while it changes aren't cached either
+		void invalidate(const String &path, bool recursive);
+
+		PrefetchStats getStats() const;
+
+	private:
+
+		struct Region {
+			FileSize offset, size;
+		};
+
+		struct CachedRegion {
+			FileSize offset, size;
+			Buffer data;
+		};
+
+		//!A path of the manifest
+		struct PrefetchedFile {
+
+			List<CachedRegion> cached;
+
+			//!The regions that were read before they were prefetched
+			List<Region> demanded;
+
+			//!Increased when the file changes, so reads that started before it aren't cached
+			u64 generation{};
+		};
+
+		static bool isDemanded(const PrefetchedFile &file, FileSize offset, FileSize size);
+
+		static void work(FilePrefetcher *prefetcher);
+
+		FileSystem *fs;
+		List<FileAccessRecord> records;
+		FileSize budget;
+
+		//!Only the paths of the manifest are tracked, so reads of other files don't grow the map
+		PathMap<PrefetchedFile> files;
+
+		PrefetchStats stats;
+
+		mutable std::mutex mutex;
+		std::condition_variable released;
+		List<std::future<void>> workers;
+
+		//!The next record to prefetch
+		usz next{};
+		bool running{ true };
+
+	};
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include "system/file_system.hpp"
+#include <future>
+
+namespace oic {
+
+	//!Sequential buffered access to a file
+	//Reads go through a double buffered window; while one window is consumed, the next one is read in the background
+	//Reads that are at least as big as the window skip the buffers and are read into the destination directly
+	//Writes are collected into a window and written when it's full, the stream seeks or flush is called
+	//Memory use is bounded by two windows for reading (and one for writing), independent of the file size
+	class FileStream {
+
+	public:
+
+		static constexpr usz defaultWindow = 256_KiB;
+
+		//!Open the file at the path; the file is closed when the stream is destroyed
+		//The stream isn't valid if the file couldn't be opened
+		FileStream(FileSystem *fs, const String &path, FileFlags flags = FileFlags::READ, usz window = defaultWindow);
+
+		//!Stream a file that's opened (and closed) by the caller
+		FileStream(File *file, usz window = defaultWindow);
+
+		~FileStream();
+
+		FileStream(const FileStream&) = delete;
+		FileStream(FileStream&&) = delete;
+		FileStream &operator=(const FileStream&) = delete;
+		FileStream &operator=(FileStream&&) = delete;
+
+		//!Read up to size bytes at the current position and move past them
+		//@return usz count The number of bytes read; less than size at the end of the file or when a read failed
+		usz read(void *v, usz size);
+
+		//!Write size bytes at the current position and move past them
+		//The data is only written to the file once the window is full or the stream is flushed
+		bool write(const void *v, usz size);
+
+		//!Write the buffered data to the file
+		bool flush();
+
+		//!Move the current position; flushes the buffered writes
+		bool seek(FileSize offset);
+
+		FileSize size() const;
+
+		inline FileSize tell() const { return position; }
+		inline bool eof() const { return position >= size(); }
+
+		inline bool valid() const { return file; }
+		inline usz getWindow() const { return window; }
+
+	private:
+
+		//!Make the window containing the position current; using the prefetched window if it matches
+		bool refill();
+
+		//!Start reading the window after the current one in the background
+		void prefetchNext();
+
+		//!Wait for the background read; the next window is invalid if it failed
+		void waitPrefetch();
+
+		//!Drop the read windows, since a write can change their data
+		void invalidateWindows();
+
+		FileSystem *fs{};
+		File *file{};
+
+		usz window;
+		FileSize position{};
+
+		Buffer current, next;
+		FileSize currentOffset{}, nextOffset{};
+		usz currentSize{}, nextSize{};
+
+		std::future<bool> prefetch;
+
+		Buffer pendingWrite;
+		FileSize writeOffset{};
+
+	};
+
+}
@@ -1,8 +1,16 @@
 #pragma once
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <condition_variable>
+#include <future>
+#include <unordered_set>
 #include "types/types.hpp"
+#include "types/list_ref.hpp"
 #include "system/system.hpp"
 #include "system/log.hpp"
+#include "utils/shared_mutex.hpp"
 
 namespace oic {
 
@@ -49,12 +57,40 @@ namespace oic {
 	//!A handle to a file
 	using FileHandle = u32;
 
+	//!Returned when a file can't be found
+	static constexpr FileHandle invalidFileHandle = u32_MAX;
+
+	//!A handle to a virtual file that stays valid until the file is removed; moves and other files don't change it
+	//The slot of a removed file can be reused, but its generation changes, so an old id is detected in O(1)
+	struct FileId {
+
+		FileHandle handle = invalidFileHandle;
+		u32 generation{};
+
+		inline bool operator==(const FileId&) const = default;
+	};
+
+	//!Hash that allows looking up Strings by StringView without allocating
+	struct PathHash {
+		using is_transparent = void;
+		inline usz operator()(StringView str) const { return std::hash<StringView>{}(str); }
+	};
+
+	template<typename V>
+	using PathMap = std::unordered_map<String, V, PathHash, std::equal_to<>>;
+
 	//!Max size of a file
 	using FileSize = usz;
 
+	//!A region of a file and the memory it's read into or written from
+	struct IoRegion {
+		FileSize offset{}, size{};
+		void *data{};
+	};
+
     //!The queried info about a file
-    //The layout of a recursive file structure:
-    //folders, files, recursive
+    //The children of a virtual folder are stored as a list of handles:
+    //folders, files
     struct FileInfo {
 
 		//friend class FileSystem;
@@ -82,13 +118,13 @@ namespace oic {
         //!The parent's file id
 		FileHandle parent{};
 
-        //!The start location of the folders
+        //!The start location of the folders in the children of the folder
 		FileHandle folderHint{};
 
-        //!The start location of the files (fileHint - folderHint = folderCount)
+        //!The start location of the files in the children (fileHint - folderHint = folderCount)
 		FileHandle fileHint{};
 
-        //!The end location of the files (fileEnd - fileHint = fileCount)
+        //!The end location of the files in the children (fileEnd - fileHint = fileCount)
 		FileHandle fileEnd{};
 
         //!The flags of this file
@@ -115,14 +151,170 @@ namespace oic {
 
     };
 
+	//!The virtual files of a file system, stored as arrays so lookups and traversal stay in cache
+	//The handles, hints and flags of the files are contiguous (nodes), the rest is stored separately (metadata)
+	//Paths are stored in one string arena and the name of a file is the end of its path
+	//The look up table only stores handles; it hashes the paths in the arena
+	//Removed files leave their path in the arena until most of it is unused, then the arena is compacted
+	//FileInfo is only used to pass files in and out of the table
+	class VirtualFileTable {
+
+	public:
+
+		struct Node {
+
+			u32 pathOffset, pathLength, nameLength;
+
+			FileHandle parent, folderHint, fileHint, fileEnd;
+
+			FileFlags flags;
+
+			inline bool isFolder() const { return FileInfo::hasFlags(flags, FileFlags::IS_FOLDER); }
+			inline bool isVirtual() const { return FileInfo::hasFlags(flags, FileFlags::IS_VIRTUAL); }
+			inline bool hasAccess(FileAccess access) const { return FileInfo::hasFlags(flags, FileFlags(access)); }
+		};
+
+		struct Metadata {
+			time_t modificationTime;
+			void *dataExt;
+			FileSize fileSize;
+		};
+
+		VirtualFileTable();
+
+		VirtualFileTable(const VirtualFileTable&) = delete;
+		VirtualFileTable(VirtualFileTable&&) = delete;
+		VirtualFileTable &operator=(const VirtualFileTable&) = delete;
+		VirtualFileTable &operator=(VirtualFileTable&&) = delete;
+
+		//!The number of slots (including removed files)
+		inline FileHandle size() const { return FileHandle(nodes.size()); }
+
+		void reserve(usz files, usz pathBytes = 0);
+
+		//!Append a file; the hints are set by FileSystem::initLut
+		FileHandle push(const FileInfo &info);
+
+		//!Append a virtual file if its path isn't in the table yet; one look up instead of a find and a push
+		//@return FileHandle handle; invalidFileHandle if the path already exists (nothing is appended)
+		FileHandle pushUnique(const FileInfo &info);
+
+		//!Store a file into a slot (or append it if the handle is the size)
+		void insert(FileHandle handle, const FileInfo &info);
+
+		//!Clear a slot; it's empty (without flags) until it's reused
+		void erase(FileHandle handle);
+
+		//!Change the path of a file (and so its name)
+		void rename(FileHandle handle, StringView path);
+
+		//!Find a file by resolved path
+		FileHandle find(StringView path) const;
+
+		//!The id of the file in a slot; the generation of a slot changes every time its file is removed
+		inline FileId id(FileHandle handle) const { return FileId{ handle, generations[handle] }; }
+
+		//!If the file of the id wasn't removed
+		inline bool isValid(FileId id) const {
+			return id.handle < size() && generations[id.handle] == id.generation;
+		}
+
+		inline StringView path(FileHandle handle) const {
+			const Node &n = nodes[handle];
+			return StringView(arena.data() + n.pathOffset, n.pathLength);
+		}
+
+		inline StringView name(FileHandle handle) const {
+			const Node &n = nodes[handle];
+			return StringView(arena.data() + n.pathOffset + n.pathLength - n.nameLength, n.nameLength);
+		}
+
+		inline Node &node(FileHandle handle) { return nodes[handle]; }
+		inline const Node &node(FileHandle handle) const { return nodes[handle]; }
+
+		inline Metadata &metadata(FileHandle handle) { return metadatas[handle]; }
+		inline const Metadata &metadata(FileHandle handle) const { return metadatas[handle]; }
+
+		//!Copy a file into an info; reuses the strings of the info, so a loop doesn't allocate for every file
+		void get(FileHandle handle, FileInfo &info) const;
+
+		inline FileInfo operator[](FileHandle handle) const {
+			FileInfo info;
+			get(handle, info);
+			return info;
+		}
+
+		//!The bytes allocated by the table (including the look up table's nodes and buckets)
+		usz memoryUsage() const;
+
+	private:
+
+		//!Hashes handles by their path, so paths can be looked up without storing them twice
+		struct Hash {
+			using is_transparent = void;
+			const VirtualFileTable *table;
+			inline usz operator()(StringView path) const { return std::hash<StringView>{}(path); }
+			inline usz operator()(FileHandle handle) const { return (*this)(table->path(handle)); }
+		};
+
+		struct Equal {
+			using is_transparent = void;
+			const VirtualFileTable *table;
+			inline StringView path(StringView path) const { return path; }
+			inline StringView path(FileHandle handle) const { return table->path(handle); }
+			template<typename A, typename B>
+			inline bool operator()(const A &a, const B &b) const { return path(a) == path(b); }
+		};
+
+		//!Store a path at the end of the arena
+		u32 append(StringView path);
+
+		//!Move the paths of the files together, dropping the paths of removed files
+		void compact();
+
+		List<Node> nodes;
+		List<Metadata> metadatas;
+		List<u32> generations;
+
+		String arena;
+		usz unusedBytes{};
+
+		std::unordered_set<FileHandle, Hash, Equal> lut;
+
+	};
+
 	class FileSystem;
 
     //!A callback for handling file changes and loops
+    //@warning foreachFile calls it while the file system is locked for reading; it can't add, remove or move files
+    //			(that fails instead of waiting on itself), so collect the paths and change them after the loop
     using FileCallback = void (*)(FileSystem*, const FileInfo&, void*);
 
     //!A callback for handling file changes and loops
     using FileChangeCallback = void (*)(FileSystem*, const FileInfo&, FileChange, void*);
 
+	//!A file change as it's passed to batch callbacks
+	struct FileChangeEvent {
+
+		FileInfo info;
+		FileChange change;
+
+		//!The previous path if the file was moved (before it was removed or moved again)
+		String oldPath;
+	};
+
+    //!A callback for handling a batch of file changes
+    using FileChangeBatchCallback = void (*)(FileSystem*, const List<FileChangeEvent>&, void*);
+
+	//!A read recorded by the access trace of a file system
+	struct FileAccessRecord {
+		String path;
+		FileSize offset{}, size{};
+	};
+
+	class FilePrefetcher;
+	struct PrefetchStats;
+
 	//!A virtual or physical file
 	class File {
 
@@ -134,6 +326,9 @@ namespace oic {
 		FileInfo f;
 		bool isOpen{}, hasWritten{};
 
+		//!Used by map when the file can't be mapped
+		Buffer mapCopy;
+
 		File(FileSystem *fs, const FileInfo f): fs(fs), f(f) {}
 		virtual ~File();
 
@@ -142,14 +337,61 @@ namespace oic {
 		virtual bool read(void *v, FileSize size, FileSize offset) const = 0;
 		virtual bool write(const void *v, FileSize size, FileSize offset) = 0;
 
+		//!Read multiple regions of the file; by default one read per region
+		//Implementations can coalesce adjacent regions into fewer calls
+		virtual bool readv(ListRef<const IoRegion> regions) const;
+
+		//!Write multiple regions of the file; by default one write per region
+		virtual bool writev(ListRef<const IoRegion> regions);
+
 		virtual bool resize(FileSize size) = 0;
 
+		//!Preallocate storage for the file to grow to the size, without changing the size
+		//Only a hint; allows the file system to allocate the file in one go
+		virtual bool reserve(FileSize) { return true; }
+
+		//!Map the file into memory (read only); valid until the file is closed
+		//Falls back to copying the file into memory if it can't be mapped
+		virtual ListRef<const u8> map();
+
 		inline bool hasRegion(FileSize size, FileSize offset) const { return f.hasRegion(size, offset); }
 
 		inline const FileInfo &getFile() const { return f; }
 		inline usz size() const { return f.fileSize; }
 	};
 
+	//!A read only view onto the memory of a file
+	//Keeps the file open (and mapped) until the view is destroyed
+	class FileView {
+
+		FileSystem *fs{};
+		File *file{};
+		ListRef<const u8> data;
+
+	public:
+
+		FileView() = default;
+		FileView(FileSystem *fs, File *file);
+		~FileView();
+
+		FileView(const FileView&) = delete;
+		FileView &operator=(const FileView&) = delete;
+		FileView(FileView &&other);
+		FileView &operator=(FileView &&other);
+
+		//!If the file could be opened
+		inline bool valid() const { return file; }
+
+		inline const ListRef<const u8> &get() const { return data; }
+		inline usz size() const { return data.size(); }
+		inline bool empty() const { return data.empty(); }
+
+		inline const u8 *begin() const { return data.begin(); }
+		inline const u8 *end() const { return data.end(); }
+
+		inline const u8 &operator[](usz i) const { return data[i]; }
+	};
+
     //!The class responsible for handling file I/O
     //A file system can also be implemented for an archive as well as a native file system
     //Every file system supports virtual files, though local and global files aren't always guaranteed
@@ -164,10 +406,18 @@ namespace oic {
 	//
 	//Note: Keep in mind that virtual FileInfo& is only valid while the FileSystem hasn't been resized (add/remove/move)
 	//		and doesn't hold all values for local files (such as file/folder hints, parent)
-	//		Use paths to avoid referencing invalid data; and lock & unlock the file system when reading or writing from it
+	//		Virtual file handles stay the same until the file is removed, after which they can be reused
+	//		Use paths or FileIds to avoid referencing invalid data; a FileId detects that its file was removed
+	//		and lock & unlock the file system when reading or writing from it
+	//
+	//Lookups (get, exists, regionExists, foreachFile) only take a shared lock, so they don't block each other
+	//Modifications (add, remove, update, mov) take an exclusive lock; this lock can be taken recursively,
+	//so callbacks are allowed to use the file system. Modifying the file system while reading it isn't allowed
 	//
 	class FileSystem {
 
+		friend class FilePrefetcher;
+
 	public:
 
 		//!Initialize the file system
@@ -175,7 +425,7 @@ namespace oic {
 		FileSystem(const FileAccess virtualFileAccess);
 
 		//Constructors
-		virtual ~FileSystem() = default;
+		virtual ~FileSystem();
 
 		FileSystem(const FileSystem &) = delete;
 		FileSystem &operator=(const FileSystem &) = delete;
@@ -187,14 +437,24 @@ namespace oic {
 		//	every retryTimeout it will attempt to open it again until maxTimeout is reached
 		virtual File *open(const FileInfo &inf, ns maxTimeout = 500_ms, ns retryTimeout = 100_ms) = 0;
 
+		//!Open a virtual file by id
+		//@return File *file; null if the file was removed or can't be read
+		File *open(FileId id, ns maxTimeout = 500_ms, ns retryTimeout = 100_ms);
+
 		//!Open a file by path
 		inline File *open(const String &path, FileFlags flags, ns maxTimeout = 500_ms, ns retry = 100_ms) { 
 
-			const auto fi = get(path);
+			auto fi = get(path);
 
 			if (!fi.hasFlags(flags))
 				return nullptr;
 
+			//Local files are only opened for writing if that's requested, so read-only mounts and files can be read
+			//(Virtual files can't be, since their write access decides where their data is stored)
+
+			if (fi.isLocal() && !FileInfo::hasFlags(flags, FileFlags::WRITE))
+				fi.flags = FileFlags(u8(fi.flags) & ~u8(FileFlags::WRITE));
+
 			return open(fi, maxTimeout, retry);
 		}
 
@@ -202,34 +462,123 @@ namespace oic {
 		void close(File *f);
 
 		//!Called to add a file modification callback at a directory
+		//The callback only receives changes to the directory and the files in it
+		//A directory can have multiple callbacks, but the same callback and data is only added once
 		void addFileChangeCallback(FileChangeCallback, const String &, void *);
 
-		//!Called to remove a file modification callback
+		//!Called to remove all file modification callbacks at a directory
 		void removeFileChangeCallback(const String&);
 
+		//!Called to remove a file modification callback (with the same data) at a directory
+		//Waits for other threads that are calling it, so its data can be freed afterwards
+		void removeFileChangeCallback(FileChangeCallback, const String&, void*);
+
+		//!Called to add a callback that receives all changes of a directory in a batch
+		//Without a change window, every batch is a single change
+		void addFileChangeBatchCallback(FileChangeBatchCallback, const String &, void *);
+
+		//!Called to remove a batch callback (with the same data) at a directory
+		//Waits for other threads that are calling it, so its data can be freed afterwards
+		void removeFileChangeBatchCallback(FileChangeBatchCallback, const String&, void*);
+
+		//!Coalesce file changes for a window and deliver them on a worker thread, outside of the file system lock
+		//Changes to the same path in a window are merged (e.g. ADD + UPDATE + UPDATE = ADD, ADD + DEL = nothing)
+		//A window of 0 (default) delivers every change directly, while the file system is locked
+		//@warning Don't call this from a file change callback or while the file system is locked
+		void setChangeWindow(ns window);
+
+		//!Deliver the pending changes on the current thread
+		//@warning The current thread can't have the file system locked
+		void flushChanges();
+
+		//!Record the regions that are read (or viewed) until the trace is stopped
+		//Every region is only recorded the first time, in the order it was read; used as a prefetch manifest
+		void startAccessTrace();
+
+		//!Stop recording and get the recorded regions (with resolved paths)
+		List<FileAccessRecord> stopAccessTrace();
+
+		//!Read the regions of a manifest ahead of the reads that need them (see FilePrefetcher)
+		//@param[in] budget The max number of bytes kept in memory for reads that haven't happened yet
+		//@return bool success False if the manifest couldn't be loaded
+		bool startPrefetch(const String &manifest, FileSize budget = 64_MiB);
+		void startPrefetch(List<FileAccessRecord> records, FileSize budget = 64_MiB);
+
+		//!Stop prefetching and release the prefetched regions that weren't read
+		//@warning File systems have to stop prefetching before they're destroyed, since prefetching opens files
+		void stopPrefetch();
+
+		PrefetchStats getPrefetchStats() const;
+
 		//!Get the properties of a file
 		//@param[in] path The target file object with oic file notation
 		//@warning Throws if the file doesn't exist
-		const FileInfo get(const String &path) const;
+		const FileInfo get(StringView path) const;
+
+		//!Get the properties of a virtual file by id, without looking up its path
+		//@warning Throws if the file was removed
+		const FileInfo get(FileId id) const;
+
+		//!Get the id of a virtual file; stays valid until the file is removed
+		//@param[in] path The target file object with oic file notation
+		//@return FileId id; invalid if the file isn't virtual or doesn't exist
+		FileId getId(StringView path) const;
+
+		//!If the file of the id still exists; O(1)
+		bool isValid(FileId id) const;
+
+		//!Find the handle of a virtual file, without copying its info
+		//@param[in] path The target file object with oic file notation
+		//@return FileHandle handle The index into getVirtualFiles() or invalidFileHandle if it isn't virtual or doesn't exist
+		FileHandle find(StringView path) const;
 
 		//!Resolve the path to a normal file directory (without ../ and ./)
 		//@param[in] path The target file object with oic file notation
 		//@param[out] outPath
 		//@return bool exists Whether the path leads to a valid path
-		bool resolvePath(const String &path, String &outPath) const;
+		bool resolvePath(StringView path, String &outPath) const;
+
+		//!Resolve the path without allocating if it's already resolved
+		//@param[in] path The target file object with oic file notation
+		//@param[out] outPath Either the path or the buffer
+		//@param[out] buffer Where the path is stored if it had to be resolved
+		//@return bool exists Whether the path leads to a valid path
+		bool resolvePath(StringView path, StringView &outPath, String &buffer) const;
+
+		//!If the path doesn't have to be resolved (no ../, ./, // or trailing /)
+		static bool isResolved(StringView path);
 
 		//!Allows looping through the children of a folder
+		//Virtual folders are locked for reading while the callbacks run, so they can't modify the file system
 		bool foreachFile(const String &path, FileCallback callback, bool recurse, void*);
 
+		//!Loops through all children of a folder recursively, using multiple threads
+		//Folders are distributed over the threads with work stealing; callbacks receive a copy of the file info,
+		//so the file system isn't locked while they run
+		//Unless ordered is set, callbacks can run on any of the threads at the same time (so they have to be thread safe)
+		//If ordered is set, the callbacks are called on the current thread in the same order as foreachFile, after traversal
+		//Runs on the current thread only if it already has access to the file system (e.g. from a callback)
+		//@param[in] usz threads; 0 uses all hardware threads
+		bool foreachFileParallel(const String &path, FileCallback callback, void *data, usz threads = 0, bool ordered = false);
+
+		//!Find the virtual files that match a glob pattern
+		//* matches any part of a name, ? any character, [abc], [a-z] and [!a-z] a character of a class
+		//and ** any number of folders (if it's the last part, every file below the folder)
+		//The pattern is matched one folder at a time: the literal parts are looked up directly
+		//and only the folders that can match are entered, so the virtual tree itself is the index
+		//@param[in] pattern The pattern in oic file notation (~/shaders/**/*.frag)
+		//@return List<FileId> matches; in the order of the folders (folders first), unless ** is used more than once
+		List<FileId> query(const String &pattern) const;
+
 		//!Detect if the path exists
 		//@param[in] path The target file object with oic file notation
 		//@return bool exists Whether the path leads to a valid path
-		bool exists(const String &path) const;
+		bool exists(StringView path) const;
 
 		//!Detect if the path exists
 		//@param[in] path The target file object with oic file notation
 		//@return bool exists Whether the file has the specified region
-		bool regionExists(const String &path, FileSize size, FileSize offset) const;
+		bool regionExists(StringView path, FileSize size, FileSize offset) const;
 
 		//!Read a (part of a) file into an address (means you have to allocate 'size' bytes)
 		//@param[in] path The path in oic file notation
@@ -247,6 +596,21 @@ namespace oic {
 		//@return bool success
 		bool read(const String &file, Buffer &buffer, FileSize size = 0, FileSize offset = 0);
 
+		//!Read multiple regions of a file while only opening it once
+		//@param[in] path The path in oic file notation
+		//@param[in] regions The regions; every destination has to have 'size' bytes allocated
+		bool read(const String &path, ListRef<const IoRegion> regions);
+
+		//!Read from a virtual file by id (see the reads by path); fails if the file was removed
+		bool read(FileId id, u8 *address, FileSize size, FileSize offset);
+		bool read(FileId id, Buffer &buffer, FileSize size = 0, FileSize offset = 0);
+		bool read(FileId id, ListRef<const IoRegion> regions);
+
+		//!Obtain a read only view of a file without copying it (if possible)
+		//@param[in] path The path in oic file notation
+		//@return FileView view; not valid if the file couldn't be opened
+		FileView view(const String &path);
+
 		//!Read a (part of a) file into a buffer, throws on fail
 		//@param[in] path The path in oic file notation
 		//@param[in] size The number of bytes to read (0 = all by default)
@@ -263,10 +627,11 @@ namespace oic {
 		}
 
 		//!Write to a (part of a) file from an address
+		//Only the written range is changed; the file grows if the range ends after it
 		//@param[in] path The path in oic file notation
 		//@param[out] address (u8[size])
 		//@param[in] size The number of bytes to read (non-zero)
-		//@param[in] offset The byte offset in the file
+		//@param[in] offset The byte offset in the file (usz_MAX = append)
 		//@return bool success
 		bool write(const String &file, const u8 *address, FileSize size, FileSize offset);
 
@@ -282,6 +647,14 @@ namespace oic {
 		//Same as write but creates a file if possible if the file cannot be found
 		bool writeNew(const String &file, const Buffer &buffer, FileSize size = 0, usz bufferOffset = 0, FileSize fileOffset = 0);
 
+		//!Replace the contents of a file, without readers ever seeing a partially written file
+		//Local files are written to a temporary file that's flushed to disk and renamed over the file
+		//The file is created if it doesn't exist yet
+		//@param[in] path The path in oic file notation
+		//@return bool success
+		bool writeAtomic(const String &file, const u8 *address, FileSize size);
+		bool writeAtomic(const String &file, const Buffer &buffer);
+
 		//!Add a directory or file
 		//@param[in] path The path in oic file notation
 		//@param[in] isFolder If the file is capable of having children
@@ -303,6 +676,8 @@ namespace oic {
 		bool update(const String &path);
 
 		//!Move a file to a destination (and rename)
+		//Virtual files and folders can be moved into any folder; a folder is moved with its children
+		//The destination folder has to exist and the destination itself can't exist yet
 		//@param[in] path The path in oic file notation
 		//@param[in] newPath The destination path in oic file notation
 		//@param bool isCallback; if this is true, it only invokes the callbacks
@@ -310,13 +685,69 @@ namespace oic {
 		//@return bool success
 		bool mov(const String &path, const String &newPath, bool isCallback = false);
 
+		//!Copy a file to a destination; the destination is created if it doesn't exist yet
+		//File systems can share the data between both files instead of copying it (see copyShared)
+		//@param[in] path The path in oic file notation
+		//@param[in] newPath The destination path in oic file notation
+		//@return bool success
+		bool copy(const String &path, const String &newPath);
+
+		//!Stages adds, removes and moves of virtual files, so they can be applied at once
+		//Applying validates every change first; if one is invalid, nothing is changed
+		//The changes are applied under one lock, every changed folder has its children rebuilt once
+		//and the callbacks are sent the changes together (a batch callback receives them in one call)
+		class Batch {
+
+		public:
+
+			Batch(FileSystem *fs);
+
+			//!Stage a change; the paths are resolved when the batch is applied
+			void add(const String &path, bool isFolder);
+			void remove(const String &path);
+			void mov(const String &path, const String &newPath);
+
+			inline usz size() const { return operations.size(); }
+
+			//!Apply the staged changes (in order) and clear the batch
+			//@return bool success False if a change was invalid (nothing is changed then)
+			bool apply();
+
+		private:
+
+			enum class Type : u8 {
+				ADD, ADD_FOLDER, DEL, MOVE
+			};
+
+			struct Operation {
+				String path, newPath;
+				Type type;
+			};
+
+			//!Check the changes against the files they would have after the previous changes
+			bool validate() const;
+
+			FileSystem *fs;
+			List<Operation> operations;
+		};
+
 		//Sizes of the file system
 
-		inline FileHandle virtualSize() const { return FileHandle(virtualFiles.size()); }
-		inline const List<FileInfo> &getVirtualFiles() const { return virtualFiles; }
+		inline FileHandle virtualSize() const { return FileHandle(virtualFiles.size() - freeVirtualFiles.size()); }
+
+		//!All virtual file slots; removed files are left as empty slots (without flags) until they are reused
+		inline const VirtualFileTable &getVirtualFiles() const { return virtualFiles; }
 
-		void lock();		//Wait for the file system to be available
-		void unlock();		//Release the file system
+		//!The children of a virtual folder; folders in [folderHint, fileHint), files in [fileHint, fileEnd)
+		inline const List<FileHandle> &getChildren(FileHandle folder) const { return virtualChildren[folder]; }
+
+		void lock();			//Wait for the file system to be available (exclusive)
+		void unlock();			//Release the file system
+
+		bool lockShared() const;		//Wait for the file system to be readable; false if the thread already has access
+		void unlockShared() const;		//Release the file system after reading
+
+		bool hasAccess() const;			//If the thread already has shared or exclusive access
 
 		//Local access; not always present
 
@@ -336,8 +767,27 @@ namespace oic {
 		//!Deletes a local file
 		virtual bool delLocal(const String &) = 0;
 
-		//!Creates the look up tables by file path
+		//!Writes the new contents of a local file to a unique temporary file next to it and flushes it to disk
+		//This doesn't touch the file system, so it's done before it's locked
+		virtual bool writeTempLocal(const String &, const u8 *address, FileSize size, String &temp) = 0;
+
+		//!Replaces a local file with the temporary file atomically (creates the file if it doesn't exist)
+		//The temporary file is removed if it can't be replaced
+		virtual bool replaceLocal(const String &, const String &temp) = 0;
+
+		//!Creates the look up tables by file path and the children by parent
 		void initLut();
+
+		//!Insert a virtual file into the folder of its parent handle, without checking access or sending changes
+		//@return FileHandle handle The slot the file was stored in
+		FileHandle insertVirtual(FileInfo info);
+
+		//!Remove a virtual file (that doesn't have children) without sending changes
+		void eraseVirtual(FileHandle handle);
+
+		//!Move a virtual file (and its children) into a folder under a new path, without checking access or sending changes
+		//The handles stay the same, only the paths of the subtree are rewritten; O(subtree)
+		void moveVirtual(FileHandle handle, FileHandle parent, const String &path);
     
         //!Called to initialize the file system cache
         virtual void initFiles() = 0;
@@ -345,6 +795,27 @@ namespace oic {
 		//!Used to handle file changes and update the metadata for the file
 		virtual void onFileChange(const FileInfo &, FileChange) {}
 
+		//!Called before a change to a (resolved) path is handled or when the path stops being watched
+		//Used to drop cached data about the path; recursive if the children could've changed too
+		//Drops the prefetched regions of the path, so overrides have to call it as well
+		virtual void invalidate(const String &path, bool recursive);
+
+		//!If a file change callback covers the (resolved) path; takes the read lock if the thread doesn't have access yet
+		bool isWatched(StringView path) const;
+
+		//!Read regions of a (resolved) path without opening a File, e.g. through a cached handle
+		//@param[out] bool success If the regions were read
+		//@return bool handled If false, the file is opened and read normally
+		virtual bool readCached(const String &, ListRef<const IoRegion>, bool &) { return false; }
+
+		//!Hint that a region of a (resolved) local path will be read soon, e.g. so the OS can read it ahead
+		//@return bool handled If false, the region is read into the prefetch cache instead
+		virtual bool prefetchLocal(const String &, FileSize, FileSize) { return false; }
+
+		//!Let an existing (resolved) destination file share the data of a file, e.g. until either is written to
+		//@return bool handled If false, the data is read and written instead
+		virtual bool copyShared(const FileInfo &, const String &) { return false; }
+
 		//!Start the watcher that updates the local file system
 		//Called when a file change callback is created
 		//should be handled in a different thread
@@ -355,24 +826,137 @@ namespace oic {
 		virtual void endFileWatcher(const String &path) = 0;
 
 		//!File cache
-		List<FileInfo> virtualFiles;
+		VirtualFileTable virtualFiles;
 
     private:
 
 		//!Helper function to obtain parts of the path (parses the ../ and ./ first)
-		static usz obtainPath(const String &path, List<String> &splits);
+		static usz obtainPath(StringView path, List<String> &splits);
+
+		//!Copy the info of the direct children of a folder
+		void getFileObjects(const FileInfo &folder, List<FileInfo> &children) const;
+
+		//!Call the callback for the children of a virtual folder (and their children if recursive)
+		//@param[inout] scratch Reused for every child, so the paths don't have to be allocated for every file
+		void foreachVirtual(FileHandle folder, FileCallback callback, bool recurse, void *data, FileInfo &scratch);
+
+		//!Add the children of a virtual folder that match the rest of a pattern (split by /)
+		void queryVirtual(FileHandle folder, const List<StringView> &parts, usz part, List<FileId> &matches) const;
+
+		//!Add a virtual file to the children of its parent (folders first) or remove it from them
+		void linkVirtual(FileHandle handle);
+		void unlinkVirtual(FileHandle handle);
+
+		//!Replace the path of a virtual file and the start of the paths of its children
+		void renameVirtual(FileHandle handle, const String &path);
+
+		//!Children of every virtual file (folders first, then files)
+		List<List<FileHandle>> virtualChildren;
+
+		//!Slots of removed virtual files that can be reused
+		List<FileHandle> freeVirtualFiles;
+
+		//!File change callbacks by path; every part of the path is a node
+		//A change is passed to the callbacks of every node on its path, so dispatching is O(path depth)
+		struct ChangeCallback {
+
+			FileChangeCallback callback;
+			FileChangeBatchCallback batchCallback;
+			void *data;
+
+			inline bool operator==(const ChangeCallback&) const = default;
+		};
+
+		struct CallbackNode {
+			List<ChangeCallback> callbacks;
+			PathMap<std::unique_ptr<CallbackNode>> children;
+		};
+
+		//!Add a callback at a directory and start watching it
+		void addCallback(const ChangeCallback &callback, const String &path);
+
+		//!Remove a callback (or all callbacks if null) at a directory and stop watching it if it was the last
+		void removeCallbacks(const ChangeCallback *callback, const String &path);
+
+		//!Get the nodes from the root to the (resolved) path; stops at the first node that doesn't exist
+		void getCallbackNodes(StringView path, List<CallbackNode*> &nodes, bool create = false) const;
 
-		//!Rename file (no recursion)
-		void rename(const FileInfo &info, const String &path, bool setName);
+		//!Send a change to the callbacks of the file's path and optionally another path (e.g. the old path of a move)
+		//Queued if there's a change window, otherwise delivered directly
+		void notify(const FileInfo &info, FileChange change, StringView otherPath = {});
 
-		//!File id by path look up tables
-		HashMap<String, FileHandle> virtualFileLut;
+		//!Send multiple changes; without a change window, they're delivered together
+		void notify(List<FileChangeEvent> changes);
 
-        //!List of all file change callbacks
-        HashMap<String, std::pair<FileChangeCallback, void*>> callbacks;
+		//!Call the callbacks of the changes; the callbacks are found while the file system is locked, but called after
+		//Without access to the file system, the delivery lock is held while calling them, so removing a callback can wait
+		void deliverChanges(const List<FileChangeEvent> &changes);
 
-		std::mutex mutex;
+		//!Queue a change; merged with the pending change of the same path
+		void queueChange(FileChangeEvent change);
+
+		//!Delivers the pending changes every change window until the window is disabled
+		static void watchChanges(FileSystem *fs);
+
+        //!Root of all file change callbacks
+        std::unique_ptr<CallbackNode> callbacks;
+
+		//!Pending changes in the order they first happened; merged away changes have an empty path
+		List<FileChangeEvent> pendingChanges;
+		PathMap<usz> pendingChangeLut;
+		usz pendingChangeCount{};
+		ns pendingSince{}, changeWindow{};
+
+		bool stopChanges{};
+
+		std::mutex changeMutex;
+		std::recursive_mutex deliverMutex;
+		std::condition_variable changeSignal;
+		std::future<void> changeWorker;
+
+		//!Record a read of a (resolved) path if the access trace is enabled
+		void traceAccess(const String &path, ListRef<const IoRegion> regions);
+
+		//!Copy the regions of a (resolved) path from the prefetch cache
+		bool readPrefetched(const String &path, ListRef<const IoRegion> regions);
+
+		//!Access trace; recorded regions by path so they're only recorded once
+		std::atomic<bool> isTracing{};
+		List<FileAccessRecord> accessTrace;
+		PathMap<List<std::pair<FileSize, FileSize>>> tracedRegions;
+		std::mutex traceMutex;
+
+		//!Shared with the reads that are using it, so it can be stopped while reading
+		std::shared_ptr<FilePrefetcher> prefetcher;
+		std::atomic<bool> isPrefetching{};
+		mutable std::mutex prefetcherMutex;
+
+		//!Prefers writers, so the watcher isn't starved by lookups
+		mutable SharedMutex mutex;
+
+		//!The thread that has exclusive access and how often it locked
+		std::atomic<std::thread::id> writer{};
+		u32 writeDepth{};
 
     };
 
+	//!Scoped locks for the file system; released when an exception leaves the scope
+
+	struct FileSystemReadLock {
+
+		const FileSystem *fs;
+		bool locked;
+
+		FileSystemReadLock(const FileSystem *fs): fs(fs), locked(fs->lockShared()) {}
+		~FileSystemReadLock() { if (locked) fs->unlockShared(); }
+	};
+
+	struct FileSystemWriteLock {
+
+		FileSystem *fs;
+
+		FileSystemWriteLock(FileSystem *fs): fs(fs) { fs->lock(); }
+		~FileSystemWriteLock() { fs->unlock(); }
+	};
+
 }
\ No newline at end of file
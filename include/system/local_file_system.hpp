@@ -1,10 +1,19 @@
 #pragma once
 #include "types/types.hpp"
 #include "system/file_system.hpp"
+#include "system/memory_file_store.hpp"
+#include <list>
+#include <memory>
 
 namespace oic {
 
+	//!Statistics of the local metadata cache
+	struct MetadataCacheStats {
+		usz hits{}, misses{}, invalidations{};
+	};
+
 	//!Subclass for file systems that are linked to a directory
+	//Files that are created in the virtual tree (~/) are writable and stored in memory (see MemoryFileStore)
 	class LocalFileSystem : public FileSystem {
 
 	public:
@@ -21,6 +30,25 @@ namespace oic {
 
 		File *open(const FileInfo &info, ns maxTimeout, ns retryTimeout) final override;
 
+		//!Cache the metadata of local files, so repeated queries don't stat the file again
+		//Entries in watched folders are kept until a file change invalidates them, others expire after the ttl
+		//@param[in] ns ttl; 0 disables (and clears) the cache
+		void setMetadataCache(ns ttl);
+
+		MetadataCacheStats getMetadataCacheStats() const;
+
+		//!Keep up to maxFiles local files open for reading, so FileSystem::read doesn't have to open them every time
+		//Files are closed when they're changed through the file system or the watcher, or when they're least recently used
+		//Files replaced by other processes are only noticed if a file change callback covers them
+		//@param[in] usz maxFiles; 0 disables the cache (and closes the files)
+		void setFileCache(usz maxFiles);
+
+		//!Limit the memory of the writable virtual files; beyond it the least recently used files are spilled to disk
+		//@param[in] FileSize budget; 0 keeps every file in memory
+		void setMemoryFileBudget(FileSize budget);
+
+		MemoryFileStats getMemoryFileStats() const;
+
 	protected:
 
 		//!Make or delete files
@@ -32,6 +60,12 @@ namespace oic {
 		//!Remove a file/folder in the physical directory
 		bool delLocal(const String &path) final override;
 
+		//!Write to a unique temporary file next to the file (with the same permissions) and flush it to disk
+		bool writeTempLocal(const String &path, const u8 *address, FileSize size, String &temp) final override;
+
+		//!Rename the temporary file over the file and flush the folder to disk
+		bool replaceLocal(const String &path, const String &temp) final override;
+
 		//!Open virtual file
 		virtual File *openVirtual(const FileInfo &file) = 0;
 
@@ -45,10 +79,61 @@ namespace oic {
 		//@param[in] FileChange change
 		virtual void onVirtualFileChange(const FileInfo &, FileChange) { }
 
+		void invalidate(const String &path, bool recursive) final override;
+
+		bool readCached(const String &path, ListRef<const IoRegion> regions, bool &success) final override;
+
+		//!Let the OS read the region ahead (posix_fadvise), so it's in the page cache when it's read
+		bool prefetchLocal(const String &path, FileSize size, FileSize offset) final override;
+
+		//!Writable virtual files share their chunks until either is written to
+		bool copyShared(const FileInfo &file, const String &path) final override;
+
 	private:
 
+		struct CachedStat {
+			ns time;
+			time_t modificationTime;
+			FileSize fileSize;
+			FileFlags flags;
+			bool exists, isWatched;
+		};
+
+		//!Stat a resolved local path, through the cache if it's enabled
+		bool statLocal(const String &apath, CachedStat &result) const;
+
+		//!Close the cached files of the path (and its children if recursive)
+		void closeOpenFiles(const String &path, bool recursive);
+
 		String localPath;
 
+		ns metadataTtl{};
+
+		mutable PathMap<CachedStat> metadata;
+		mutable MetadataCacheStats metadataStats;
+
+		//Increased by every invalidation, so a stat that started before one isn't cached
+		mutable u64 metadataEpoch{};
+		mutable std::mutex metadataMutex;
+
+		//!Closes the file once the cache and all reads are done with it
+		struct OpenFile;
+
+		struct CachedFile {
+			String path;
+			std::shared_ptr<OpenFile> file;
+		};
+
+		usz maxOpenFiles{};
+
+		//!Open files; most recently used first
+		std::list<CachedFile> openFiles;
+		PathMap<std::list<CachedFile>::iterator> openFileLut;
+		std::mutex openFileMutex;
+
+		//!The data of the writable virtual files (referenced by their dataExt)
+		MemoryFileStore memoryFiles;
+
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+#include "system/file_system.hpp"
+#include <list>
+
+namespace oic {
+
+	//!Statistics of a MemoryFileStore
+	struct MemoryFileStats {
+
+		usz files{}, chunks{}, spilledFiles{};
+
+		//!Bytes of chunks in memory (shared chunks are counted once) and bytes that are spilled to disk
+		FileSize memory{}, maxMemory{}, spilledBytes{};
+
+		//!How often files were spilled to disk and loaded back
+		usz spills{}, reloads{};
+	};
+
+	//!Storage of writable virtual files
+	//A file is a list of fixed size chunks, so growing it never moves the data that's already written
+	//Copied files share their chunks until one of them writes to a chunk (copy on write)
+	//If the chunks in memory exceed the budget, the least recently used files are spilled to temporary files
+	//and loaded back when they're accessed again
+	class MemoryFileStore {
+
+	public:
+
+		static constexpr FileSize chunkSize = 64_KiB;
+
+		//!The data of a file; referenced by its FileInfo and every File that has it open
+		struct Node;
+
+		//!@param[in] budget The max bytes of chunks kept in memory (0 = unlimited)
+		MemoryFileStore(FileSize budget = 0);
+		~MemoryFileStore();
+
+		MemoryFileStore(const MemoryFileStore&) = delete;
+		MemoryFileStore(MemoryFileStore&&) = delete;
+		MemoryFileStore &operator=(const MemoryFileStore&) = delete;
+		MemoryFileStore &operator=(MemoryFileStore&&) = delete;
+
+		//!Create an empty file with one reference
+		Node *create();
+
+		void retain(Node *node);
+		void release(Node *node);
+
+		//!Make the file share the data of another file
+		bool copy(Node *destination, Node *source);
+
+		FileSize size(Node *node) const;
+
+		bool read(Node *node, void *v, FileSize size, FileSize offset);
+
+		//!Write into the file; grows the file if the region ends after it
+		bool write(Node *node, const void *v, FileSize size, FileSize offset);
+
+		bool resize(Node *node, FileSize size);
+
+		//!Change the budget; files are spilled right away if the memory exceeds it
+		void setBudget(FileSize budget);
+
+		MemoryFileStats getStats() const;
+
+	private:
+
+		using Chunk = std::shared_ptr<u8[]>;
+
+		Chunk allocate();
+
+		//!Make the node the most recently used and load it back if it was spilled
+		bool touch(Node *node);
+
+		//!Make sure a chunk isn't shared before it's written to
+		void makeUnique(Chunk &chunk);
+
+		bool resizeLocked(Node *node, FileSize size);
+
+		//!Spill the least recently used files until the memory is within the budget
+		void trim(const Node *keep);
+
+		bool spill(Node *node);
+		bool reload(Node *node);
+
+		//!Most recently used first
+		std::list<Node*> nodes;
+
+		FileSize budget;
+		MemoryFileStats stats;
+		u64 nextSpill{};
+
+		mutable std::mutex mutex;
+
+	};
+
+}
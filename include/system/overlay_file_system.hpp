@@ -0,0 +1,106 @@
+#pragma once
+#include "system/file_system.hpp"
+
+namespace oic {
+
+	//!Statistics of a mounted layer
+	//entries: The files and folders of the merged tree that come from the layer
+	//hits: How often files of the layer were opened through the overlay
+	struct OverlayLayerStats {
+		usz entries{}, hits{};
+	};
+
+	//!A read only file system that merges the trees of other file systems (layers) into its virtual tree (~/)
+	//Layers are mounted in order; a file in a later layer hides the file with the same path in earlier layers
+	//Folders are merged, unless a later layer has a file with the same path
+	//
+	//The merged tree is stored as the virtual files of the overlay, so lookups don't have to check every layer
+	//The dataExt of a merged file points to the layer it's resolved to
+	//Every layer is watched; a change to a layer only resolves the changed paths (and their children) again
+	//
+	//@warning A layer that changes should deliver its changes outside of its lock (see FileSystem::setChangeWindow),
+	//			because the overlay locks itself before it locks the layers
+	class OverlayFileSystem : public FileSystem {
+
+	public:
+
+		OverlayFileSystem();
+		~OverlayFileSystem();
+
+		//!Mount a folder of a file system on top of the other layers
+		//The file system has to stay valid until it's unmounted or the overlay is destroyed
+		//@param[in] source The file system of the layer
+		//@param[in] root The folder that's mounted as ~/ (e.g. ~/patch or ./mods/example)
+		//@return usz layer The index of the layer (or usz_MAX if the root isn't a folder)
+		usz mount(FileSystem *source, const String &root = "~");
+
+		//!Unmount a layer; the layers after it move down by one
+		bool unmount(usz layer);
+
+		inline usz getLayerCount() const { return layers.size(); }
+
+		//!The statistics of every layer, in mount order
+		List<OverlayLayerStats> getLayerStats() const;
+
+		//!Open the file in the layer it's resolved to
+		File *open(const FileInfo &info, ns maxTimeout, ns retryTimeout) final override;
+
+		const FileInfo local(const String &path) const final override;
+		bool hasLocal(const String&) const final override { return false; }
+		bool hasLocalRegion(const String&, FileSize, FileSize) const final override { return false; }
+
+		List<String> localDirectories(const String&) const final override { return {}; }
+		List<String> localFileObjects(const String&) const final override { return {}; }
+		List<String> localFiles(const String&) const final override { return {}; }
+
+	protected:
+
+		bool makeLocal(const String&, bool) final override { return false; }
+		bool delLocal(const String&) final override { return false; }
+		bool writeTempLocal(const String&, const u8*, FileSize, String&) final override { return false; }
+		bool replaceLocal(const String&, const String&) final override { return false; }
+
+		void initFiles() final override {}
+
+		//The layers are watched instead
+
+		void startFileWatcher(const String&) final override {}
+		void endFileWatcher(const String&) final override {}
+
+	private:
+
+		struct Layer {
+
+			OverlayFileSystem *overlay;
+			FileSystem *source;
+			String root;
+
+			usz entries{};
+			std::atomic<usz> hits{};
+
+			bool isMounted{};
+
+			//!Path in the layer of a merged path
+			String toLayer(const String &path) const;
+
+			//!Merged path of a path in the layer; false if it's not in the mounted folder
+			bool fromLayer(StringView path, String &result) const;
+		};
+
+		//!Resolve a merged path again; the last layer that has the path provides it
+		//Children are only resolved if recursive, or if the folder wasn't in the merged tree yet
+		//@param[in] removed A layer that the path (and its children) are being removed from
+		void resolve(const String &path, bool recursive, const Layer *removed = nullptr);
+
+		//!Remove a merged file and its children
+		void removeEntry(FileHandle handle);
+
+		//!Resolves the paths of the changes of a layer
+		static void onLayerChange(FileSystem *source, const List<FileChangeEvent> &changes, void *layer);
+
+		//!Layers are referenced by the merged files and callbacks, so they can't move
+		List<std::unique_ptr<Layer>> layers;
+
+	};
+
+}
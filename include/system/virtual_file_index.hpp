@@ -0,0 +1,34 @@
+#pragma once
+#include "types/types.hpp"
+
+namespace oic {
+
+	//!A virtual file in the index that's embedded into executables by configure_virtual_files
+	struct VirtualFileEntry {
+
+		//!The handle of the parent folder (0 = ~)
+		u32 parent;
+
+		//!The path (offset and length in the string table) and the start of the name in the path
+		u32 path, pathLength, name;
+
+		//!The embedded data; null for folders
+		const u8 *begin, *end;
+
+		//!If the data is stored as CompressedChunks (add_virtual_files COMPRESS)
+		bool isCompressed;
+	};
+
+	//!The virtual files of an executable
+	//Entries are stored in file handle order (starting at 1); folders first, sorted by path, so parents are before their children
+	//Everything is constant data, so loading it doesn't require any parsing
+	struct VirtualFileIndex {
+		const VirtualFileEntry *entries;
+		u32 count;
+		const c8 *strings;
+	};
+
+}
+
+//!Generated by configure_virtual_files; not present if the executable doesn't have virtual files
+extern "C" const oic::VirtualFileIndex oicVirtualFileIndex;
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <limits>
 #include <string>
+#include <string_view>
 #include <codecvt>
 #include <vector>
 #include <array>
@@ -98,6 +99,7 @@ static constexpr f64 TO_RAD = PI_CONST / 180;
 //Containers
 
 using String = std::string;
+using StringView = std::string_view;
 using WString = std::u16string;
 
 static inline WString fromUTF8(const String &str) {
@@ -0,0 +1,34 @@
+#pragma once
+#include "types/types.hpp"
+#include "types/list_ref.hpp"
+
+namespace oic {
+
+	//!Data that's split into chunks which are LZ4 compressed separately, so ranges can be read without decompressing everything
+	//Layout: Header, u64 offsets[chunks + 1] (seek table, relative to the chunk data), chunk data
+	//Chunks that don't get smaller are stored uncompressed
+	struct CompressedChunks {
+
+		struct Header {
+			u32 magic, chunkSize;
+			u64 size;
+		};
+
+		static constexpr u32 magic = 0x4B435A4C;		//LZCK
+		static constexpr u32 defaultChunkSize = 64 * 1024;
+
+		//!Compress the data
+		static List<u8> compress(ListRef<const u8> data, u32 chunkSize = defaultChunkSize);
+
+		//!The uncompressed size or 0 if the data doesn't have a valid header and seek table
+		static u64 size(ListRef<const u8> compressed);
+
+		//!Decompress a range of the data
+		//Only the chunks that overlap the range are decompressed
+		//@param[in] threads How many threads can decompress chunks (0 = hardware concurrency)
+		//@return bool success If the range is in bounds and the chunks were valid
+		static bool read(ListRef<const u8> compressed, void *output, u64 size, u64 offset, usz threads = 1);
+
+	};
+
+}
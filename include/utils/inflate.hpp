@@ -0,0 +1,18 @@
+#pragma once
+#include "types/types.hpp"
+#include "types/list_ref.hpp"
+
+namespace oic {
+
+	//!Decompresses raw deflate streams (RFC 1951), such as the entries of a ZIP archive
+	struct Inflate {
+
+		//!Decompress the stream into the output
+		//@param[in] input The deflate stream (without zlib or gzip header)
+		//@param[out] output The memory the data is decompressed into; has to be the exact decompressed size
+		//@return bool success If the stream was valid and filled the output exactly
+		static bool decompress(ListRef<const u8> input, ListRef<u8> output);
+
+	};
+
+}
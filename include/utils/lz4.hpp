@@ -0,0 +1,25 @@
+#pragma once
+#include "types/types.hpp"
+#include "types/list_ref.hpp"
+
+namespace oic {
+
+	//!Compresses and decompresses LZ4 blocks (without frame header)
+	//Compression is greedy and optimized for speed; decompression doesn't need any state
+	struct Lz4 {
+
+		//!Compress the input
+		//@param[in] input The data to compress
+		//@param[out] output The memory the block is written to
+		//@return usz size The size of the block or 0 if it doesn't fit into the output
+		static usz compress(ListRef<const u8> input, ListRef<u8> output);
+
+		//!Decompress a block
+		//@param[in] input The block
+		//@param[out] output The memory the data is decompressed into; has to be the exact decompressed size
+		//@return bool success If the block was valid and filled the output exactly
+		static bool decompress(ListRef<const u8> input, ListRef<u8> output);
+
+	};
+
+}
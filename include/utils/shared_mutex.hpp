@@ -0,0 +1,81 @@
+#pragma once
+#include "types/types.hpp"
+#include <atomic>
+
+namespace oic {
+
+	//!A shared mutex that prefers writers; once a writer waits, new readers wait until it's done
+	//std::shared_mutex prefers readers on some platforms (glibc), so a steady stream of readers can starve writers
+	//Not recursive; the state is one atomic, so an uncontended lock is a single compare exchange
+	class SharedMutex {
+
+	public:
+
+		SharedMutex() = default;
+
+		SharedMutex(const SharedMutex&) = delete;
+		SharedMutex(SharedMutex&&) = delete;
+		SharedMutex &operator=(const SharedMutex&) = delete;
+		SharedMutex &operator=(SharedMutex&&) = delete;
+
+		void lock() {
+
+			u32 s = state.fetch_add(waiter, std::memory_order_relaxed) + waiter;
+
+			while (true) {
+
+				if (s & (locked | readers))
+					state.wait(s, std::memory_order_relaxed);
+
+				else if (state.compare_exchange_weak(s, (s - waiter) | locked, std::memory_order_acquire))
+					return;
+
+				s = state.load(std::memory_order_relaxed);
+			}
+		}
+
+		void unlock() {
+			state.fetch_and(~locked, std::memory_order_release);
+			state.notify_all();
+		}
+
+		void lock_shared() {
+
+			u32 s = state.load(std::memory_order_relaxed);
+
+			while (true) {
+
+				if (s & (locked | waiters))
+					state.wait(s, std::memory_order_relaxed);
+
+				else if (state.compare_exchange_weak(s, s + 1, std::memory_order_acquire))
+					return;
+
+				s = state.load(std::memory_order_relaxed);
+			}
+		}
+
+		void unlock_shared() {
+
+			//Only the last reader has to wake the waiting writers
+
+			const u32 s = state.fetch_sub(1, std::memory_order_release);
+
+			if ((s & readers) == 1 && (s & waiters))
+				state.notify_all();
+		}
+
+	private:
+
+		//Readers in the low bits, then the waiting writers and if a writer has the lock
+
+		static constexpr u32 readers = (1 << 20) - 1;
+		static constexpr u32 waiter = 1 << 20;
+		static constexpr u32 waiters = ((1u << 31) - 1) & ~readers;
+		static constexpr u32 locked = 1u << 31;
+
+		std::atomic<u32> state{};
+
+	};
+
+}
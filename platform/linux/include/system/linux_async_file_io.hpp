@@ -0,0 +1,75 @@
+#pragma once
+#include "system/async_file_io.hpp"
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace oic {
+
+	//!Reads local files through io_uring
+	//Virtual files, opened files and systems without io_uring fall back to the thread pool
+	class LAsyncFileIO : public AsyncFileIO {
+
+	public:
+
+		LAsyncFileIO(FileSystem *fs, usz threads, u32 entries = 256);
+		~LAsyncFileIO();
+
+		//!If io_uring is used
+		inline bool isNative() const { return ring >= 0; }
+
+	protected:
+
+		bool submitNative(const FileRequest &request, u64 id, ns start) final override;
+		void flushNative() final override;
+
+	private:
+
+		struct InFlight {
+			String path;
+			u64 id;
+			void *userData;
+			ns start;
+			u8 *destination;
+			FileSize size, offset;
+			i32 fd;
+		};
+
+		static void reap(LAsyncFileIO *io);
+
+		//!Push a read of the slot (or the stop signal) into the submission queue (requires the lock)
+		void push(u64 slot);
+
+		//!Submit the queued entries to the kernel (requires the lock)
+		void enter();
+
+		//!Release the file of a finished slot (requires the lock)
+		void release(u32 slot);
+
+		i32 ring{ -1 };
+
+		void *sqRing{}, *cqRing{};
+		usz sqRingSize{}, cqRingSize{}, sqesSize{};
+
+		u32 *sqHead{}, *sqTail{}, *sqMask{}, *sqArray{};
+		u32 *cqHead{}, *cqTail{}, *cqMask{};
+
+		io_uring_sqe *sqes{};
+		io_uring_cqe *cqes{};
+
+		u32 sqEntries{}, toSubmit{};
+
+		List<InFlight> inFlight;
+		List<u32> freeSlots;
+
+		//!Open files and the number of requests using them
+		HashMap<String, Pair<i32, u32>> files;
+
+		std::mutex mutex;
+		std::condition_variable slotCondition;
+
+		std::future<void> reaper;
+
+	};
+
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include "system/local_file_system.hpp"
+#include <future>
+
+namespace oic {
+
+	class LFileSystem : public LocalFileSystem {
+
+	public:
+
+		LFileSystem();
+		~LFileSystem();
+
+	protected:
+
+		File *openVirtual(const FileInfo &file) final override;
+
+		void startFileWatcher(const String &location) final override;
+		void endFileWatcher(const String &location) final override;
+		void initFiles() final override;
+
+		List<String> localDirectories(const String &path) const final override;
+		List<String> localFileObjects(const String &path) const final override;
+		List<String> localFiles(const String &path) const final override;
+
+		//!Watches all directories through one inotify fd until the stop event is signalled
+		static void watchFileSystem(LFileSystem *fs);
+
+		//!Add a watch to the folder and all of its sub folders
+		//@param[in] announce Send add events for the children (for folders created while watching)
+		void addWatch(const String &path, bool announce);
+
+		//!Handle all queued inotify events
+		void handleEvents(const u8 *buffer, usz size);
+
+		i32 inotify{ -1 }, epoll{ -1 }, stopEvent{ -1 };
+		std::future<void> thread;
+
+		//!Protects the watches, since they're modified by both the watcher and the caller
+		std::mutex watchMutex;
+
+		//!The oic path of every inotify watch
+		HashMap<i32, String> watches;
+
+		//!The watched roots and how often they're watched
+		HashMap<String, u32> roots;
+
+	};
+
+}
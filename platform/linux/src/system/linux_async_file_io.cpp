@@ -0,0 +1,292 @@
+#include "system/linux_async_file_io.hpp"
+#include "system/log.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+namespace oic {
+
+	AsyncFileIO *AsyncFileIO::create(FileSystem *fs, usz threads) {
+		return new LAsyncFileIO(fs, threads);
+	}
+
+	//The ring is shared with the kernel, so head and tail have to be synchronized with it
+
+	static inline u32 loadAcquire(u32 *v) { return std::atomic_ref<u32>(*v).load(std::memory_order_acquire); }
+	static inline void storeRelease(u32 *v, u32 val) { std::atomic_ref<u32>(*v).store(val, std::memory_order_release); }
+
+	static constexpr u64 stopSignal = u64_MAX;
+
+	//Reads are split into parts, since the kernel limits the size of a single read
+
+	static constexpr FileSize maxReadSize = 1_GiB;
+
+	LAsyncFileIO::LAsyncFileIO(FileSystem *fs, usz threads, u32 entries): AsyncFileIO(fs, threads) {
+
+		io_uring_params params{};
+		ring = i32(syscall(__NR_io_uring_setup, entries, &params));
+
+		//Not supported (or not allowed); the thread pool is used instead
+
+		if (ring < 0) {
+			System::log()->warn("io_uring isn't available; falling back to threaded file reads");
+			return;
+		}
+
+		sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+		cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+		const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+
+		if (singleMap)
+			sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+
+		sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+		cqRing = singleMap ? sqRing :
+			mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+
+		void *sqePtr = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+
+		if (sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqePtr == MAP_FAILED) {
+			System::log()->fatal("Couldn't map io_uring");
+			return;
+		}
+
+		u8 *sq = (u8*) sqRing, *cq = (u8*) cqRing;
+
+		sqHead = (u32*)(sq + params.sq_off.head);
+		sqTail = (u32*)(sq + params.sq_off.tail);
+		sqMask = (u32*)(sq + params.sq_off.ring_mask);
+		sqArray = (u32*)(sq + params.sq_off.array);
+		sqEntries = params.sq_entries;
+		sqes = (io_uring_sqe*) sqePtr;
+
+		cqHead = (u32*)(cq + params.cq_off.head);
+		cqTail = (u32*)(cq + params.cq_off.tail);
+		cqMask = (u32*)(cq + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+		//Every request in flight has a slot and the reaper consumes its completion before the slot is reused
+		//So there are never more completions than slots and the completion queue can't overflow
+
+		inFlight.resize(params.cq_entries);
+		freeSlots.resize(params.cq_entries);
+
+		for (u32 i = 0; i < params.cq_entries; ++i)
+			freeSlots[i] = params.cq_entries - 1 - i;
+
+		reaper = std::async(std::launch::async, reap, this);
+	}
+
+	LAsyncFileIO::~LAsyncFileIO() {
+
+		if (ring < 0)
+			return;
+
+		//Wait for the requests in flight and stop the reaper
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			slotCondition.wait(lock, [this]() { return freeSlots.size() == inFlight.size(); });
+
+			push(stopSignal);
+			enter();
+		}
+
+		reaper.wait();
+
+		for (auto &file : files)
+			close(file.second.first);
+
+		munmap(sqes, sqesSize);
+
+		if (cqRing != sqRing)
+			munmap(cqRing, cqRingSize);
+
+		munmap(sqRing, sqRingSize);
+		close(ring);
+	}
+
+	void LAsyncFileIO::push(u64 slot) {
+
+		const u32 tail = *sqTail;
+		const u32 index = tail & *sqMask;
+
+		io_uring_sqe &sqe = sqes[index];
+		std::memset(&sqe, 0, sizeof(sqe));
+
+		sqe.user_data = slot;
+
+		if (slot == stopSignal)
+			sqe.opcode = IORING_OP_NOP;
+
+		else {
+			const InFlight &f = inFlight[slot];
+			sqe.opcode = IORING_OP_READ;
+			sqe.fd = f.fd;
+			sqe.addr = u64(f.destination);
+			sqe.len = u32(std::min(f.size, maxReadSize));
+			sqe.off = f.offset;
+		}
+
+		sqArray[index] = index;
+		storeRelease(sqTail, tail + 1);
+
+		if (++toSubmit == sqEntries)
+			enter();
+	}
+
+	void LAsyncFileIO::enter() {
+
+		while (toSubmit) {
+
+			const i32 submitted = i32(syscall(__NR_io_uring_enter, ring, toSubmit, 0, 0, nullptr, 0));
+
+			if (submitted < 0) {
+
+				if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+					continue;
+
+				System::log()->fatal("Couldn't submit to io_uring");
+				return;
+			}
+
+			toSubmit -= u32(submitted);
+		}
+	}
+
+	void LAsyncFileIO::release(u32 slot) {
+
+		auto it = files.find(inFlight[slot].path);
+
+		if (!--it->second.second) {
+			close(it->second.first);
+			files.erase(it);
+		}
+
+		inFlight[slot].path.clear();
+		freeSlots.push_back(slot);
+	}
+
+	bool LAsyncFileIO::submitNative(const FileRequest &request, u64 id, ns start) {
+
+		if (ring < 0 || request.file)
+			return false;
+
+		String path;
+
+		if (!fs->resolvePath(request.path, path) || path[0] != '.')
+			return false;
+
+		std::unique_lock<std::mutex> lock(mutex);
+
+		//Wait for a request to finish if all slots are in use
+		//Finished requests can close files, so the file is only looked up after
+
+		if (freeSlots.empty()) {
+			enter();
+			slotCondition.wait(lock, [this]() { return !freeSlots.empty(); });
+		}
+
+		//Files are shared by all requests in flight
+
+		auto it = files.find(path);
+
+		if (it == files.end()) {
+
+			const i32 fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0)
+				return false;
+
+			it = files.insert({ path, { fd, 0 } }).first;
+		}
+
+		const u32 slot = freeSlots.back();
+		freeSlots.pop_back();
+
+		++it->second.second;
+
+		inFlight[slot] = InFlight{
+			path, id, request.userData, start,
+			request.destination, request.size, request.offset,
+			it->second.first
+		};
+
+		push(slot);
+		return true;
+	}
+
+	void LAsyncFileIO::flushNative() {
+
+		if (ring < 0)
+			return;
+
+		std::lock_guard<std::mutex> guard(mutex);
+		enter();
+	}
+
+	void LAsyncFileIO::reap(LAsyncFileIO *io) {
+
+		bool running = true;
+
+		while (running) {
+
+			if (syscall(__NR_io_uring_enter, io->ring, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) {
+				System::log()->fatal("Couldn't wait for io_uring");
+				return;
+			}
+
+			u32 head = *io->cqHead;
+			const u32 tail = loadAcquire(io->cqTail);
+
+			while (head != tail) {
+
+				//The entry is consumed before its slot is released or read again
+
+				const io_uring_cqe cqe = io->cqes[head & *io->cqMask];
+				storeRelease(io->cqHead, ++head);
+
+				if (cqe.user_data == stopSignal) {
+					running = false;
+					continue;
+				}
+
+				const u32 slot = u32(cqe.user_data);
+
+				std::unique_lock<std::mutex> lock(io->mutex);
+				InFlight &f = io->inFlight[slot];
+
+				//Continue partial reads
+
+				if (cqe.res > 0 && FileSize(cqe.res) < f.size) {
+					f.destination += cqe.res;
+					f.offset += cqe.res;
+					f.size -= cqe.res;
+					io->push(slot);
+					io->enter();
+					continue;
+				}
+
+				const bool success = cqe.res >= 0 && FileSize(cqe.res) == f.size;
+				const u64 id = f.id;
+				void *userData = f.userData;
+				const ns start = f.start;
+
+				io->release(slot);
+				lock.unlock();
+
+				io->slotCondition.notify_all();
+				io->complete(id, userData, start, success);
+			}
+		}
+	}
+
+}
@@ -0,0 +1,486 @@
+#include "system/linux_file_system.hpp"
+#include "system/system.hpp"
+#include "system/log.hpp"
+#include "system/virtual_file_index.hpp"
+#include "utils/compressed_chunks.hpp"
+
+#include <cstring>
+#include <exception>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+//The index is only linked in if the executable has virtual files
+extern "C" const oic::VirtualFileIndex oicVirtualFileIndex __attribute__((weak));
+
+namespace oic {
+
+	static constexpr u32 watchMask =
+		IN_CREATE | IN_DELETE | IN_MODIFY | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK;
+
+	static String getWorkingDirectory() {
+		String directory(PATH_MAX + 1, '\0');
+		return getcwd(directory.data(), directory.size()) ? String(directory.c_str()) : String();
+	}
+
+	LFileSystem::LFileSystem() : LocalFileSystem(getWorkingDirectory()) {
+		initFiles();
+		initLut();
+	}
+
+	LFileSystem::~LFileSystem() {
+
+		if (thread.valid()) {
+			eventfd_write(stopEvent, 1);
+			thread.wait();
+		}
+
+		for (i32 fd : { inotify, epoll, stopEvent })
+			if (fd >= 0)
+				::close(fd);
+
+		//Deliver the changes that are still pending and stop prefetching while this file system still exists
+
+		setChangeWindow(0);
+		stopPrefetch();
+	}
+
+	//Virtual files are stored in the executable (dataExt points to their VirtualFileEntry)
+	//Compressed files only decompress the chunks that are read; large reads are decompressed in parallel
+
+	class LVirtualFile : public File {
+
+	private:
+
+		static constexpr FileSize parallelReadSize = 1_MiB;
+
+		ListRef<const u8> data;
+		bool isCompressed{};
+
+		virtual ~LVirtualFile() = default;
+
+	public:
+
+		LVirtualFile(FileSystem *fs, const FileInfo &f): File(fs, f) {
+
+			if (const VirtualFileEntry *entry = (const VirtualFileEntry*) f.dataExt) {
+				data = { entry->begin, usz(entry->end - entry->begin) };
+				isCompressed = entry->isCompressed;
+			}
+
+			isOpen = f.dataExt || !f.fileSize;
+
+			if(!isOpen)
+				System::log()->fatal("File can't be opened");
+		}
+
+		bool read(void *v, FileSize size, FileSize offset) const final override {
+
+			if (offset + size > f.fileSize) {
+				System::log()->fatal("File read is out of bounds");
+				return false;
+			}
+
+			if (!isCompressed) {
+				std::memcpy(v, data.begin() + offset, size);
+				return true;
+			}
+
+			if (!CompressedChunks::read(data, v, size, offset, size >= parallelReadSize ? 0 : 1)) {
+				System::log()->fatal("Compressed file is corrupt");
+				return false;
+			}
+
+			return true;
+		}
+
+		//Write to file isn't allowed with virtual files
+
+		bool write(const void*, FileSize, FileSize) final override { return false; }
+		bool resize(FileSize) final override { return false; }
+
+		ListRef<const u8> map() final override {
+
+			if (!isCompressed)
+				return { data.begin(), f.fileSize };
+
+			if (mapCopy.size() != f.fileSize) {
+
+				mapCopy.resize(f.fileSize);
+
+				if (!read(mapCopy.data(), f.fileSize, 0)) {
+					mapCopy.clear();
+					return {};
+				}
+			}
+
+			return { mapCopy.data(), mapCopy.size() };
+		}
+	};
+
+	File *LFileSystem::openVirtual(const FileInfo &info) {
+		return new LVirtualFile(this, info);
+	}
+
+	//Watching the file system
+
+	void LFileSystem::addWatch(const String &path, bool announce) {
+
+		const i32 wd = inotify_add_watch(inotify, path.c_str(), watchMask);
+
+		if (wd < 0) {
+			System::log()->warn("Couldn't watch folder ", path);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(watchMutex);
+			watches[wd] = path;
+		}
+
+		//Files could've been created before the watch existed
+
+		if (announce)
+			for (const String &file : localFiles(path))
+				add(file, false, true);
+
+		for (const String &folder : localDirectories(path)) {
+
+			if (announce)
+				add(folder, true, true);
+
+			addWatch(folder, announce);
+		}
+	}
+
+	void LFileSystem::handleEvents(const u8 *buffer, usz size) {
+
+		//A move is a IN_MOVED_FROM directly followed by a IN_MOVED_TO with the same cookie
+		//If the destination isn't watched, it's the same as a remove
+
+		bool isMoving{};
+		u32 moveCookie{};
+		String movePath;
+
+		for (usz i = 0; i < size; ) {
+
+			const inotify_event *e = (const inotify_event*)(buffer + i);
+			i += sizeof(inotify_event) + e->len;
+
+			String path;
+
+			{
+				std::lock_guard<std::mutex> guard(watchMutex);
+
+				auto it = watches.find(e->wd);
+
+				if (it == watches.end())
+					continue;
+
+				if (e->mask & IN_IGNORED) {
+					watches.erase(it);
+					continue;
+				}
+
+				path = it->second;
+			}
+
+			//Events on the watched folder itself are handled by the parent's watch
+
+			if (!e->len)
+				continue;
+
+			path += "/";
+			path += e->name;
+
+			const bool isFolder = e->mask & IN_ISDIR;
+
+			//A change can fail if the file changed again before it's handled (e.g. a fatal in get)
+			//Then the event is skipped, so one event can't stop the watcher
+
+			try {
+
+				//Cached metadata is stale, even before the change is known
+
+				invalidate(path, true);
+
+				if (isMoving && !((e->mask & IN_MOVED_TO) && e->cookie == moveCookie)) {
+					remove(movePath, true);
+					isMoving = false;
+				}
+
+				if (e->mask & IN_MOVED_FROM) {
+					isMoving = true;
+					moveCookie = e->cookie;
+					movePath = path;
+				}
+
+				else if ((e->mask & IN_MOVED_TO) && isMoving) {
+
+					isMoving = false;
+
+					if (isFolder) {
+
+						std::lock_guard<std::mutex> guard(watchMutex);
+
+						for (auto &watch : watches)
+							if (watch.second == movePath || watch.second.starts_with(movePath + "/"))
+								watch.second = path + watch.second.substr(movePath.size());
+					}
+
+					//The file can be moved or removed again before the event is handled
+					//If the move can't be applied, it's sent as a remove and an add instead
+
+					bool moved{};
+
+					if (hasLocal(path))
+						try {
+							moved = mov(movePath, path, true);
+						} catch (const std::exception&) {}
+
+					if (!moved) {
+
+						remove(movePath, true);
+
+						if (hasLocal(path))
+							add(path, isFolder, true);
+					}
+				}
+
+				else if (e->mask & (IN_CREATE | IN_MOVED_TO)) {
+
+					if (!hasLocal(path))
+						continue;
+
+					add(path, isFolder, true);
+
+					if (isFolder)
+						addWatch(path, true);
+				}
+
+				else if (e->mask & IN_DELETE)
+					remove(path, true);
+
+				//If the file is removed right after this check, update fails and the remove event follows
+
+				else if ((e->mask & IN_MODIFY) && !isFolder && hasLocal(path))
+					update(path);
+
+			} catch (const std::exception &err) {
+				System::log()->warn("Couldn't handle file change of ", path, ": ", err.what());
+			}
+		}
+
+		if (isMoving)
+			try {
+				remove(movePath, true);
+			} catch (const std::exception &err) {
+				System::log()->warn("Couldn't handle file change of ", movePath, ": ", err.what());
+			}
+	}
+
+	void LFileSystem::watchFileSystem(LFileSystem *fs) {
+
+		alignas(inotify_event) u8 buffer[64_KiB];
+		epoll_event events[2];
+
+		while (true) {
+
+			const i32 count = epoll_wait(fs->epoll, events, 2, -1);
+
+			if (count < 0) {
+
+				if (errno == EINTR)
+					continue;
+
+				System::log()->fatal("Couldn't wait for file changes");
+				return;
+			}
+
+			for (i32 i = 0; i < count; ++i)
+				if (events[i].data.fd == fs->stopEvent)
+					return;
+
+			//Handle every batch of events at once
+
+			isz size;
+
+			while ((size = ::read(fs->inotify, buffer, sizeof(buffer))) > 0) {
+				FileSystemWriteLock lock(fs);
+				fs->handleEvents(buffer, usz(size));
+			}
+		}
+	}
+
+	void LFileSystem::startFileWatcher(const String &path) {
+
+		//Virtual files can only be changed through the file system
+
+		if (path[0] != '.' || roots[path]++)
+			return;
+
+		if (!thread.valid()) {
+
+			inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			stopEvent = eventfd(0, EFD_CLOEXEC);
+			epoll = epoll_create1(EPOLL_CLOEXEC);
+
+			if (inotify < 0 || stopEvent < 0 || epoll < 0) {
+				System::log()->fatal("Couldn't create the file watcher");
+				return;
+			}
+
+			epoll_event ev{};
+			ev.events = EPOLLIN;
+
+			ev.data.fd = inotify;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, inotify, &ev);
+
+			ev.data.fd = stopEvent;
+			epoll_ctl(epoll, EPOLL_CTL_ADD, stopEvent, &ev);
+
+			thread = std::async(std::launch::async, watchFileSystem, this);
+		}
+
+		addWatch(path, false);
+	}
+
+	void LFileSystem::endFileWatcher(const String &path) {
+
+		auto it = roots.find(path);
+
+		if (it == roots.end() || --it->second)
+			return;
+
+		roots.erase(it);
+
+		//Remove the watches that aren't used by other roots anymore
+
+		auto isInside = [](const String &file, const String &root) -> bool {
+			return file == root || file.starts_with(root + "/");
+		};
+
+		std::lock_guard<std::mutex> guard(watchMutex);
+
+		for (auto w = watches.begin(); w != watches.end(); ) {
+
+			bool isUsed = !isInside(w->second, path);
+
+			for (auto &root : roots)
+				isUsed |= isInside(w->second, root.first);
+
+			if (isUsed)
+				++w;
+
+			else {
+				inotify_rm_watch(inotify, w->first);
+				w = watches.erase(w);
+			}
+		}
+	}
+
+	//Finding files with one getdents64 pass per directory
+
+	template<bool includeFiles, bool includeFolders>
+	inline List<String> findFileObjects(const String &path) {
+
+		const i32 dir = openat(AT_FDCWD, path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+
+		if (dir < 0) {
+			System::log()->fatal("Invalid folder to scan");
+			return {};
+		}
+
+		List<String> objs;
+		objs.reserve(32);
+
+		alignas(dirent64) u8 buffer[16_KiB];
+		isz size;
+
+		while ((size = getdents64(dir, buffer, sizeof(buffer))) > 0)
+			for (isz i = 0; i < size; ) {
+
+				const dirent64 *ent = (const dirent64*)(buffer + i);
+				i += ent->d_reclen;
+
+				const c8 *name = ent->d_name;
+
+				//Skip .. and .
+				if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+					continue;
+
+				bool isFolder = ent->d_type == DT_DIR;
+
+				//Not all file systems report the type and symlinks have to be followed
+
+				if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+
+					struct stat st;
+
+					if (fstatat(dir, name, &st, 0))
+						continue;
+
+					isFolder = S_ISDIR(st.st_mode);
+				}
+
+				if (isFolder) {
+
+					if constexpr(includeFolders)
+						objs.push_back(path + "/" + name);
+
+				} else if constexpr(includeFiles)
+					objs.push_back(path + "/" + name);
+			}
+
+		::close(dir);
+		return objs;
+	}
+
+	List<String> LFileSystem::localDirectories(const String &path) const {
+		return findFileObjects<false, true>(path);
+	}
+
+	List<String> LFileSystem::localFileObjects(const String &path) const {
+		return findFileObjects<true, true>(path);
+	}
+
+	List<String> LFileSystem::localFiles(const String &path) const {
+		return findFileObjects<true, false>(path);
+	}
+
+	//Virtual files are embedded into the executable through the index generated by configure_virtual_files
+
+	void LFileSystem::initFiles() {
+
+		if (!&oicVirtualFileIndex)
+			return;
+
+		const VirtualFileIndex &index = oicVirtualFileIndex;
+
+		//The index is already in file handle order, so the files can be appended directly
+
+		virtualFiles.reserve(virtualFiles.size() + index.count);
+
+		for (u32 i = 0; i < index.count; ++i) {
+
+			const VirtualFileEntry &entry = index.entries[i];
+			const String path(index.strings + entry.path, entry.pathLength);
+
+			//Compressed files report their uncompressed size
+
+			const ListRef<const u8> data = { entry.begin, usz(entry.end - entry.begin) };
+			const FileSize size = entry.isCompressed ? CompressedChunks::size(data) : data.size();
+
+			virtualFiles.push(FileInfo{
+				path, path.substr(entry.name),
+				0, entry.begin ? (void*) &entry : nullptr, size, entry.parent, 0, 0, 0,
+				entry.begin ? FileFlags::VIRTUAL_FILE : FileFlags::VIRTUAL_FOLDER
+			});
+		}
+	}
+
+}
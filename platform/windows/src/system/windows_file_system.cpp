@@ -5,6 +5,7 @@
 
 #include <Windows.h>
 #include <codecvt>
+#include <charconv>
 #define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
 
 namespace oic {
@@ -21,10 +22,16 @@ namespace oic {
 	}
 
 	WFileSystem::~WFileSystem() {
+
 		for (auto &thr : threads) {
 			running[thr.first] = false;
 			thr.second.wait();
 		}
+
+		//Deliver the changes that are still pending and stop prefetching while this file system still exists
+
+		setChangeWindow(0);
+		stopPrefetch();
 	}
 
 	class WVirtualFile : public File {
@@ -81,6 +88,12 @@ namespace oic {
 			return true;
 		}
 
+		//The resource is already in memory
+
+		ListRef<const u8> map() final override {
+			return { (const u8*) data, f.fileSize };
+		}
+
 		//Write to file isn't allowed with virtual files
 
 		bool write(const void*, FileSize, FileSize) final override { return false; }
@@ -244,10 +257,10 @@ namespace oic {
 			if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
 
 				if constexpr(includeFolders)
-					objs.push_back(data.cFileName);
+					objs.push_back(path + "/" + data.cFileName);
 
 			} else if constexpr(includeFiles)
-				objs.push_back(data.cFileName);
+				objs.push_back(path + "/" + data.cFileName);
 
 		} while (FindNextFileA(file, &data));
 
@@ -282,14 +295,10 @@ namespace oic {
 
 		usz end = SizeofResource(nullptr, root);
 
-		List<FileInfo> files;
-		files.push_back(virtualFiles[0]);
-
-		files[0].fileHint = u32_MAX;
-		files[0].fileEnd = u32_MAX;
-		files[0].folderHint = u32_MAX;
+		//Ids are assigned in order by add_virtual_files and parents are always listed before their children,
+		//so the files can be appended directly and the parents are remapped while parsing
 
-		HashMap<u32, u32> unorderedIdToId;
+		List<FileHandle> idToHandle(1, 0);
 
 		usz prev{}, i0{}, i1{};
 
@@ -311,113 +320,59 @@ namespace oic {
 				usz k = data[i - 1] == '\r' ? i - 1 : i;
 
 				bool isFile = data[k - 1] == '|';
-				String name(data + i1 + 1, data + k - isFile);
+				String path(data + i1 + 1, data + k - isFile);
 
-				u32 parent = std::stoi(String(data + i0 + 1, data + i1));
+				u32 primaryId{}, parentId{};
+				std::from_chars(data + prev, data + i0, primaryId);
+				std::from_chars(data + i0 + 1, data + i1, parentId);
 
-				String primaryId = String(data + prev, data + i0);
-				u32 primaryIdi = std::stoi(primaryId);
+				i0 = i1 = 0;
+				prev = i + 1;
 
 				//Windows can't handle numbers as file names
 				//So we just use an underscore
 
-				String primary = '_' + primaryId;
+				String primary = "_" + std::to_string(primaryId);
 
 				auto file = isFile ?
 					FindResourceA(nullptr, primary.c_str(), RT_RCDATA) : nullptr;
 
-				HRESULT hr = GetLastError();
-				
-				if (FAILED(hr)) {
+				if (isFile && !file) {
 					oic::System::log()->warn("Missing symbol " + primary);
 					continue;
 				}
 
-				//Find the last file that has the same parent
-				//And insert after; otherwise, insert at end
-				//If it's a folder, stop when it first encounters a file
-
-				u32 j = 1;
-				bool inFolder{};
-
-				for (; j < u32(files.size()); ++j)
-
-					if (!isFile && inFolder && !files[j].isFolder())
-						break;
-
-					else if (files[j].parent == parent)
-						inFolder = true;
-
-					else if (inFolder)
-						break;
+				if (parentId >= idToHandle.size() || idToHandle[parentId] == invalidFileHandle) {
+					oic::System::log()->warn("Missing parent of virtual file " + path);
+					continue;
+				}
 
-				//Correct ids
+				if (primaryId >= idToHandle.size())
+					idToHandle.resize(primaryId + 1, invalidFileHandle);
 
-				for (auto &map : unorderedIdToId)
-					if (map.second >= j)
-						++map.second;
+				idToHandle[primaryId] = FileHandle(virtualFiles.size());
 
-				//Insert this entry
+				const usz slash = path.find_last_of('/');
 
-				unorderedIdToId[primaryIdi] = j;
+				//The children and hints are created by initLut
 
-				files.insert(files.begin() + j, FileInfo{
-					name,
-					name,
+				virtualFiles.push(FileInfo{
+					path,
+					path.substr(slash + 1),
 					0,
 					file,
 					isFile ? SizeofResource(nullptr, file) : 0,
-					parent,
+					idToHandle[parentId],
 					u32_MAX,
 					u32_MAX,
 					u32_MAX,
 					isFile ? FileFlags::VIRTUAL_FILE : FileFlags::VIRTUAL_FOLDER
 				});
-
-				i0 = i1 = 0;
-				prev = i + 1;
 			}
 		}
 
-		//Update references to parents and file hint if needed
-
-		for(u32 i = 1; i < u32(files.size()); ++i) {
-
-			auto &f = files[i];
-
-			//Lookup real parent
-
-			u32 parent = unorderedIdToId[f.parent];
-
-			f.parent = parent;
-			auto &p = files[parent];
-
-			if (f.isFolder()) {
-
-				//Since folders are ordered first, we only have to set folderHint and fileEnd to i + 1
-
-				if (p.folderHint == u32_MAX)
-					p.folderHint = i;
-
-				p.fileHint = p.fileEnd = i + 1;
-			}
-			else {
-
-				if (p.folderHint == u32_MAX)
-					p.folderHint = i;
-
-				if (p.fileHint == u32_MAX)
-					p.fileHint = i;
-
-				p.fileEnd = i + 1;
-			}
-
-		}
-
 		//Done with parsing root file
 
-		virtualFiles = files;
-
 		UnlockResource(rootHandle);
 		FreeResource(rootHandle);
 
@@ -0,0 +1,349 @@
+#include "system/archive_file_system.hpp"
+#include "utils/inflate.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace oic {
+
+	//ZIP records (little endian)
+
+	static constexpr u32
+		localHeaderSignature = 0x04034B50,
+		centralHeaderSignature = 0x02014B50,
+		endSignature = 0x06054B50,
+		end64LocatorSignature = 0x07064B50,
+		end64Signature = 0x06064B50;
+
+	static constexpr usz localHeaderSize = 30, centralHeaderSize = 46, endSize = 22, end64LocatorSize = 20, end64Size = 56;
+
+	static constexpr u16 methodStored = 0, methodDeflated = 8, flagEncrypted = 1, extraZip64 = 1;
+
+	template<typename T>
+	static inline T readLe(const u8 *ptr) {
+		T t;
+		std::memcpy(&t, ptr, sizeof(t));
+		return t;
+	}
+
+	//MS-DOS date and time (local time) to seconds since 1970
+
+	static time_t dosTime(u16 time, u16 date) {
+
+		i64 y = 1980 + (date >> 9), m = (date >> 5) & 0xF, d = date & 0x1F;
+
+		y -= m <= 2;
+		const i64 era = (y >= 0 ? y : y - 399) / 400;
+		const i64 yoe = y - era * 400;
+		const i64 doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+		const i64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+		const i64 days = era * 146097 + doe - 719468;
+
+		return time_t(days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3F) * 60 + (time & 0x1F) * 2);
+	}
+
+	//Entries are read from the archive; stored entries directly and deflated entries through a decompressed copy
+
+	class ArchiveFile : public File {
+
+	private:
+
+		ListRef<const u8> data;
+
+		virtual ~ArchiveFile() = default;
+
+	public:
+
+		ArchiveFile(FileSystem *fs, const FileInfo &f, ListRef<const u8> compressed, u16 method): File(fs, f) {
+
+			if (method == methodStored)
+				data = compressed;
+
+			else {
+
+				mapCopy.resize(f.fileSize);
+
+				if (Inflate::decompress(compressed, { mapCopy.data(), mapCopy.size() }))
+					data = { mapCopy.data(), mapCopy.size() };
+			}
+
+			isOpen = data.size() == f.fileSize;
+
+			if (!isOpen)
+				System::log()->fatal("Archive entry is corrupt");
+		}
+
+		bool read(void *v, FileSize size, FileSize offset) const final override {
+
+			if (offset + size > f.fileSize) {
+				System::log()->fatal("File read is out of bounds");
+				return false;
+			}
+
+			std::memcpy(v, data.begin() + offset, size);
+			return true;
+		}
+
+		//Archives are read only
+
+		bool write(const void*, FileSize, FileSize) final override { return false; }
+		bool resize(FileSize) final override { return false; }
+
+		ListRef<const u8> map() final override {
+			return data;
+		}
+	};
+
+	ArchiveFileSystem::ArchiveFileSystem(FileSystem *source, const String &path):
+		FileSystem(FileAccess::READ), source(source), file(source->open(path, FileFlags::READ))
+	{
+		if (file)
+			archive = file->map();
+
+		initFiles();
+		initLut();
+	}
+
+	ArchiveFileSystem::ArchiveFileSystem(ListRef<const u8> archive): FileSystem(FileAccess::READ), archive(archive) {
+		initFiles();
+		initLut();
+	}
+
+	ArchiveFileSystem::~ArchiveFileSystem() {
+
+		stopPrefetch();
+
+		if (file)
+			source->close(file);
+	}
+
+	File *ArchiveFileSystem::open(const FileInfo &info, ns, ns) {
+
+		if (info.isFolder()) {
+			System::log()->fatal("Can't open a folder");
+			return nullptr;
+		}
+
+		if (!info.isVirtual()) {
+			System::log()->fatal("Archives don't have local files");
+			return nullptr;
+		}
+
+		const Entry &entry = *(const Entry*) info.dataExt;
+		const u8 *header = archive.begin() + entry.localHeader;
+
+		//The local header can have different extra fields than the central directory
+
+		const FileSize start = entry.localHeader + localHeaderSize +
+			readLe<u16>(header + 26) + readLe<u16>(header + 28);
+
+		if (start > archive.size() || entry.compressedSize > archive.size() - start) {
+			System::log()->fatal("Archive entry is out of bounds");
+			return nullptr;
+		}
+
+		return new ArchiveFile(this, info, { archive.begin() + start, entry.compressedSize }, entry.method);
+	}
+
+	const FileInfo ArchiveFileSystem::local(const String&) const {
+		System::log()->fatal("Archives don't have local files");
+		return {};
+	}
+
+	//Get or create the folder of a path (without trailing slash)
+
+	static FileHandle obtainFolder(StringView path, VirtualFileTable &files) {
+
+		const FileHandle handle = files.find(path);
+
+		if (handle != invalidFileHandle)
+			return files.node(handle).isFolder() ? handle : invalidFileHandle;
+
+		const usz slash = path.find_last_of('/');
+		const FileHandle parent = obtainFolder(path.substr(0, slash), files);
+
+		if (parent == invalidFileHandle)
+			return invalidFileHandle;
+
+		return files.push(FileInfo{
+			String(path), String(path.substr(slash + 1)),
+			0, nullptr, 0, parent, 0, 0, 0,
+			FileFlags::VIRTUAL_FOLDER
+		});
+	}
+
+	void ArchiveFileSystem::initFiles() {
+
+		const u8 *begin = archive.begin();
+		const usz size = archive.size();
+
+		if (size < endSize) {
+			System::log()->fatal("Archive is invalid");
+			return;
+		}
+
+		//The end of the central directory is followed by a comment of up to 64 KiB
+
+		usz end = usz_MAX;
+
+		for (usz i = size - endSize + 1, last = size > endSize + 0xFFFF ? size - endSize - 0xFFFF : 0; i-- > last; )
+			if (readLe<u32>(begin + i) == endSignature) {
+				end = i;
+				break;
+			}
+
+		if (end == usz_MAX) {
+			System::log()->fatal("Archive doesn't have a central directory");
+			return;
+		}
+
+		usz count = readLe<u16>(begin + end + 10);
+		usz directorySize = readLe<u32>(begin + end + 12);
+		usz directory = readLe<u32>(begin + end + 16);
+
+		//ZIP64 stores the real values in a separate record
+
+		if (
+			end >= end64LocatorSize && readLe<u32>(begin + end - end64LocatorSize) == end64LocatorSignature
+		) {
+
+			const usz end64 = usz(readLe<u64>(begin + end - end64LocatorSize + 8));
+
+			if (end64 > size || size - end64 < end64Size || readLe<u32>(begin + end64) != end64Signature) {
+				System::log()->fatal("Archive has an invalid ZIP64 record");
+				return;
+			}
+
+			count = usz(readLe<u64>(begin + end64 + 32));
+			directorySize = usz(readLe<u64>(begin + end64 + 40));
+			directory = usz(readLe<u64>(begin + end64 + 48));
+		}
+
+		//Compared by subtraction, so offsets close to the maximum can't overflow
+
+		if (directory > size || directorySize > size - directory) {
+			System::log()->fatal("Archive central directory is out of bounds");
+			return;
+		}
+
+		//Every entry has at least a header, so a corrupt count can't reserve more than the directory can hold
+
+		count = std::min(count, directorySize / centralHeaderSize);
+
+		//Entries are referenced by pointer, so they can't be reallocated
+
+		entries.reserve(count);
+
+		auto &files = virtualFiles;
+		files.reserve(files.size() + count, directorySize);
+
+		//The info is reused, so the path isn't allocated for every entry (the name is the end of the path)
+
+		FileInfo info;
+		String &path = info.path;
+
+		//Entries are usually grouped by folder, so the last folder is checked first
+
+		String lastFolder = String(files.path(0));
+		FileHandle lastParent{};
+
+		for (usz i = 0, offset = directory; i < count; ++i) {
+
+			const u8 *header = begin + offset;
+
+			if (size - offset < centralHeaderSize || readLe<u32>(header) != centralHeaderSignature) {
+				System::log()->fatal("Archive central directory is invalid");
+				return;
+			}
+
+			const u16 flags = readLe<u16>(header + 8), method = readLe<u16>(header + 10);
+			const u16 nameLength = readLe<u16>(header + 28), extraLength = readLe<u16>(header + 30);
+
+			FileSize compressedSize = readLe<u32>(header + 20), fileSize = readLe<u32>(header + 24);
+			FileSize localHeader = readLe<u32>(header + 42);
+
+			const u8 *name = header + centralHeaderSize, *extra = name + nameLength;
+			offset += centralHeaderSize + nameLength + extraLength + readLe<u16>(header + 32);
+
+			if (offset > size) {
+				System::log()->fatal("Archive central directory is out of bounds");
+				return;
+			}
+
+			//ZIP64 extra field; only contains the values that didn't fit
+
+			for (const u8 *field = extra; field + 4 <= extra + extraLength; ) {
+
+				const u16 id = readLe<u16>(field), fieldSize = readLe<u16>(field + 2);
+				const u8 *value = field + 4, *valueEnd = value + fieldSize;
+
+				if (valueEnd > extra + extraLength)
+					break;
+
+				if (id == extraZip64) {
+
+					for (FileSize *v : { &fileSize, &compressedSize, &localHeader })
+						if (*v == u32_MAX && value + 8 <= valueEnd) {
+							*v = readLe<u64>(value);
+							value += 8;
+						}
+
+					break;
+				}
+
+				field = valueEnd;
+			}
+
+			path = "~/";
+			path.append((const c8*) name, nameLength);
+
+			const bool isFolder = path.back() == '/';
+
+			if (isFolder)
+				path.pop_back();
+
+			//Only valid paths and readable entries are added
+
+			if (!isResolved(path) || path.find('\\') != String::npos)
+				continue;
+
+			if (!isFolder && ((flags & flagEncrypted) || (method != methodStored && method != methodDeflated))) {
+				System::log()->warn("Archive entry is encrypted or uses an unsupported compression: ", path);
+				continue;
+			}
+
+			if (!isFolder && (localHeader > size || size - localHeader < localHeaderSize || readLe<u32>(begin + localHeader) != localHeaderSignature)) {
+				System::log()->warn("Archive entry has an invalid header: ", path);
+				continue;
+			}
+
+			const usz slash = path.find_last_of('/');
+			const StringView folder = StringView(path).substr(0, slash);
+
+			if (folder != lastFolder) {
+
+				lastParent = obtainFolder(folder, files);
+
+				if (lastParent == invalidFileHandle) {
+					lastFolder.clear();
+					continue;
+				}
+
+				lastFolder = folder;
+			}
+
+			//Duplicates keep the first entry
+
+			info.modificationTime = dosTime(readLe<u16>(header + 12), readLe<u16>(header + 14));
+			info.dataExt = isFolder ? nullptr : entries.data() + entries.size();
+			info.fileSize = isFolder ? 0 : fileSize;
+			info.parent = lastParent;
+			info.flags = isFolder ? FileFlags::VIRTUAL_FOLDER : FileFlags::VIRTUAL_FILE;
+
+			if (files.pushUnique(info) != invalidFileHandle && !isFolder)
+				entries.push_back(Entry{ localHeader, compressedSize, method });
+		}
+
+		isValid = true;
+	}
+
+}
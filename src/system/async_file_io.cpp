@@ -0,0 +1,158 @@
+#include "system/async_file_io.hpp"
+#include "utils/timer.hpp"
+
+namespace oic {
+
+	//Without a native implementation every request is handled by the thread pool
+
+	#ifndef __linux__
+
+		AsyncFileIO *AsyncFileIO::create(FileSystem *fs, usz threads) {
+			return new AsyncFileIO(fs, threads);
+		}
+
+	#endif
+
+	AsyncFileIO::AsyncFileIO(FileSystem *fs, usz threads): fs(fs) {
+
+		workers.reserve(threads);
+
+		for (usz i = 0; i < threads; ++i)
+			workers.push_back(std::async(std::launch::async, work, this));
+	}
+
+	AsyncFileIO::~AsyncFileIO() {
+
+		{
+			std::lock_guard<std::mutex> guard(pendingMutex);
+			running = false;
+		}
+
+		pendingCondition.notify_all();
+
+		for (auto &worker : workers)
+			worker.wait();
+	}
+
+	u64 AsyncFileIO::submit(ListRef<const FileRequest> requests) {
+
+		const ns start = Timer::now();
+		u64 id;
+
+		{
+			std::lock_guard<std::mutex> guard(completionMutex);
+
+			id = nextId;
+			nextId += requests.size();
+
+			stats.submitted += requests.size();
+			stats.queueDepth += requests.size();
+			stats.maxQueueDepth = std::max(stats.maxQueueDepth, stats.queueDepth);
+		}
+
+		//Native submits can wait for a free slot, so the workers aren't blocked while they do
+
+		List<Pending> fallback;
+
+		for (usz i = 0; i < requests.size(); ++i)
+			if (!submitNative(requests[i], id + i, start))
+				fallback.push_back(Pending{ requests[i], id + i, start });
+
+		flushNative();
+
+		const usz queued = fallback.size();
+
+		if (queued) {
+			std::lock_guard<std::mutex> guard(pendingMutex);
+			pending.insert(pending.end(), fallback.begin(), fallback.end());
+		}
+
+		if (queued == 1)
+			pendingCondition.notify_one();
+
+		else if (queued)
+			pendingCondition.notify_all();
+
+		return id;
+	}
+
+	void AsyncFileIO::complete(u64 id, void *userData, ns start, bool success) {
+
+		const ns latency = Timer::getElapsed(start);
+
+		{
+			std::lock_guard<std::mutex> guard(completionMutex);
+
+			completions.push_back(FileCompletion{ id, userData, latency, success });
+
+			++stats.completed;
+			stats.failed += usz(!success);
+			--stats.queueDepth;
+			stats.totalLatency += latency;
+			stats.maxLatency = std::max(stats.maxLatency, latency);
+		}
+
+		completionCondition.notify_all();
+	}
+
+	usz AsyncFileIO::poll(List<FileCompletion> &out) {
+		return wait(out, 0);
+	}
+
+	usz AsyncFileIO::wait(List<FileCompletion> &out, usz minCount) {
+
+		std::unique_lock<std::mutex> lock(completionMutex);
+
+		if (minCount)
+			completionCondition.wait(lock, [&]() { return completions.size() >= minCount; });
+
+		const usz count = completions.size();
+		out.insert(out.end(), completions.begin(), completions.end());
+		completions.clear();
+		return count;
+	}
+
+	AsyncFileStats AsyncFileIO::getStats() const {
+		std::lock_guard<std::mutex> guard(completionMutex);
+		return stats;
+	}
+
+	void AsyncFileIO::work(AsyncFileIO *io) {
+
+		while (true) {
+
+			Pending p;
+
+			{
+				std::unique_lock<std::mutex> lock(io->pendingMutex);
+				io->pendingCondition.wait(lock, [io]() { return !io->running || !io->pending.empty(); });
+
+				if (io->pending.empty())
+					return;
+
+				p = std::move(io->pending.front());
+				io->pending.pop_front();
+			}
+
+			const FileRequest &r = p.request;
+			bool success{};
+
+			//A read that throws (e.g. a path that doesn't exist) fails the request instead of the worker
+			//Otherwise the request never completes and its waiter hangs
+
+			try {
+
+				if (r.file) {
+					std::lock_guard<std::mutex> guard(io->fileMutexes[(usz(r.file) >> 4) % 16]);
+					success = r.file->read(r.destination, r.size, r.offset);
+				}
+
+				else success = io->fs->read(r.path, r.destination, r.size, r.offset);
+
+			} catch (...) {}
+
+			io->complete(p.id, r.userData, p.start, success);
+		}
+	}
+
+}
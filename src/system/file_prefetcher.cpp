@@ -0,0 +1,341 @@
+#include "system/file_prefetcher.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace oic {
+
+	//Manifest: magic, version, record count, then every record as path length, path, offset, size (little endian)
+
+	static constexpr u32 manifestMagic = 0x4650696F;	//oiPF
+	static constexpr u32 manifestVersion = 1;
+
+	template<typename T>
+	static inline void writeLe(Buffer &buffer, T t) {
+		const usz offset = buffer.size();
+		buffer.resize(offset + sizeof(t));
+		std::memcpy(buffer.data() + offset, &t, sizeof(t));
+	}
+
+	template<typename T>
+	static inline bool readLe(const Buffer &buffer, usz &offset, T &t) {
+
+		if (offset + sizeof(t) > buffer.size())
+			return false;
+
+		std::memcpy(&t, buffer.data() + offset, sizeof(t));
+		offset += sizeof(t);
+		return true;
+	}
+
+	bool FilePrefetcher::saveManifest(FileSystem *fs, const String &path, const List<FileAccessRecord> &records) {
+
+		Buffer buffer;
+
+		writeLe(buffer, manifestMagic);
+		writeLe(buffer, manifestVersion);
+		writeLe(buffer, u64(records.size()));
+
+		for (const FileAccessRecord &record : records) {
+
+			writeLe(buffer, u32(record.path.size()));
+
+			const usz offset = buffer.size();
+			buffer.resize(offset + record.path.size());
+			std::memcpy(buffer.data() + offset, record.path.data(), record.path.size());
+
+			writeLe(buffer, u64(record.offset));
+			writeLe(buffer, u64(record.size));
+		}
+
+		return fs->writeAtomic(path, buffer);
+	}
+
+	bool FilePrefetcher::loadManifest(FileSystem *fs, const String &path, List<FileAccessRecord> &records) {
+
+		Buffer buffer;
+
+		if (!fs->exists(path) || !fs->read(path, buffer))
+			return false;
+
+		usz offset{};
+		u32 magic, version;
+		u64 count;
+
+		if (
+			!readLe(buffer, offset, magic) || !readLe(buffer, offset, version) || !readLe(buffer, offset, count) ||
+			magic != manifestMagic || version != manifestVersion
+		) {
+			System::log()->warn("Prefetch manifest is invalid: ", path);
+			return false;
+		}
+
+		records.reserve(records.size() + usz(std::min(count, u64(buffer.size() / 20))));
+
+		for (u64 i = 0; i < count; ++i) {
+
+			u32 length;
+			u64 start, size;
+
+			if (!readLe(buffer, offset, length) || offset + length > buffer.size()) {
+				System::log()->warn("Prefetch manifest is truncated: ", path);
+				return false;
+			}
+
+			String recordPath((const c8*) buffer.data() + offset, length);
+			offset += length;
+
+			if (!readLe(buffer, offset, start) || !readLe(buffer, offset, size) || !FileSystem::isResolved(recordPath)) {
+				System::log()->warn("Prefetch manifest is truncated or invalid: ", path);
+				return false;
+			}
+
+			records.push_back(FileAccessRecord{ std::move(recordPath), FileSize(start), FileSize(size) });
+		}
+
+		return true;
+	}
+
+	FilePrefetcher::FilePrefetcher(FileSystem *fs, List<FileAccessRecord> records, FileSize budget, usz threads):
+		fs(fs), records(std::move(records)), budget(budget)
+	{
+		stats.records = this->records.size();
+
+		files.reserve(this->records.size());
+
+		for (const FileAccessRecord &record : this->records)
+			files[record.path];
+
+		workers.reserve(threads);
+
+		for (usz i = 0; i < std::max(threads, usz(1)); ++i)
+			workers.push_back(std::async(std::launch::async, work, this));
+	}
+
+	FilePrefetcher::~FilePrefetcher() {
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			running = false;
+		}
+
+		released.notify_all();
+
+		for (auto &worker : workers)
+			worker.wait();
+	}
+
+	bool FilePrefetcher::isDemanded(const PrefetchedFile &file, FileSize offset, FileSize size) {
+		return std::any_of(file.demanded.begin(), file.demanded.end(), [offset, size](const Region &region) {
+			return region.offset < offset + size && offset < region.offset + region.size;
+		});
+	}
+
+	bool FilePrefetcher::take(const String &path, ListRef<const IoRegion> regions) {
+
+		bool hit;
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+
+			auto it = files.find(path);
+
+			if (it == files.end()) {
+				++stats.misses;
+				return false;
+			}
+
+			auto &cached = it->second.cached;
+
+			//Every region has to be in a cached region
+
+			List<usz> sources;
+			sources.reserve(regions.size());
+
+			for (const IoRegion &region : regions) {
+
+				auto source = std::find_if(cached.begin(), cached.end(), [&region](const CachedRegion &c) {
+					return c.offset <= region.offset && region.offset + region.size <= c.offset + c.size;
+				});
+
+				if (source == cached.end())
+					break;
+
+				sources.push_back(source - cached.begin());
+			}
+
+			//Otherwise the regions are read from the file, so they don't have to be prefetched anymore
+			//Only the records that overlap them are skipped; the rest of the file is still prefetched
+
+			hit = sources.size() == regions.size();
+
+			if (!hit) {
+
+				PrefetchedFile &file = it->second;
+
+				for (const IoRegion &region : regions) {
+
+					if (next < records.size() && !isDemanded(file, region.offset, region.size))
+						file.demanded.push_back(Region{ region.offset, region.size });
+
+					for (auto c = cached.begin(); c != cached.end(); )
+						if (c->offset < region.offset + region.size && region.offset < c->offset + c->size) {
+							stats.cachedBytes -= c->size;
+							c = cached.erase(c);
+						}
+
+						else ++c;
+				}
+
+				++stats.misses;
+			}
+
+			else {
+
+				for (usz i = 0; i < regions.size(); ++i) {
+					const CachedRegion &source = cached[sources[i]];
+					std::memcpy(regions[i].data, source.data.data() + (regions[i].offset - source.offset), regions[i].size);
+				}
+
+				//Startup reads are usually only done once, so the regions are released to make room for the next ones
+
+				std::sort(sources.begin(), sources.end());
+				sources.erase(std::unique(sources.begin(), sources.end()), sources.end());
+
+				for (auto source = sources.rbegin(); source != sources.rend(); ++source) {
+					stats.cachedBytes -= cached[*source].size;
+					cached.erase(cached.begin() + *source);
+				}
+
+				++stats.hits;
+			}
+		}
+
+		released.notify_all();
+		return hit;
+	}
+
+	void FilePrefetcher::invalidate(const String &path, bool recursive) {
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+
+			auto drop = [this](PrefetchedFile &file) {
+
+				++file.generation;
+
+				for (const CachedRegion &region : file.cached)
+					stats.cachedBytes -= region.size;
+
+				file.cached.clear();
+			};
+
+			auto it = files.find(path);
+
+			if (it != files.end())
+				drop(it->second);
+
+			if (recursive)
+				for (auto &file : files) {
+
+					const String &key = file.first;
+
+					if (key.size() > path.size() && key[path.size()] == '/' && key.starts_with(path))
+						drop(file.second);
+				}
+		}
+
+		released.notify_all();
+	}
+
+	PrefetchStats FilePrefetcher::getStats() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return stats;
+	}
+
+	void FilePrefetcher::work(FilePrefetcher *p) {
+
+		while (true) {
+
+			const FileAccessRecord *next;
+			u64 generation;
+
+			{
+				std::unique_lock<std::mutex> lock(p->mutex);
+
+				if (!p->running || p->next == p->records.size())
+					return;
+
+				next = &p->records[p->next++];
+
+				const PrefetchedFile &file = p->files[next->path];
+
+				if (isDemanded(file, next->offset, next->size)) {
+					++p->stats.skipped;
+					continue;
+				}
+
+				generation = file.generation;
+			}
+
+			const FileAccessRecord &record = *next;
+
+			if (record.path[0] == '.' && p->fs->prefetchLocal(record.path, record.size, record.offset)) {
+				std::lock_guard<std::mutex> guard(p->mutex);
+				++p->stats.hinted;
+				continue;
+			}
+
+			//Wait for room in the cache; a region that's bigger than the budget is only read into an empty cache
+
+			{
+				std::unique_lock<std::mutex> lock(p->mutex);
+
+				p->released.wait(lock, [p, &record]() {
+					return !p->running || !p->stats.cachedBytes || p->stats.cachedBytes + record.size <= p->budget;
+				});
+
+				if (!p->running)
+					return;
+
+				//Reserved, so other threads don't read past the budget
+
+				p->stats.cachedBytes += record.size;
+			}
+
+			//Read directly from the file, so the read isn't traced or taken from the cache
+
+			CachedRegion region{ record.offset, record.size, Buffer(record.size) };
+			bool success{};
+
+			if (p->fs->exists(record.path))
+				if (File *f = p->fs->open(record.path, FileFlags::READ, 0, 0)) {
+
+					success = record.offset + record.size <= f->size() &&
+						f->read(region.data.data(), region.size, region.offset);
+
+					p->fs->close(f);
+				}
+
+			{
+				std::lock_guard<std::mutex> guard(p->mutex);
+
+				PrefetchedFile &file = p->files[record.path];
+
+				//The file could've changed or the region could've been read while it was being read
+
+				if (success && file.generation == generation && !isDemanded(file, record.offset, record.size)) {
+					p->stats.maxCachedBytes = std::max(p->stats.maxCachedBytes, p->stats.cachedBytes);
+					++p->stats.prefetched;
+					file.cached.push_back(std::move(region));
+					continue;
+				}
+
+				p->stats.skipped += usz(success);
+				p->stats.cachedBytes -= record.size;
+			}
+
+			p->released.notify_all();
+		}
+	}
+
+}
@@ -0,0 +1,199 @@
+#include "system/file_stream.hpp"
+#include <cstring>
+
+namespace oic {
+
+	FileStream::FileStream(FileSystem *fs, const String &path, FileFlags flags, usz window):
+		fs(fs), file(fs->open(path, flags)), window(window ? window : defaultWindow) {}
+
+	FileStream::FileStream(File *file, usz window): file(file), window(window ? window : defaultWindow) {}
+
+	FileStream::~FileStream() {
+
+		if (!file)
+			return;
+
+		flush();
+		waitPrefetch();
+
+		if (fs)
+			fs->close(file);
+	}
+
+	FileSize FileStream::size() const {
+		return std::max(FileSize(file->size()), writeOffset + pendingWrite.size());
+	}
+
+	void FileStream::waitPrefetch() {
+
+		if (prefetch.valid() && !prefetch.get())
+			nextSize = 0;
+	}
+
+	void FileStream::prefetchNext() {
+
+		const FileSize end = currentOffset + currentSize, fileSize = file->size();
+
+		if (end >= fileSize) {
+			nextSize = 0;
+			return;
+		}
+
+		nextOffset = end;
+		nextSize = usz(std::min(FileSize(window), fileSize - end));
+
+		next.resize(window);
+
+		prefetch = std::async(std::launch::async, [this]() {
+			return file->read(next.data(), nextSize, nextOffset);
+		});
+	}
+
+	bool FileStream::refill() {
+
+		waitPrefetch();
+
+		if (nextSize && position >= nextOffset && position < nextOffset + nextSize) {
+			current.swap(next);
+			currentOffset = nextOffset;
+			currentSize = nextSize;
+		}
+
+		else {
+
+			currentOffset = position;
+			currentSize = usz(std::min(FileSize(window), file->size() - position));
+
+			current.resize(window);
+
+			if (!file->read(current.data(), currentSize, currentOffset)) {
+				currentSize = 0;
+				return false;
+			}
+		}
+
+		prefetchNext();
+		return true;
+	}
+
+	void FileStream::invalidateWindows() {
+		waitPrefetch();
+		currentSize = nextSize = 0;
+	}
+
+	usz FileStream::read(void *v, usz size) {
+
+		if (!file || !flush())
+			return 0;
+
+		const FileSize fileSize = file->size();
+
+		if (position >= fileSize)
+			return 0;
+
+		size = usz(std::min(FileSize(size), fileSize - position));
+
+		u8 *dst = (u8*) v;
+		usz copied{};
+
+		while (copied < size) {
+
+			//Copy from the current window
+
+			if (position >= currentOffset && position < currentOffset + currentSize) {
+
+				const usz start = usz(position - currentOffset);
+				const usz count = std::min(size - copied, currentSize - start);
+
+				std::memcpy(dst + copied, current.data() + start, count);
+				copied += count;
+				position += count;
+				continue;
+			}
+
+			//Big reads don't need to be buffered
+
+			const usz remaining = size - copied;
+
+			if (remaining >= window) {
+
+				waitPrefetch();
+
+				if (!file->read(dst + copied, remaining, position))
+					break;
+
+				copied += remaining;
+				position += remaining;
+				break;
+			}
+
+			if (!refill())
+				break;
+		}
+
+		return copied;
+	}
+
+	bool FileStream::write(const void *v, usz size) {
+
+		if (!file)
+			return false;
+
+		invalidateWindows();
+
+		if (pendingWrite.empty())
+			writeOffset = position;
+
+		//Writes that don't fit in the window are written directly
+
+		if (pendingWrite.size() + size > window) {
+
+			if (!flush())
+				return false;
+
+			if (size >= window) {
+
+				if (!file->write(v, size, position))
+					return false;
+
+				position += size;
+				return true;
+			}
+
+			writeOffset = position;
+		}
+
+		if (pendingWrite.capacity() < window)
+			pendingWrite.reserve(window);
+
+		const u8 *src = (const u8*) v;
+		pendingWrite.insert(pendingWrite.end(), src, src + size);
+		position += size;
+		return true;
+	}
+
+	bool FileStream::flush() {
+
+		if (pendingWrite.empty())
+			return true;
+
+		const bool success = file->write(pendingWrite.data(), pendingWrite.size(), writeOffset);
+		pendingWrite.clear();
+		return success;
+	}
+
+	bool FileStream::seek(FileSize offset) {
+
+		if (!flush())
+			return false;
+
+		if (offset > size()) {
+			System::log()->fatal("File stream seek is out of bounds");
+			return false;
+		}
+
+		position = offset;
+		return true;
+	}
+
+}
@@ -1,14 +1,23 @@
 #define _SILENCE_CXX17_CODECVT_HEADER_DEPRECATION_WARNING
 #include "system/file_system.hpp"
+#include "system/file_prefetcher.hpp"
 #include "system/system.hpp"
 #include "system/log.hpp"
+#include "utils/timer.hpp"
 #include <algorithm>
 #include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
 
 namespace oic {
 
 	static constexpr c8 vroot[] = "~", lroot[] = ".";
 
+	//The file systems the current thread has shared access to
+
+	static thread_local List<const FileSystem*> sharedLocks;
+
 	FileInfo::SizeType FileInfo::getFolders() const { return fileHint - folderHint; }
 	FileInfo::SizeType FileInfo::getFiles() const { return fileEnd - fileHint; }
 	FileInfo::SizeType FileInfo::getFileObjects() const { return fileEnd - folderHint; }
@@ -34,51 +43,506 @@ namespace oic {
 	}
 
 	File::~File() {
+
+		//The file can be removed while it's still open, then there's nothing left to update
+		//A destructor can't throw, so an update that fails anyway (e.g. removed in between) is dropped
+
 		if (hasWritten)
-			fs->update(f.path);
+			try {
+				if (fs->exists(f.path))
+					fs->update(f.path);
+			} catch (...) {}
+	}
+
+	ListRef<const u8> File::map() {
+
+		if (!f.hasAccess(FileAccess::READ)) {
+			System::log()->fatal("File map requires read access");
+			return {};
+		}
+
+		if (mapCopy.size() != f.fileSize) {
+			mapCopy.resize(f.fileSize);
+			read(mapCopy.data(), mapCopy.size(), 0);
+		}
+
+		return { mapCopy.data(), mapCopy.size() };
+	}
+
+	bool File::readv(ListRef<const IoRegion> regions) const {
+
+		for (const IoRegion &region : regions)
+			if (!read(region.data, region.size, region.offset))
+				return false;
+
+		return true;
+	}
+
+	bool File::writev(ListRef<const IoRegion> regions) {
+
+		for (const IoRegion &region : regions)
+			if (!write(region.data, region.size, region.offset))
+				return false;
+
+		return true;
+	}
+
+	FileView::FileView(FileSystem *fs, File *file): fs(fs), file(file) {
+		if (file)
+			data = file->map();
+	}
+
+	FileView::~FileView() {
+		if (file)
+			fs->close(file);
+	}
+
+	FileView::FileView(FileView &&other): fs(other.fs), file(other.file), data(other.data) {
+		other.file = nullptr;
+		other.data = {};
+	}
+
+	FileView &FileView::operator=(FileView &&other) {
+
+		if (file)
+			fs->close(file);
+
+		fs = other.fs;
+		file = other.file;
+		data = other.data;
+
+		other.file = nullptr;
+		other.data = {};
+		return *this;
 	}
 
 	FileSystem::FileSystem(const FileAccess virtualFileAccess): 
-		virtualFiles {
-			{
-				FileInfo{
-					vroot, vroot,
-					0, nullptr, 0, 0, 0, 0, 0,
-					FileFlags(u8(virtualFileAccess) | u8(FileFlags::IS_FOLDER) | u8(FileFlags::IS_VIRTUAL))
-				}
-			}
-		},
-		virtualFileLut { { vroot, 0 } }
-	{ }
+		virtualChildren(1),
+		callbacks(std::make_unique<CallbackNode>())
+	{
+		virtualFiles.push(FileInfo{
+			vroot, vroot,
+			0, nullptr, 0, 0, 0, 0, 0,
+			FileFlags(u8(virtualFileAccess) | u8(FileFlags::IS_FOLDER) | u8(FileFlags::IS_VIRTUAL))
+		});
+	}
+
+	//Pending changes are dropped; file systems with watchers flush them before they're destroyed
+
+	FileSystem::~FileSystem() {
+
+		{
+			std::lock_guard<std::mutex> guard(changeMutex);
+			stopChanges = true;
+		}
+
+		changeSignal.notify_all();
+
+		if (changeWorker.valid())
+			changeWorker.wait();
+	}
 
     void FileSystem::addFileChangeCallback(FileChangeCallback callback, const String &path, void *ptr) {
+		addCallback(ChangeCallback{ callback, nullptr, ptr }, path);
+    }
+
+    void FileSystem::addFileChangeBatchCallback(FileChangeBatchCallback callback, const String &path, void *ptr) {
+		addCallback(ChangeCallback{ nullptr, callback, ptr }, path);
+    }
 
+    void FileSystem::removeFileChangeCallback(const String &path) {
+		removeCallbacks(nullptr, path);
+    }
+
+	void FileSystem::removeFileChangeCallback(FileChangeCallback callback, const String &path, void *ptr) {
+		const ChangeCallback target{ callback, nullptr, ptr };
+		removeCallbacks(&target, path);
+	}
+
+	void FileSystem::removeFileChangeBatchCallback(FileChangeBatchCallback callback, const String &path, void *ptr) {
+		const ChangeCallback target{ nullptr, callback, ptr };
+		removeCallbacks(&target, path);
+	}
+
+	void FileSystem::addCallback(const ChangeCallback &callback, const String &path) {
+
+		FileSystemWriteLock lock(this);
 		String apath;
 
-		if (!resolvePath(path, apath) || callbacks.find(apath) != callbacks.end())
+		if (!resolvePath(path, apath))
 			return;
 
-		callbacks[apath] = { callback, ptr };
-		startFileWatcher(apath);
-    }
+		List<CallbackNode*> nodes;
+		getCallbackNodes(apath, nodes, true);
 
-    void FileSystem::removeFileChangeCallback(const String &path) {
+		auto &targets = nodes.back()->callbacks;
+
+		if (std::find(targets.begin(), targets.end(), callback) != targets.end())
+			return;
+
+		targets.push_back(callback);
+
+		//The watcher is shared by all callbacks of a path
+
+		if (targets.size() == 1)
+			startFileWatcher(apath);
+	}
+
+	void FileSystem::removeCallbacks(const ChangeCallback *callback, const String &path) {
+
+		//Deliveries that already found the callback have to finish before it's gone (e.g. before its data is freed)
+		//Deliveries of a thread with access to the file system are waited on by the write lock instead
+
+		std::unique_lock<std::recursive_mutex> deliverGuard(deliverMutex, std::defer_lock);
 
+		if (!hasAccess())
+			deliverGuard.lock();
+
+		FileSystemWriteLock lock(this);
 		String apath;
 
 		if (!resolvePath(path, apath))
 			return;
 
-		auto it = callbacks.find(apath);
+		List<CallbackNode*> nodes;
+		getCallbackNodes(apath, nodes);
+
+		//The root and one node per part of the path
+
+		if (nodes.size() != usz(std::count(apath.begin(), apath.end(), '/')) + 2)
+			return;
+
+		auto &targets = nodes.back()->callbacks;
+		const usz count = targets.size();
+
+		//Without a callback, all callbacks of the path are removed
+
+		if (callback)
+			targets.erase(std::remove(targets.begin(), targets.end(), *callback), targets.end());
+
+		else targets.clear();
 
-		if (it == callbacks.end())
+		if (targets.size() == count || !targets.empty())
 			return;
 
 		endFileWatcher(apath);
-		callbacks.erase(it);
-    }
 
-	usz FileSystem::obtainPath(const String &path, List<String> &splits) {
+		//Remove the nodes that aren't used anymore
+
+		StringView remaining = apath;
+
+		for (usz i = nodes.size() - 1; i && nodes[i]->callbacks.empty() && nodes[i]->children.empty(); --i) {
+
+			const usz slash = remaining.find_last_of('/');
+			auto &siblings = nodes[i - 1]->children;
+
+			siblings.erase(siblings.find(remaining.substr(slash + 1)));
+			remaining = remaining.substr(0, slash == StringView::npos ? 0 : slash);
+		}
+
+		invalidate(apath, true);
+	}
+
+	void FileSystem::getCallbackNodes(StringView path, List<CallbackNode*> &nodes, bool create) const {
+
+		CallbackNode *node = callbacks.get();
+		nodes.push_back(node);
+
+		if (path.empty())
+			return;
+
+		for (usz start = 0; start <= path.size(); ) {
+
+			usz end = path.find('/', start);
+
+			if (end == StringView::npos)
+				end = path.size();
+
+			const StringView part = path.substr(start, end - start);
+			auto it = node->children.find(part);
+
+			if (it == node->children.end()) {
+
+				if (!create)
+					return;
+
+				it = node->children.emplace(String(part), std::make_unique<CallbackNode>()).first;
+			}
+
+			node = it->second.get();
+			nodes.push_back(node);
+			start = end + 1;
+		}
+	}
+
+	void FileSystem::notify(const FileInfo &info, FileChange change, StringView otherPath) {
+
+		notify(List<FileChangeEvent>{ FileChangeEvent{ info, change, String(otherPath) } });
+	}
+
+	void FileSystem::notify(List<FileChangeEvent> changes) {
+
+		if (changes.empty())
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(changeMutex);
+
+			if (changeWindow) {
+
+				if (!pendingChangeCount)
+					pendingSince = Timer::now();
+
+				for (FileChangeEvent &change : changes)
+					queueChange(std::move(change));
+
+				if (pendingChangeCount)
+					changeSignal.notify_all();
+
+				return;
+			}
+		}
+
+		deliverChanges(changes);
+	}
+
+	void FileSystem::deliverChanges(const List<FileChangeEvent> &changes) {
+
+		//Copied, since callbacks are allowed to add or remove callbacks
+
+		List<std::pair<ChangeCallback, usz>> calls;
+		List<std::pair<ChangeCallback, List<FileChangeEvent>>> batches;
+
+		std::unique_lock<std::recursive_mutex> deliverGuard(deliverMutex, std::defer_lock);
+
+		if (!hasAccess())
+			deliverGuard.lock();
+
+		{
+			FileSystemReadLock lock(this);
+
+			List<CallbackNode*> nodes, otherNodes;
+
+			for (usz i = 0; i < changes.size(); ++i) {
+
+				const FileChangeEvent &change = changes[i];
+
+				nodes.clear();
+				getCallbackNodes(change.info.path, nodes);
+
+				//Nodes that both paths share are only notified once
+
+				if (!change.oldPath.empty()) {
+
+					otherNodes.clear();
+					getCallbackNodes(change.oldPath, otherNodes);
+
+					for (CallbackNode *node : otherNodes)
+						if (std::find(nodes.begin(), nodes.end(), node) == nodes.end())
+							nodes.push_back(node);
+				}
+
+				for (CallbackNode *node : nodes)
+					for (const ChangeCallback &callback : node->callbacks) {
+
+						if (callback.callback) {
+							calls.push_back({ callback, i });
+							continue;
+						}
+
+						auto it = std::find_if(batches.begin(), batches.end(), [&callback](const auto &batch) {
+							return batch.first == callback;
+						});
+
+						if (it == batches.end())
+							it = batches.insert(batches.end(), { callback, {} });
+
+						it->second.push_back(change);
+					}
+			}
+		}
+
+		for (auto &call : calls) {
+			const FileChangeEvent &change = changes[call.second];
+			call.first.callback(this, change.info, change.change, call.first.data);
+		}
+
+		for (auto &batch : batches)
+			batch.first.batchCallback(this, batch.second, batch.first.data);
+	}
+
+	void FileSystem::queueChange(FileChangeEvent change) {
+
+		auto &lut = pendingChangeLut;
+		auto &pending = pendingChanges;
+
+		//A file that's moved continues the changes of its old path
+		//If it was added in this window, it's only added at the new path (e.g. a temporary file that replaces a file)
+
+		if (change.change == FileChange::MOVE) {
+
+			auto it = lut.find(change.oldPath);
+
+			if (it != lut.end()) {
+
+				FileChangeEvent &old = pending[it->second];
+
+				if (old.change == FileChange::ADD) {
+					change.change = FileChange::ADD;
+					change.oldPath.clear();
+				}
+
+				else if (old.change == FileChange::MOVE)
+					change.oldPath = old.oldPath;
+
+				old.info.path.clear();
+				lut.erase(it);
+				--pendingChangeCount;
+			}
+		}
+
+		auto it = lut.find(change.info.path);
+
+		if (it == lut.end()) {
+			lut[change.info.path] = pending.size();
+			pending.push_back(std::move(change));
+			++pendingChangeCount;
+			return;
+		}
+
+		FileChangeEvent &prev = pending[it->second];
+
+		//Merge with the previous change of the path
+
+		switch (prev.change) {
+
+			case FileChange::ADD:
+
+				if (change.change == FileChange::DEL) {
+					prev.info.path.clear();
+					lut.erase(it);
+					--pendingChangeCount;
+					return;
+				}
+
+				if (change.change == FileChange::UPDATE)
+					change.change = FileChange::ADD;
+
+				break;
+
+			case FileChange::DEL:
+
+				if (change.change == FileChange::ADD)
+					change.change = FileChange::UPDATE;
+
+				break;
+
+			case FileChange::MOVE:
+
+				if (change.change == FileChange::UPDATE)
+					change.change = FileChange::MOVE;
+
+				break;
+
+			default:
+				break;
+		}
+
+		if (change.oldPath.empty())
+			change.oldPath = std::move(prev.oldPath);
+
+		prev = std::move(change);
+	}
+
+	void FileSystem::setChangeWindow(ns window) {
+
+		bool stop;
+
+		{
+			std::lock_guard<std::mutex> guard(changeMutex);
+			changeWindow = window;
+			stop = !window && changeWorker.valid();
+			stopChanges = stop;
+		}
+
+		changeSignal.notify_all();
+
+		if (stop) {
+			changeWorker.wait();
+			changeWorker = {};
+			stopChanges = false;
+			flushChanges();
+		}
+
+		else if (window && !changeWorker.valid())
+			changeWorker = std::async(std::launch::async, watchChanges, this);
+	}
+
+	void FileSystem::flushChanges() {
+
+		std::lock_guard<std::recursive_mutex> deliverGuard(deliverMutex);
+		List<FileChangeEvent> changes;
+
+		{
+			std::lock_guard<std::mutex> guard(changeMutex);
+
+			changes.reserve(pendingChangeCount);
+
+			for (FileChangeEvent &change : pendingChanges)
+				if (!change.info.path.empty())
+					changes.push_back(std::move(change));
+
+			pendingChanges.clear();
+			pendingChangeLut.clear();
+			pendingChangeCount = 0;
+		}
+
+		if (!changes.empty())
+			deliverChanges(changes);
+	}
+
+	void FileSystem::watchChanges(FileSystem *fs) {
+
+		std::unique_lock<std::mutex> lock(fs->changeMutex);
+
+		while (!fs->stopChanges) {
+
+			if (!fs->pendingChangeCount) {
+				fs->changeSignal.wait(lock);
+				continue;
+			}
+
+			//The window starts at the first change, so a stream of changes is still delivered
+
+			const ns now = Timer::now(), due = fs->pendingSince + fs->changeWindow;
+
+			if (now < due) {
+				fs->changeSignal.wait_for(lock, std::chrono::nanoseconds(due - now));
+				continue;
+			}
+
+			lock.unlock();
+			fs->flushChanges();
+			lock.lock();
+		}
+	}
+
+	bool FileSystem::isWatched(StringView path) const {
+
+		//Callbacks are added and removed under the write lock, so the trie can't be walked while that happens
+
+		FileSystemReadLock lock(this);
+		List<CallbackNode*> nodes;
+		getCallbackNodes(path, nodes);
+
+		for (CallbackNode *node : nodes)
+			if (!node->callbacks.empty())
+				return true;
+
+		return false;
+	}
+
+	usz FileSystem::obtainPath(StringView path, List<String> &splits) {
 
 		auto beg = path.begin();
 		auto end = path.end();
@@ -98,7 +562,7 @@ namespace oic {
 					total -= splits[splits.size() - 1].size();
 					splits.erase(splits.end() - 1);
 
-				} else if ((it - prev) != 1 || *prev != '.' || prev == beg) {         //Add next if not .
+				} else if (it != prev && ((it - prev) != 1 || *prev != '.' || prev == beg)) {	//Add next if not . or empty
 					splits.push_back(String(prev, it));
 					total += it - prev;
 				}
@@ -108,26 +572,75 @@ namespace oic {
 				++i;
 
 			} else if (it == last) {                                                 //Add last parameter
-				splits.push_back(String(prev, end));
-				total += end - prev;
+
+				if ((end - prev) == 2 && *prev == '.' && *(prev + 1) == '.') {
+
+					if (splits.size() <= 1)
+						return false;
+
+					total -= splits[splits.size() - 1].size();
+					splits.erase(splits.end() - 1);
+
+				} else if ((end - prev) != 1 || *prev != '.' || prev == beg) {
+					splits.push_back(String(prev, end));
+					total += end - prev;
+				}
 			}
 
 		return total;
 	}
 
-	//TODO: "a/" should turn into "a"
-    bool FileSystem::resolvePath(const String &path, String &outPath) const {
+	bool FileSystem::isResolved(StringView path) {
+
+		if (path.empty() || (path[0] != '~' && path[0] != '.') || (path.size() > 1 && path[1] != '/'))
+			return false;
+
+		//Every part after the root has to be a name (not empty, . or ..)
+
+		for (usz i = 1, j = path.size(); i < j; ++i) {
+
+			if (path[i] == '\\')
+				return false;
+
+			if (path[i] != '/')
+				continue;
+
+			const usz next = i + 1 < j ? i + 1 : j;
+			const usz len = std::min(path.find('/', next), j) - next;
+
+			if (!len || (path[next] == '.' && (len == 1 || (len == 2 && path[next + 1] == '.'))))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool FileSystem::resolvePath(StringView path, StringView &outPath, String &buffer) const {
+
+		if (isResolved(path)) {
+			outPath = path;
+			return true;
+		}
+
+		if (!resolvePath(path, buffer))
+			return false;
+
+		outPath = buffer;
+		return true;
+	}
+
+    bool FileSystem::resolvePath(StringView path, String &outPath) const {
 
 		//Force correct paths
 
-        if(path.size() == 0 || path.find('\\') != String::npos)
+        if(path.size() == 0 || path.find('\\') != StringView::npos)
             return false;
 
-		//Skip path parsing if there's no ./ and ../
+		//Skip path parsing if there's no ./, ../, // or trailing /
 
-		if (path.size() == 1 || path.find("/../") == String::npos || path.find("/./") == String::npos) {
+		if (isResolved(path)) {
 			outPath = path;
-			return (outPath[0] == '~' || outPath[0] == '.') && (outPath.size() == 1 || outPath[1] == '/');
+			return true;
 		}
 
         //Split into sub paths
@@ -169,454 +682,1736 @@ namespace oic {
 			return true;
 		}
 
-        auto &arr = virtualFiles;
+		//Callbacks can't modify the file system, since it's locked for reading
+
+		FileSystemReadLock lock(this);
+		const FileHandle handle = virtualFiles.find(info.path);
+
+		if (handle == invalidFileHandle)
+			return false;
+
+		FileInfo scratch;
+		foreachVirtual(handle, callback, recurse, data, scratch);
+        return true;
+    }
+
+	void FileSystem::foreachVirtual(FileHandle folder, FileCallback callback, bool recurse, void *data, FileInfo &scratch) {
+
+		const List<FileHandle> &children = virtualChildren[folder];
+		const VirtualFileTable::Node &node = virtualFiles.node(folder);
+
+		for (FileHandle i = node.folderHint, end = node.fileEnd; i != end; ++i) {
+			virtualFiles.get(children[i], scratch);
+			callback(this, scratch, data);
+		}
+
+		if (recurse)
+			for (FileHandle i = node.folderHint, end = node.fileHint; i != end; ++i)
+				foreachVirtual(children[i], callback, true, data, scratch);
+	}
+
+	//Glob matching of a single name; a class can start with ] ([]] matches ]) and ! or ^ negate it
+
+	static usz globClassEnd(StringView pattern, usz start) {
+
+		usz i = start + 1;
+
+		if (i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^'))
+			++i;
+
+		if (i < pattern.size() && pattern[i] == ']')
+			++i;
+
+		return pattern.find(']', i);
+	}
+
+	static bool globClassMatches(StringView pattern, usz start, usz end, c8 c) {
+
+		usz i = start + 1;
+		const bool negate = pattern[i] == '!' || pattern[i] == '^';
+
+		if (negate)
+			++i;
+
+		bool matched{};
+
+		for (; i < end; ++i) {
+
+			c8 lo = pattern[i], hi = lo;
+
+			if (i + 2 < end && pattern[i + 1] == '-') {
+				hi = pattern[i + 2];
+				i += 2;
+			}
+
+			matched |= lo <= c && c <= hi;
+		}
+
+		return matched != negate;
+	}
+
+	static bool globMatches(StringView pattern, StringView name) {
+
+		//A * first matches nothing and grows every time the rest doesn't match
+
+		usz p{}, n{}, star = StringView::npos, starName{};
+
+		while (n < name.size()) {
+
+			if (p < pattern.size()) {
+
+				const c8 c = pattern[p];
+
+				if (c == '*') {
+					star = ++p;
+					starName = n;
+					continue;
+				}
+
+				if (c == '[') {
+
+					const usz end = globClassEnd(pattern, p);
+
+					if (globClassMatches(pattern, p, end, name[n])) {
+						p = end + 1;
+						++n;
+						continue;
+					}
+				}
+
+				else if (c == '?' || c == name[n]) {
+					++p;
+					++n;
+					continue;
+				}
+			}
+
+			if (star == StringView::npos)
+				return false;
+
+			p = star;
+			n = ++starName;
+		}
+
+		while (p < pattern.size() && pattern[p] == '*')
+			++p;
+
+		return p == pattern.size();
+	}
+
+	static bool isGlobLiteral(StringView part) {
+		return part.find_first_of("*?[") == StringView::npos;
+	}
+
+	List<FileId> FileSystem::query(const String &pattern) const {
+
+		String apattern;
+
+		if (!resolvePath(pattern, apattern) || apattern[0] != '~') {
+			System::log()->fatal("Queries only support virtual paths in oic file notation");
+			return {};
+		}
+
+		//Consecutive ** are the same as one
+
+		List<StringView> parts;
+		usz recursiveParts{};
+
+		for (usz start = 2; start < apattern.size(); ) {
+
+			const usz end = std::min(apattern.find('/', start), apattern.size());
+			const StringView part = StringView(apattern).substr(start, end - start);
+
+			for (usz i = part.find('['); i != StringView::npos; i = part.find('[', i + 1))
+				if ((i = globClassEnd(part, i)) == StringView::npos) {
+					System::log()->fatal("Query has a character class without an end");
+					return {};
+				}
+
+			if (part == "**" && !parts.empty() && parts.back() == "**") {
+				start = end + 1;
+				continue;
+			}
+
+			recursiveParts += part == "**";
+			parts.push_back(part);
+			start = end + 1;
+		}
+
+		List<FileId> matches;
+		FileSystemReadLock lock(this);
+
+		//The literal start of the pattern is a single lookup
+
+		usz first{};
+
+		while (first < parts.size() && isGlobLiteral(parts[first]))
+			++first;
+
+		const usz prefix = first ? usz(parts[first - 1].data() + parts[first - 1].size() - apattern.data()) : 1;
+		const FileHandle folder = virtualFiles.find(StringView(apattern).substr(0, prefix));
+
+		if (folder == invalidFileHandle)
+			return matches;
+
+		if (first == parts.size()) {
+			matches.push_back(virtualFiles.id(folder));
+			return matches;
+		}
+
+		if (!virtualFiles.node(folder).isFolder())
+			return matches;
+
+		queryVirtual(folder, parts, first, matches);
+
+		//Multiple ** can match the same file in different ways
+
+		if (recursiveParts > 1) {
+
+			std::sort(matches.begin(), matches.end(), [](const FileId &a, const FileId &b) {
+				return a.handle < b.handle;
+			});
+
+			matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+		}
+
+		return matches;
+	}
+
+	void FileSystem::queryVirtual(FileHandle folder, const List<StringView> &parts, usz part, List<FileId> &matches) const {
+
+		const List<FileHandle> &children = virtualChildren[folder];
+		const VirtualFileTable::Node &node = virtualFiles.node(folder);
+
+		const StringView pattern = parts[part];
+		const bool isLast = part + 1 == parts.size();
+
+		//** matches no folder (continue in this folder) or enters every folder
+		//As the last part, it matches everything in the folder and below it
+
+		if (pattern == "**") {
+
+			if (isLast)
+				for (FileHandle i = node.folderHint, end = node.fileEnd; i != end; ++i)
+					matches.push_back(virtualFiles.id(children[i]));
+
+			else queryVirtual(folder, parts, part + 1, matches);
+
+			for (FileHandle i = node.folderHint, end = node.fileHint; i != end; ++i)
+				queryVirtual(children[i], parts, part, matches);
+
+			return;
+		}
+
+		//Literal names are looked up, instead of compared with every child
+
+		if (isGlobLiteral(pattern)) {
+
+			String path(virtualFiles.path(folder));
+			path += '/';
+			path += pattern;
+
+			const FileHandle child = virtualFiles.find(path);
+
+			if (child == invalidFileHandle)
+				return;
+
+			if (isLast)
+				matches.push_back(virtualFiles.id(child));
+
+			else if (virtualFiles.node(child).isFolder())
+				queryVirtual(child, parts, part + 1, matches);
+
+			return;
+		}
+
+		//Only folders can have the rest of the pattern
+
+		for (FileHandle i = node.folderHint, end = isLast ? node.fileEnd : node.fileHint; i != end; ++i) {
+
+			const FileHandle child = children[i];
+
+			if (!globMatches(pattern, virtualFiles.name(child)))
+				continue;
+
+			if (isLast)
+				matches.push_back(virtualFiles.id(child));
+
+			else queryVirtual(child, parts, part + 1, matches);
+		}
+	}
+
+	void FileSystem::getFileObjects(const FileInfo &folder, List<FileInfo> &children) const {
+
+		if (folder.isLocal()) {
+
+			for (const String &file : localFileObjects(folder.path))
+				children.push_back(local(file));
+
+			return;
+		}
+
+		FileSystemReadLock lock(this);
+		const FileHandle handle = virtualFiles.find(folder.path);
+
+		if (handle == invalidFileHandle)
+			return;
+
+		const List<FileHandle> &handles = virtualChildren[handle];
+		children.resize(children.size() + handles.size());
+
+		FileInfo *child = children.data() + children.size() - handles.size();
+
+		for (FileHandle h : handles)
+			virtualFiles.get(h, *child++);
+	}
+
+	//Parallel traversal
+	//Every thread owns a queue of folders; it takes the last folder it added (depth first),
+	//or steals the oldest folder of another thread (usually the biggest subtree) when it runs out
+
+	struct TraversalNode {
+		List<FileInfo> children;
+		List<std::unique_ptr<TraversalNode>> folders;
+	};
+
+	struct TraversalTask {
+		FileInfo folder;
+		TraversalNode *node;
+	};
+
+	struct TraversalQueue {
+		std::mutex mutex;
+		std::deque<TraversalTask> tasks;
+	};
+
+	static void emitTraversal(FileSystem *fs, const TraversalNode &node, FileCallback callback, void *data) {
+
+		for (const FileInfo &child : node.children)
+			callback(fs, child, data);
+
+		for (auto &folder : node.folders)
+			emitTraversal(fs, *folder, callback, data);
+	}
+
+	bool FileSystem::foreachFileParallel(const String &path, FileCallback callback, void *data, usz threads, bool ordered) {
+
+		if (path == "")
+			return false;
+
+		FileInfo root = get(path);
+
+		if (!root.isFolder())
+			return false;
+
+		//Other threads can't read while this thread has access to the file system
+
+		if (hasAccess())
+			threads = 1;
+
+		else if (!threads)
+			threads = std::max(usz(std::thread::hardware_concurrency()), usz(1));
+
+		List<TraversalQueue> queues(threads);
+		std::atomic<usz> pending = 1;
+
+		//Idle workers sleep until folders are pushed or the traversal is done
+
+		std::atomic<u32> signal{};
+
+		auto wake = [&]() {
+			signal.fetch_add(1, std::memory_order_release);
+			signal.notify_all();
+		};
+
+		//The first exception of a worker (e.g. a folder that was removed while traversing) stops all workers
+		//It's thrown again once they're done, so the call fails instead of waiting for the folder forever
+
+		std::exception_ptr error;
+		std::mutex errorMutex;
+		std::atomic<bool> failed{};
+
+		TraversalNode tree;
+		queues[0].tasks.push_back(TraversalTask{ std::move(root), &tree });
+
+		auto pop = [&](usz i, TraversalTask &task) -> bool {
+
+			for (usz j = 0; j < threads; ++j) {
+
+				TraversalQueue &q = queues[(i + j) % threads];
+				std::lock_guard<std::mutex> guard(q.mutex);
+
+				if (q.tasks.empty())
+					continue;
+
+				if (!j) {
+					task = std::move(q.tasks.back());
+					q.tasks.pop_back();
+				}
+
+				else {
+					task = std::move(q.tasks.front());
+					q.tasks.pop_front();
+				}
+
+				return true;
+			}
+
+			return false;
+		};
+
+		auto work = [&](usz i) {
+
+			TraversalTask task;
+			List<FileInfo> children;
+
+			while (pending && !failed) {
+
+				const u32 seen = signal.load(std::memory_order_acquire);
+
+				if (!pop(i, task)) {
+
+					if (pending && !failed)
+						signal.wait(seen, std::memory_order_acquire);
+
+					continue;
+				}
+
+				try {
+
+					children.clear();
+					getFileObjects(task.folder, children);
+
+					usz folders{};
+
+					for (const FileInfo &child : children)
+						folders += usz(child.isFolder());
+
+					if (folders) {
+
+						pending += folders;
+
+						if (ordered)
+							task.node->folders.reserve(folders);
+
+						TraversalQueue &q = queues[i];
+						std::lock_guard<std::mutex> guard(q.mutex);
+
+						for (const FileInfo &child : children)
+							if (child.isFolder()) {
+
+								TraversalNode *node{};
+
+								if (ordered)
+									node = task.node->folders.emplace_back(new TraversalNode()).get();
+
+								q.tasks.push_back(TraversalTask{ child, node });
+							}
+					}
+
+					if (folders)
+						wake();
+
+					if (ordered)
+						task.node->children = std::move(children);
+
+					else for (const FileInfo &child : children)
+						callback(this, child, data);
+
+				} catch (...) {
+
+					std::lock_guard<std::mutex> guard(errorMutex);
+
+					if (!error)
+						error = std::current_exception();
+
+					failed = true;
+				}
+
+				if (!--pending || failed)
+					wake();
+			}
+		};
+
+		List<std::future<void>> workers;
+		workers.reserve(threads - 1);
+
+		for (usz i = 1; i < threads; ++i)
+			workers.push_back(std::async(std::launch::async, work, i));
+
+		work(0);
+
+		for (auto &worker : workers)
+			worker.wait();
+
+		if (error)
+			std::rethrow_exception(error);
+
+		if (ordered)
+			emitTraversal(this, tree, callback, data);
+
+		return true;
+	}
+
+	const FileInfo FileSystem::get(StringView path) const {
+
+		String buffer;
+		StringView apath;
+
+		if (!resolvePath(path, apath, buffer))
+			System::log()->fatal("File path should be in proper oic notation");
+
+		if (apath[0] == '.')
+			return local(String(apath));
+
+		FileSystemReadLock lock(this);
+		const FileHandle handle = virtualFiles.find(apath);
+
+		if (handle == invalidFileHandle) {
+			System::log()->fatal("Virtual file doesn't exist");
+			return {};
+		}
+
+		return virtualFiles[handle];
+	}
+
+	const FileInfo FileSystem::get(FileId id) const {
+
+		FileSystemReadLock lock(this);
+
+		if (!virtualFiles.isValid(id)) {
+			System::log()->fatal("Virtual file doesn't exist anymore");
+			return {};
+		}
+
+		return virtualFiles[id.handle];
+	}
+
+	FileId FileSystem::getId(StringView path) const {
+
+		FileSystemReadLock lock(this);
+		const FileHandle handle = find(path);
+
+		return handle == invalidFileHandle ? FileId{} : virtualFiles.id(handle);
+	}
+
+	bool FileSystem::isValid(FileId id) const {
+		FileSystemReadLock lock(this);
+		return virtualFiles.isValid(id);
+	}
+
+	FileHandle FileSystem::find(StringView path) const {
+
+		String buffer;
+		StringView apath;
+
+		if (!resolvePath(path, apath, buffer) || apath[0] != '~')
+			return invalidFileHandle;
+
+		FileSystemReadLock lock(this);
+		return virtualFiles.find(apath);
+	}
+
+	bool FileSystem::exists(StringView path) const {
+
+		String buffer;
+		StringView apath;
+
+		if (!resolvePath(path, apath, buffer))
+			return false;
+
+		if (apath[0] == '~') {
+			FileSystemReadLock lock(this);
+			return virtualFiles.find(apath) != invalidFileHandle;
+		}
+
+		return hasLocal(String(apath));
+	}
+
+	bool FileSystem::regionExists(StringView path, FileSize size, FileSize offset) const {
+
+		String buffer;
+		StringView apath;
+
+		if (!resolvePath(path, apath, buffer))
+			return false;
+
+		if (apath[0] == '~') {
+
+			FileSystemReadLock lock(this);
+			const FileHandle handle = virtualFiles.find(apath);
+
+			if (handle == invalidFileHandle)
+				return false;
+
+			return virtualFiles.metadata(handle).fileSize > size + offset;
+		}
+
+		return hasLocalRegion(String(apath), size, offset);
+	}
+
+	void FileSystem::initLut() {
+
+		auto &arr = virtualFiles;
+		const FileHandle j = arr.size();
+
+		freeVirtualFiles.clear();
+		virtualChildren.assign(j, {});
+
+		for (FileHandle i = 0; i < j; ++i)
+			if (!arr.node(i).isVirtual())
+				freeVirtualFiles.push_back(i);
+
+		//Folders are ordered before files in the children
+
+		for (FileHandle i = 1; i < j; ++i)
+			if (arr.node(i).isVirtual() && arr.node(i).isFolder())
+				virtualChildren[arr.node(i).parent].push_back(i);
+
+		for (FileHandle i = 0; i < j; ++i)
+			arr.node(i).fileHint = FileHandle(virtualChildren[i].size());
+
+		for (FileHandle i = 1; i < j; ++i)
+			if (arr.node(i).isVirtual() && !arr.node(i).isFolder())
+				virtualChildren[arr.node(i).parent].push_back(i);
+
+		for (FileHandle i = 0; i < j; ++i) {
+			arr.node(i).folderHint = 0;
+			arr.node(i).fileEnd = FileHandle(virtualChildren[i].size());
+		}
+	}
+
+	FileHandle FileSystem::insertVirtual(FileInfo info) {
+
+		auto &arr = virtualFiles;
+
+		//Reuse a removed slot if possible, so no other handles have to change
+
+		FileHandle handle;
+
+		if (freeVirtualFiles.size()) {
+			handle = freeVirtualFiles.back();
+			freeVirtualFiles.pop_back();
+		} else {
+			handle = arr.size();
+			virtualChildren.push_back({});
+		}
+
+		info.folderHint = info.fileHint = info.fileEnd = 0;
+		arr.insert(handle, info);
+
+		linkVirtual(handle);
+		return handle;
+	}
+
+	void FileSystem::eraseVirtual(FileHandle handle) {
+
+		unlinkVirtual(handle);
+
+		//Remove from system; the slot can be reused by the next add
+
+		virtualFiles.erase(handle);
+		virtualChildren[handle].clear();
+		freeVirtualFiles.push_back(handle);
+	}
+
+	void FileSystem::linkVirtual(FileHandle handle) {
+
+		//Add to the parent; folders are ordered before files
+
+		VirtualFileTable &arr = virtualFiles;
+		const VirtualFileTable::Node &node = arr.node(handle);
+		const bool isFolder = node.isFolder();
+
+		VirtualFileTable::Node &parent = arr.node(node.parent);
+		List<FileHandle> &siblings = virtualChildren[node.parent];
+
+		siblings.insert(siblings.begin() + (isFolder ? parent.fileHint : parent.fileEnd), handle);
+
+		parent.fileHint += FileHandle(isFolder);
+		++parent.fileEnd;
+	}
+
+	void FileSystem::unlinkVirtual(FileHandle handle) {
+
+		//Remove from parent
+
+		VirtualFileTable &arr = virtualFiles;
+		const VirtualFileTable::Node &node = arr.node(handle);
+		const bool isFolder = node.isFolder();
+
+		VirtualFileTable::Node &parent = arr.node(node.parent);
+		List<FileHandle> &siblings = virtualChildren[node.parent];
+
+		auto beg = siblings.begin() + (isFolder ? parent.folderHint : parent.fileHint);
+		auto end = siblings.begin() + (isFolder ? parent.fileHint : parent.fileEnd);
+
+		//The last sibling is checked first, since a removed folder removes its children from the last one
+		//That way every child is found (and erased) right away, instead of the whole folder being searched for each
+
+		siblings.erase(end != beg && *(end - 1) == handle ? end - 1 : std::find(beg, end, handle));
+
+		if (isFolder)
+			--parent.fileHint;
+
+		--parent.fileEnd;
+	}
+
+	void FileSystem::moveVirtual(FileHandle handle, FileHandle parent, const String &path) {
+
+		if (virtualFiles.node(handle).parent != parent) {
+			unlinkVirtual(handle);
+			virtualFiles.node(handle).parent = parent;
+			linkVirtual(handle);
+		}
+
+		renameVirtual(handle, path);
+	}
+
+	void FileSystem::renameVirtual(FileHandle handle, const String &path) {
+
+		VirtualFileTable &arr = virtualFiles;
+
+		const usz length = arr.path(handle).size();
+		arr.rename(handle, path);
+
+		//Removed children can still be listed while a batch is applied
+
+		for (FileHandle child : virtualChildren[handle])
+			if (arr.node(child).isVirtual() && arr.node(child).parent == handle)
+				renameVirtual(child, path + String(arr.path(child).substr(length)));
+	}
+
+	bool FileSystem::remove(const String &path, bool isCallback) {
+
+		FileSystemWriteLock lock(this);
+		String apath;
+
+		if (!resolvePath(path, apath)) {
+			System::log()->fatal("Invalid path");
+			return false;
+		}
+
+		FileFlags flags = apath[0] == '~' ? FileFlags::IS_VIRTUAL: FileFlags::NONE;
+		invalidate(apath, true);
+
+		if (!isCallback) {
+
+			const FileInfo inf = get(apath);
+
+			if (!inf.hasAccess(FileAccess::WRITE) || inf.path.size() == 1) {
+				System::log()->fatal("File access isn't allowed; write access is disabled");
+				return false;
+			}
+
+			//Remove children (copied, since removing them modifies the children)
+
+			if (inf.isVirtual() && inf.getFileObjects() != 0) {
+
+				const List<FileHandle> children = virtualChildren[virtualFiles.find(apath)];
+
+				for (auto it = children.rbegin(); it != children.rend(); ++it)
+					remove(String(virtualFiles.path(*it)));
+			}
+		}
+
+		//Pass remove events
+
+		FileInfo inf {
+			apath, apath.substr(apath.find_last_of('/') + 1),
+			0, nullptr, 0, 0, 0, 0, 0,
+			flags
+		};
+
+		onFileChange(inf, FileChange::DEL);
+		notify(inf, FileChange::DEL);
+
+		//Remove actual file
+
+		if (!isCallback) {
+
+			if (inf.isVirtual())
+				eraseVirtual(virtualFiles.find(inf.path));
+
+			//The path was queried again while it still existed, so it's invalidated again
+
+			else {
+				delLocal(inf.path);
+				invalidate(apath, true);
+			}
+		}
+
+		return true;
+	}
+
+	bool FileSystem::add(const String &path, bool isFolder, bool isCallback) {
+
+		FileSystemWriteLock lock(this);
+		String apath;
+
+		if (!resolvePath(path, apath)) {
+			System::log()->fatal("Invalid file path");
+			return false;
+		}
+
+		invalidate(apath, false);
+
+		//Callbacks are sent after the file was created
+
+		if (!isCallback && exists(apath))
+			return true;
+
+		bool isLocal = apath[0] == '.';
+
+		List<String> parts;
+		obtainPath(path, parts);
+
+		//Go through subfiles and find the parent
+
+		FileHandle pid{};
+		FileInfo parent;
+
+		if (!isCallback) {
+
+			if (!isLocal) {
+
+				String dpath = "~";
+
+				for (usz i = 1, j = parts.size() - 1; i < j; ++i) {
+
+					dpath += "/" + parts[i];
+
+					//Mkdir
+
+					FileHandle handle = virtualFiles.find(dpath);
+
+					if (handle == invalidFileHandle) {
+
+						if (!add(dpath, true)) {
+							System::log()->fatal("Couldn't create subdirectory");
+							return false;
+						}
+
+						handle = virtualFiles.find(dpath);
+					}
+
+					pid = handle;
+				}
+
+				parent = virtualFiles[pid];
+
+			} else {
+
+				String dpath = ".";
+
+				for (usz i = 1, j = parts.size() - 1; i < j; ++i) {
+
+					const String part = parts[i];
+					dpath += "/" + part;
+
+					//Mkdir
+
+					if (!exists(dpath)) {
+
+						if (!add(dpath, true)) {
+							System::log()->fatal("Couldn't create subdirectory");
+							return false;
+						}
+
+						parent = get(dpath);
+					}
+				}
+
+				if (parent.path.empty())
+					parent = get(dpath);
+			}
+
+			if (!parent.hasAccess(FileAccess::WRITE)) {
+				System::log()->fatal("Write into folder isn't supported");
+				return false;
+			}
+
+			//Create file or directory
+
+			String &part = *(parts.end() - 1);
+
+			if (!isLocal)
+				insertVirtual(FileInfo {
+					apath, part,
+					0, nullptr, 0,
+					pid, 0, 0, 0,
+					FileFlags(
+						isFolder ? u8(parent.flags) : (u8(parent.flags) & ~u8(FileFlags::IS_FOLDER))
+					)
+				});
+
+			//The path was queried again before it existed, so it's invalidated again
+
+			else {
+				makeLocal(apath, isFolder);
+				invalidate(apath, false);
+			}
+		}
+
+		//Send update
+
+		const FileInfo fi = get(apath);
+		onFileChange(fi, FileChange::ADD);
+		notify(fi, FileChange::ADD);
+
+		return true;
+	}
+
+	bool FileSystem::update(const String &path) {
+
+		FileSystemWriteLock lock(this);
+		String apath;
+
+		if (resolvePath(path, apath))
+			invalidate(apath, false);
+
+		const FileInfo &file = get(path);
+		onFileChange(file, FileChange::UPDATE);
+		notify(file, FileChange::UPDATE);
+
+		return true;
+	}
+
+	bool FileSystem::mov(const String &path, const String &npath, bool isCallback) {
+
+		FileSystemWriteLock lock(this);
+		String apath, anpath;
+
+		if (!resolvePath(path, apath) || !resolvePath(npath, anpath)) {
+			System::log()->fatal("Invalid path");
+			return false;
+		}
+
+		invalidate(apath, true);
+		invalidate(anpath, false);
+
+		if (!isCallback) {
+
+			if (apath[0] != '~' || anpath[0] != '~') {
+				System::log()->fatal("Only virtual files can be moved");
+				return false;
+			}
+
+			const FileHandle handle = virtualFiles.find(apath);
+			const FileHandle parent = virtualFiles.find(StringView(anpath).substr(0, anpath.find_last_of('/')));
+
+			if (handle == invalidFileHandle || apath.size() == 1 || !virtualFiles.node(handle).hasAccess(FileAccess::WRITE)) {
+				System::log()->fatal("File access isn't allowed; write access is disabled");
+				return false;
+			}
+
+			if (
+				parent == invalidFileHandle || !virtualFiles.node(parent).isFolder() ||
+				!virtualFiles.node(parent).hasAccess(FileAccess::WRITE)
+			) {
+				System::log()->fatal("Write into folder isn't supported");
+				return false;
+			}
+
+			if (apath == anpath)
+				return true;
+
+			//A folder can't be moved into itself
+
+			if (virtualFiles.find(anpath) != invalidFileHandle || (anpath.starts_with(apath) && anpath[apath.size()] == '/')) {
+				System::log()->fatal("Couldn't move file; the destination already exists or is inside of the file");
+				return false;
+			}
+
+			moveVirtual(handle, parent, anpath);
+		}
+
+		const FileInfo &info = get(anpath);
+		onFileChange(info, FileChange::MOVE);
+		notify(info, FileChange::MOVE, apath);
+
+		return true;
+	}
+
+	bool FileSystem::copy(const String &path, const String &npath) {
+
+		FileSystemWriteLock lock(this);
+		String apath, anpath;
+
+		if (!resolvePath(path, apath) || !resolvePath(npath, anpath)) {
+			System::log()->fatal("Invalid path");
+			return false;
+		}
+
+		if (!exists(apath) || get(apath).isFolder()) {
+			System::log()->fatal("Only existing files can be copied");
+			return false;
+		}
+
+		if (apath == anpath)
+			return true;
+
+		if (!exists(anpath) && !add(anpath, false))
+			return false;
+
+		const FileInfo info = get(apath);
+
+		if (copyShared(info, anpath))
+			return update(anpath);
+
+		Buffer buffer;
+		return (!info.fileSize || read(apath, buffer)) && write(anpath, buffer);
+	}
+
+	FileSystem::Batch::Batch(FileSystem *fs): fs(fs) {}
+
+	void FileSystem::Batch::add(const String &path, bool isFolder) {
+		operations.push_back(Operation{ path, {}, isFolder ? Type::ADD_FOLDER : Type::ADD });
+	}
+
+	void FileSystem::Batch::remove(const String &path) {
+		operations.push_back(Operation{ path, {}, Type::DEL });
+	}
+
+	void FileSystem::Batch::mov(const String &path, const String &newPath) {
+		operations.push_back(Operation{ path, newPath, Type::MOVE });
+	}
+
+	static StringView parentPath(StringView path) {
+		return path.substr(0, path.find_last_of('/'));
+	}
+
+	bool FileSystem::Batch::validate() const {
+
+		//The paths that previous changes added, removed or moved to
+		//Moved files keep the path they have in the file system, so their children can still be found there
+
+		struct Staged {
+			String movedFrom;
+			bool exists, isFolder;
+		};
+
+		PathMap<Staged> staged;
+		staged.reserve(operations.size());
+
+		//If the file exists after the previous changes; tablePath is where the file system has it (empty if it was added)
+
+		auto lookup = [this, &staged](StringView path, bool &isFolder, bool &isWritable, String *tablePath = nullptr) -> bool {
+
+			if (auto it = staged.find(path); it != staged.end()) {
+
+				isFolder = it->second.isFolder;
+				isWritable = true;
+
+				if (tablePath)
+					*tablePath = it->second.movedFrom;
+
+				return it->second.exists;
+			}
+
+			//The closest staged parent decides if the file is still where the file system has it
+
+			StringView current = path;
+			String buffer;
+
+			for (usz slash = path.find_last_of('/'); slash != StringView::npos && slash; slash = path.find_last_of('/', slash - 1)) {
+
+				auto it = staged.find(path.substr(0, slash));
+
+				if (it == staged.end())
+					continue;
+
+				if (!it->second.exists || it->second.movedFrom.empty())
+					return false;
+
+				buffer = it->second.movedFrom;
+				buffer += path.substr(slash);
+				current = buffer;
+				break;
+			}
+
+			const FileHandle handle = fs->virtualFiles.find(current);
+
+			if (handle == invalidFileHandle)
+				return false;
+
+			const VirtualFileTable::Node &node = fs->virtualFiles.node(handle);
+			isFolder = node.isFolder();
+			isWritable = node.hasAccess(FileAccess::WRITE);
+
+			if (tablePath)
+				*tablePath = current;
+
+			return true;
+		};
+
+		//Staged changes of the children follow their folder
+
+		auto stageChildren = [&staged](const String &path, const String *newPath) {
+
+			List<std::pair<String, Staged>> moved;
+
+			for (auto it = staged.begin(); it != staged.end(); ) {
+
+				if (it->first.size() <= path.size() || it->first[path.size()] != '/' || !it->first.starts_with(path)) {
+					++it;
+					continue;
+				}
+
+				if (newPath)
+					moved.push_back({ *newPath + it->first.substr(path.size()), std::move(it->second) });
+
+				it = staged.erase(it);
+			}
+
+			for (auto &child : moved)
+				staged[child.first] = std::move(child.second);
+		};
+
+		bool isFolder{}, isWritable{};
+
+		//Imports add many files to the same folder, so the last folder is only checked once
+		//Removes and moves can change it, so they reset it
+
+		StringView folder;
+		String folderTablePath;
+
+		for (const Operation &op : operations)
+			switch (op.type) {
+
+				case Type::ADD:
+				case Type::ADD_FOLDER: {
+
+					const StringView parent = parentPath(op.path);
+
+					if (parent == folder) {
+
+						if (auto it = staged.find(op.path); it != staged.end()) {
+							if (it->second.exists)
+								break;
+						}
+
+						else if (
+							!folderTablePath.empty() && fs->virtualFiles.find(
+								folderTablePath == parent ? op.path : folderTablePath + op.path.substr(parent.size())
+							) != invalidFileHandle
+						)
+							break;
+
+						staged[op.path] = Staged{ {}, true, op.type == Type::ADD_FOLDER };
+						break;
+					}
+
+					if (lookup(op.path, isFolder, isWritable))
+						break;
+
+					//Missing folders are created, up to the first folder that exists
+
+					List<StringView> folders;
+					StringView existing = parent;
+
+					for (; !lookup(existing, isFolder, isWritable); existing = parentPath(existing))
+						folders.push_back(existing);
+
+					if (!isFolder || !isWritable) {
+						System::log()->fatal("Write into folder isn't supported");
+						return false;
+					}
+
+					for (StringView missing : folders)
+						staged[String(missing)] = Staged{ {}, true, true };
+
+					staged[op.path] = Staged{ {}, true, op.type == Type::ADD_FOLDER };
+
+					folder = parent;
+					lookup(folder, isFolder, isWritable, &folderTablePath);
+					break;
+				}
+
+				case Type::DEL:
+
+					if (!lookup(op.path, isFolder, isWritable) || !isWritable || op.path.size() == 1) {
+						System::log()->fatal("File access isn't allowed; write access is disabled");
+						return false;
+					}
+
+					if (isFolder)
+						stageChildren(op.path, nullptr);
+
+					staged[op.path] = Staged{ {}, false, isFolder };
+					folder = {};
+					break;
+
+				case Type::MOVE: {
+
+					//Files that exist in the file system are found through where the file system has them
+
+					String movedFrom;
+					bool isDestFolder{};
+
+					if (!lookup(op.path, isFolder, isWritable, &movedFrom) || !isWritable || op.path.size() == 1) {
+						System::log()->fatal("File access isn't allowed; write access is disabled");
+						return false;
+					}
+
+					if (!lookup(parentPath(op.newPath), isDestFolder, isWritable) || !isDestFolder || !isWritable) {
+						System::log()->fatal("Write into folder isn't supported");
+						return false;
+					}
+
+					//A folder can't be moved into itself
+
+					if (
+						lookup(op.newPath, isDestFolder, isWritable) ||
+						(op.newPath.starts_with(op.path) && op.newPath[op.path.size()] == '/')
+					) {
+						System::log()->fatal("Couldn't move file; the destination already exists or is inside of the file");
+						return false;
+					}
+
+					if (isFolder)
+						stageChildren(op.path, &op.newPath);
+
+					staged[op.path] = Staged{ {}, false, isFolder };
+					staged[op.newPath] = Staged{ std::move(movedFrom), true, isFolder };
+					folder = {};
+					break;
+				}
+			}
+
+		return true;
+	}
+
+	bool FileSystem::Batch::apply() {
+
+		FileSystemWriteLock lock(fs);
+
+		//Resolved once, so validating and applying can compare the paths directly
+
+		for (Operation &op : operations) {
+
+			String apath, anpath;
+
+			if (
+				!fs->resolvePath(op.path, apath) || apath[0] != '~' ||
+				(op.type == Type::MOVE && (!fs->resolvePath(op.newPath, anpath) || anpath[0] != '~'))
+			) {
+				System::log()->fatal("Batches only support valid virtual paths");
+				operations.clear();
+				return false;
+			}
+
+			op.path = std::move(apath);
+			op.newPath = std::move(anpath);
+		}
+
+		if (!validate()) {
+			operations.clear();
+			return false;
+		}
+
+		//The children of changed folders are only put in order (folders first) once, after every change
+		//Removed slots are only reused after that, since they can still be in the children until then
 
-        for(FileHandle i = info.folderHint, end = info.fileEnd; i != end; ++i)
-            callback(this, arr[i], data);
+		VirtualFileTable &arr = fs->virtualFiles;
 
-        if(recurse)
-            for(FileHandle i = info.folderHint; i != info.fileHint; ++i)
-                foreachFile(arr[i].path, callback, true, data);
+		List<FileChangeEvent> changes;
+		List<FileHandle> dirty, removed, moved;
+		FileInfo info;
 
-        return true;
-    }
+		auto markDirty = [&dirty](FileHandle folder) {
+			if (dirty.empty() || dirty.back() != folder)
+				dirty.push_back(folder);
+		};
 
-	const FileInfo FileSystem::get(const String &path) const {
+		auto insert = [&](StringView path, FileHandle parent, bool isFolder) -> FileHandle {
 
-		String apath;
+			FileHandle handle;
 
-		if (!resolvePath(path, apath))
-			System::log()->fatal("File path should be in proper oic notation");
+			if (fs->freeVirtualFiles.size()) {
+				handle = fs->freeVirtualFiles.back();
+				fs->freeVirtualFiles.pop_back();
+			} else {
+				handle = arr.size();
+				fs->virtualChildren.push_back({});
+			}
 
-		if (apath[0] == '.')
-			return local(apath);
+			const FileFlags flags = arr.node(parent).flags;
 
-		auto ou = virtualFileLut.find(apath);
+			arr.insert(handle, FileInfo {
+				String(path), String(path.substr(path.find_last_of('/') + 1)),
+				0, nullptr, 0,
+				parent, 0, 0, 0,
+				FileFlags(isFolder ? u8(flags) : (u8(flags) & ~u8(FileFlags::IS_FOLDER)))
+			});
 
-		if (ou == virtualFileLut.end())
-			System::log()->fatal("Virtual file doesn't exist");
+			fs->virtualChildren[parent].push_back(handle);
+			markDirty(parent);
 
-		return virtualFiles[ou->second];
-	}
+			arr.get(handle, info);
+			fs->onFileChange(info, FileChange::ADD);
+			changes.push_back(FileChangeEvent{ info, FileChange::ADD, {} });
 
-	bool FileSystem::exists(const String &path) const {
+			return handle;
+		};
 
-		String apath;
+		auto obtainFolder = [&](StringView path, auto &self) -> FileHandle {
 
-		if (!resolvePath(path, apath))
-			return false;
+			const FileHandle handle = arr.find(path);
 
-		if (apath[0] == '~')
-			return virtualFileLut.find(apath) != virtualFileLut.end();
+			if (handle != invalidFileHandle)
+				return handle;
 
-		return hasLocal(apath);
-	}
+			return insert(path, self(parentPath(path), self), true);
+		};
 
-	bool FileSystem::regionExists(const String &path, FileSize size, FileSize offset) const {
+		auto erase = [&](FileHandle handle, auto &self) -> void {
 
-		String apath;
+			const List<FileHandle> &children = fs->virtualChildren[handle];
 
-		if (!resolvePath(path, apath))
-			return false;
+			for (auto it = children.rbegin(); it != children.rend(); ++it)
+				if (arr.node(*it).isVirtual() && arr.node(*it).parent == handle)
+					self(*it, self);
 
-		if (apath[0] == '~') {
+			const FileInfo inf {
+				String(arr.path(handle)), String(arr.name(handle)),
+				0, nullptr, 0, 0, 0, 0, 0,
+				FileFlags::IS_VIRTUAL
+			};
 
-			auto it = virtualFileLut.find(apath);
+			fs->onFileChange(inf, FileChange::DEL);
+			changes.push_back(FileChangeEvent{ inf, FileChange::DEL, {} });
 
-			if (it == virtualFileLut.end())
-				return false;
+			arr.erase(handle);
+			fs->virtualChildren[handle].clear();
+			removed.push_back(handle);
+		};
 
-			return virtualFiles[it->second].hasRegion(size, offset);
-		}
+		//The folder of the previous add, like when validating
 
-		return hasLocalRegion(apath, size, offset);
-	}
+		StringView lastFolder;
+		FileHandle lastFolderHandle{};
 
-	void FileSystem::initLut() {
+		for (const Operation &op : operations)
+			switch (op.type) {
 
-		FileInfo::SizeType i{};
-		virtualFileLut.clear();
+				case Type::ADD:
+				case Type::ADD_FOLDER: {
 
-		for (const FileInfo &info : virtualFiles) {
-			virtualFileLut[info.path] = i;
-			++i;
-		}
-	}
+					fs->invalidate(op.path, false);
 
-	bool FileSystem::remove(const String &path, bool isCallback) {
+					if (arr.find(op.path) != invalidFileHandle)
+						break;
 
-		String apath;
+					const StringView parent = parentPath(op.path);
 
-		if (!resolvePath(path, apath)) {
-			System::log()->fatal("Invalid path");
-			return false;
-		}
+					if (parent != lastFolder) {
+						lastFolderHandle = obtainFolder(parent, obtainFolder);
+						lastFolder = parent;
+					}
 
-		FileFlags flags = apath[0] == '~' ? FileFlags::IS_VIRTUAL: FileFlags::NONE;
+					insert(op.path, lastFolderHandle, op.type == Type::ADD_FOLDER);
+					break;
+				}
 
-		if (!isCallback) {
+				case Type::DEL: {
 
-			const FileInfo inf = get(apath);
+					fs->invalidate(op.path, true);
 
-			if (!inf.hasAccess(FileAccess::WRITE) || inf.path.size() == 1) {
-				System::log()->fatal("File access isn't allowed; write access is disabled");
-				return false;
-			}
+					const FileHandle handle = arr.find(op.path);
+					markDirty(arr.node(handle).parent);
+					erase(handle, erase);
+
+					lastFolder = {};
+					break;
+				}
+
+				case Type::MOVE: {
+
+					fs->invalidate(op.path, true);
+					fs->invalidate(op.newPath, false);
 
-			//Remove children
+					//The old folder is marked, so the moved file is removed from it with the other changed folders
+					//Until then it's still listed there, but its parent tells that it moved
 
-			if (inf.isVirtual()) {
+					const FileHandle handle = arr.find(op.path);
+					const FileHandle parent = arr.node(handle).parent;
+					const FileHandle newParent = arr.find(parentPath(op.newPath));
 
-				FileInfo::SizeType fileObjects;
+					if (parent != newParent) {
 
-				if ((fileObjects = inf.getFileObjects()) != 0) {
+						fs->virtualChildren[newParent].push_back(handle);
+						moved.push_back(handle);
+						arr.node(handle).parent = newParent;
 
-					FileHandle folderEnd = inf.fileHint - 1;
-					FileHandle folderStart = inf.folderHint;
-					FileInfo::SizeType folders = inf.getFolders();
+						markDirty(parent);
+						markDirty(newParent);
+					}
 
-					FileHandle fileEnd = inf.fileEnd - 1 - folders;		//- folders since those will be removed
-					FileHandle fileStart = inf.fileHint - folders;		//- folders since those will be removed
+					fs->renameVirtual(handle, op.newPath);
 
-					for (FileHandle i = folderEnd; i >= folderStart; --i)
-						remove(virtualFiles[i].path);
+					arr.get(handle, info);
+					fs->onFileChange(info, FileChange::MOVE);
+					changes.push_back(FileChangeEvent{ info, FileChange::MOVE, op.path });
 
-					for (FileHandle i = fileEnd; i >= fileStart; --i)
-						remove(virtualFiles[i].path);
+					lastFolder = {};
+					break;
 				}
 			}
-		}
 
-		//Pass remove events
+		std::sort(dirty.begin(), dirty.end());
+		dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
 
-		FileInfo inf {
-			apath, apath.substr(apath.find_last_of('/') + 1),
-			0, nullptr, 0, 0, 0, 0, 0,
-			flags
-		};
+		//A file that moved back to a folder it was listed in is there twice; only the first is kept
 
-		onFileChange(inf, FileChange::DEL);
+		std::sort(moved.begin(), moved.end());
+		moved.erase(std::unique(moved.begin(), moved.end()), moved.end());
 
-		for (auto &cb : callbacks)
-			cb.second.first(this, inf, FileChange::DEL, cb.second.second);
+		List<bool> listed(moved.size());
 
-		//Remove actual file
+		for (FileHandle folder : dirty) {
 
-		if (!isCallback) {
+			VirtualFileTable::Node &node = arr.node(folder);
 
-			if (inf.isVirtual()) {
+			if (!node.isVirtual())
+				continue;
 
-				//Remove from parent
+			List<FileHandle> &children = fs->virtualChildren[folder];
 
-				List<FileInfo> &arr = virtualFiles;
-				auto &map = virtualFileLut;
+			children.erase(std::remove_if(children.begin(), children.end(), [&](FileHandle child) {
 
-				FileInfo &parent = arr[inf.parent];
+				const VirtualFileTable::Node &childNode = arr.node(child);
 
-				if (inf.isFolder())
-					--parent.fileHint;
+				if (!childNode.isVirtual() || childNode.parent != folder)
+					return true;
 
-				--parent.fileEnd;
+				const auto it = std::lower_bound(moved.begin(), moved.end(), child);
 
-				//Remove from system
+				if (it == moved.end() || *it != child)
+					return false;
 
-				FileHandle handle = map.find(inf.path)->second;
-				map.erase(inf.path);
-				arr.erase(arr.begin() + handle);
+				const bool isListed = listed[it - moved.begin()];
+				listed[it - moved.begin()] = true;
+				return isListed;
 
-				for (FileHandle i = handle, j = FileHandle(arr.size()); i < j; ++i) {
+			}), children.end());
 
-					FileInfo &f = arr[i];
-					FileHandle shouldDecrement = f.folderHint != 0;
+			const auto files = std::stable_partition(children.begin(), children.end(), [&arr](FileHandle child) {
+				return arr.node(child).isFolder();
+			});
 
-					f.parent -= FileHandle(f.parent > handle);
-					f.folderHint -= shouldDecrement;
-					f.fileHint -= shouldDecrement;
-					f.fileEnd -= shouldDecrement;
-				}
-			} else delLocal(inf.path);
+			node.folderHint = 0;
+			node.fileHint = FileHandle(files - children.begin());
+			node.fileEnd = FileHandle(children.size());
 		}
 
+		fs->freeVirtualFiles.insert(fs->freeVirtualFiles.end(), removed.begin(), removed.end());
+
+		operations.clear();
+		fs->notify(std::move(changes));
 		return true;
 	}
 
-	bool FileSystem::add(const String &path, bool isFolder, bool isCallback) {
+	void FileSystem::lock() {
 
-		String apath;
+		const std::thread::id id = std::this_thread::get_id();
 
-		if (!resolvePath(path, apath)) {
-			System::log()->fatal("Invalid file path");
-			return false;
+		if (writer.load(std::memory_order_relaxed) == id) {
+			++writeDepth;
+			return;
 		}
 
-		if (exists(apath))
-			return true;
+		//Upgrading a shared lock would wait on itself
 
-		bool isLocal = apath[0] == '.';
+		if (std::find(sharedLocks.begin(), sharedLocks.end(), this) != sharedLocks.end()) {
+			System::log()->fatal("The file system can't be modified while it's being read by the same thread");
+			return;
+		}
 
-		List<String> parts;
-		obtainPath(path, parts);
+		mutex.lock();
+		writer.store(id, std::memory_order_relaxed);
+		writeDepth = 1;
+	}
 
-		//Go through subfiles and find the parent
+	void FileSystem::unlock() {
 
-		FileHandle pid{};
-		FileInfo parent;
+		if (--writeDepth)
+			return;
 
-		if (!isCallback) {
+		writer.store({}, std::memory_order_relaxed);
+		mutex.unlock();
+	}
 
-			if (!isLocal) {
+	bool FileSystem::hasAccess() const {
+		return
+			writer.load(std::memory_order_relaxed) == std::this_thread::get_id() ||
+			std::find(sharedLocks.begin(), sharedLocks.end(), this) != sharedLocks.end();
+	}
 
-				auto &arr = virtualFiles;
-				parent = arr[0];
+	bool FileSystem::lockShared() const {
 
-				String dpath = "~";
+		if (hasAccess())
+			return false;
 
-				for (usz i = 1, j = parts.size() - 1; i < j; ++i) {
+		mutex.lock_shared();
+		sharedLocks.push_back(this);
+		return true;
+	}
 
-					const String part = parts[i];
-					bool found = false;
+	void FileSystem::unlockShared() const {
+		sharedLocks.erase(std::find(sharedLocks.begin(), sharedLocks.end(), this));
+		mutex.unlock_shared();
+	}
 
-					dpath += "/" + part;
+	bool FileSystem::read(const String &file, u8 *address, FileSize size, FileSize offset) {
 
-					for (FileHandle k = parent.folderHint; k != parent.fileHint; ++k) {
+		String apath;
+		bool success;
 
-						if (arr[k].name == part) {
-							parent = arr[pid = k];
-							found = true;
-							break;
-						}
-					}
+		const IoRegion region{ offset, size, address };
 
-					//Mkdir
+		if (resolvePath(file, apath)) {
 
-					if (!found) {
+			traceAccess(apath, { &region, 1 });
 
-						if (!add(dpath, true)) {
-							System::log()->fatal("Couldn't create subdirectory");
-							return false;
-						}
+			if (readPrefetched(apath, { &region, 1 }))
+				return true;
 
-						parent = get(dpath);
-					}
-				}
+			if (readCached(apath, { &region, 1 }, success))
+				return success;
+		}
 
-				if (parent.path.empty())
-					parent = get(dpath);
+		if (File *f = open(file, FileFlags::READ)) {
+			success = f->read(address, size, offset);
+			close(f);
+			return success;
+		}
 
-			} else {
+		return false;
+	}
 
-				String dpath = ".";
+	bool FileSystem::read(const String &path, ListRef<const IoRegion> regions) {
 
-				for (usz i = 1, j = parts.size() - 1; i < j; ++i) {
+		String apath;
+		bool success;
 
-					const String part = parts[i];
-					dpath += "/" + part;
+		if (resolvePath(path, apath)) {
 
-					//Mkdir
+			traceAccess(apath, regions);
 
-					if (!exists(dpath)) {
+			if (readPrefetched(apath, regions))
+				return true;
 
-						if (!add(dpath, true)) {
-							System::log()->fatal("Couldn't create subdirectory");
-							return false;
-						}
+			if (readCached(apath, regions, success))
+				return success;
+		}
 
-						parent = get(dpath);
-					}
-				}
+		if (File *f = open(path, FileFlags::READ)) {
+			success = f->readv(regions);
+			close(f);
+			return success;
+		}
 
-				if (parent.path.empty())
-					parent = get(dpath);
-			}
+		return false;
+	}
 
-			if (!parent.hasAccess(FileAccess::WRITE)) {
-				System::log()->fatal("Write into folder isn't supported");
-				return false;
-			}
+	File *FileSystem::open(FileId id, ns maxTimeout, ns retryTimeout) {
 
-			//Create file or directory
+		FileInfo info;
 
-			String &part = *(parts.end() - 1);
+		{
+			FileSystemReadLock lock(this);
 
-			if (!isLocal) {
+			if (!virtualFiles.isValid(id))
+				return nullptr;
 
-				FileHandle handle = isFolder ? parent.fileHint : parent.fileEnd;
+			virtualFiles.get(id.handle, info);
+		}
 
-				//The file doesn't have folders/files yet
-				if (handle == 0) {
-					System::log()->fatal("File hint is invalid");
-					return false;
-				}
+		return open(info, maxTimeout, retryTimeout);
+	}
 
-				//Set up the parent's handles
+	bool FileSystem::read(FileId id, u8 *address, FileSize size, FileSize offset) {
+		const IoRegion region{ offset, size, address };
+		return read(id, { &region, 1 });
+	}
 
-				auto &p = virtualFiles[pid];
+	bool FileSystem::read(FileId id, Buffer &buffer, FileSize size, FileSize offset) {
 
-				bool setParentHint = false;
+		if (!size) {
 
-				if (parent.getFolders() == 0 && isFolder) {			//Setup folder hint
+			FileSystemReadLock lock(this);
 
-					const FileHandle files = parent.getFiles();
+			if (!virtualFiles.isValid(id))
+				return false;
 
-					if (files == 0)
-						p.fileHint = handle + 1;
-					else
-						++p.fileHint;
+			const FileSize fileSize = virtualFiles.metadata(id.handle).fileSize;
+			size = fileSize - (offset >= fileSize ? 0 : offset);
+		}
 
-					p.folderHint = handle;
-					p.fileEnd = handle + files + 1;
+		buffer.resize(size);
+		return read(id, buffer.data(), size, offset);
+	}
 
-				} else if (parent.getFiles() == 0 && !isFolder) {		//Setup file hint
+	bool FileSystem::read(FileId id, ListRef<const IoRegion> regions) {
 
-					const FileHandle folders = parent.getFolders();
-					const FileHandle ou = parent.folderHint;
+		//The info is copied while locked; the path is only used for the caches, it's never looked up
 
-					if (folders == 0)
-						p.folderHint = handle;
+		FileInfo info;
 
-					p.fileHint = ou + folders;
-					p.fileEnd = ou + folders + 1;
+		{
+			FileSystemReadLock lock(this);
 
-				} else {												//Increase hints
-					p.fileHint += FileHandle(isFolder);
-					++p.fileEnd;
-				}
+			if (!virtualFiles.isValid(id))
+				return false;
 
-				//Update all file handles
+			virtualFiles.get(id.handle, info);
+		}
 
-				auto &lut = virtualFileLut;
-				auto &arr = virtualFiles;
+		traceAccess(info.path, regions);
 
-				for (FileHandle i = 0, j = virtualSize(); i < j; ++i) {
+		if (readPrefetched(info.path, regions))
+			return true;
 
-					FileInfo &f = arr[i];
+		bool success;
 
-					FileHandle shouldIncrement(
-						i != pid && (f.fileEnd > handle || (f.fileEnd == handle && f.parent >= pid))
-					);
+		if (readCached(info.path, regions, success))
+			return success;
 
-					f.folderHint += shouldIncrement;
-					f.fileHint += shouldIncrement;
-					f.fileEnd += shouldIncrement;
+		if (!info.hasAccess(FileAccess::READ))
+			return false;
 
-					if (i >= handle)
-						lut[f.path] = i + 1;
+		if (File *f = open(info)) {
+			success = f->readv(regions);
+			close(f);
+			return success;
+		}
 
-					f.parent += FileHandle(f.parent >= handle);
-				}
+		return false;
+	}
 
-				//Obtain where the folder's children should be located
+	FileView FileSystem::view(const String &path) {
 
-				FileHandle hint = isFolder ? parent.fileEnd : 0;
+		FileView view(this, open(path, FileFlags::READ));
 
-				if (isFolder && parent.getFolders() > 1 && !setParentHint)
-					hint = arr[parent.fileHint - 2].fileEnd;
+		if (isTracing.load(std::memory_order_relaxed) && view.valid()) {
+			const IoRegion region{ 0, view.size(), nullptr };
+			traceAccess(get(path).path, { &region, 1 });
+		}
 
-				//The folder doesn't have a place to go
+		return view;
+	}
 
-				if (hint == 0 && isFolder) {
-					System::log()->fatal("Folder doesn't have place it could be allocated in");
-					return false;
-				}
+	void FileSystem::startAccessTrace() {
 
-				//Add to system
+		std::lock_guard<std::mutex> guard(traceMutex);
 
-				FileInfo info {
-					apath, part,
-					0, nullptr, 0,
-					pid, hint, hint, hint,
-					FileFlags(
-						isFolder ? u8(parent.flags) : (u8(parent.flags) & ~u8(FileFlags::IS_FOLDER))
-					)
-				};
+		accessTrace.clear();
+		tracedRegions.clear();
+		isTracing = true;
+	}
 
-				lut[apath] = handle;
-				arr.insert(arr.begin() + handle, info);
+	List<FileAccessRecord> FileSystem::stopAccessTrace() {
 
-			}
-			else makeLocal(apath, isFolder);
-		}
+		std::lock_guard<std::mutex> guard(traceMutex);
 
-		//Send update
+		isTracing = false;
+		tracedRegions.clear();
+		return std::move(accessTrace);
+	}
 
-		const FileInfo fi = get(apath);
-		onFileChange(fi, FileChange::ADD);
+	void FileSystem::traceAccess(const String &path, ListRef<const IoRegion> regions) {
 
-		for (auto &cb : callbacks)
-			cb.second.first(this, fi, FileChange::ADD, cb.second.second);
+		if (!isTracing.load(std::memory_order_relaxed))
+			return;
 
-		return true;
-	}
+		std::lock_guard<std::mutex> guard(traceMutex);
 
-	bool FileSystem::update(const String &path) {
+		if (!isTracing)
+			return;
 
-		const FileInfo &file = get(path);
-		onFileChange(file, FileChange::UPDATE);
+		auto &traced = tracedRegions[path];
 
-		for (auto &cb : callbacks)
-			cb.second.first(this, file, FileChange::UPDATE, cb.second.second);
+		for (const IoRegion &region : regions) {
 
-		return true;
-	}
+			const std::pair<FileSize, FileSize> key{ region.offset, region.size };
 
-	bool FileSystem::mov(const String &path, const String &npath, bool isCallback) {
+			if (std::find(traced.begin(), traced.end(), key) != traced.end())
+				continue;
 
-		if (path.substr(0, path.find_last_of('/')) != npath.substr(0, npath.find_last_of('/'))) {
-			System::log()->fatal("Cannot move a file to a different folder: Not supported yet");
-			return false;
+			traced.push_back(key);
+			accessTrace.push_back(FileAccessRecord{ path, region.offset, region.size });
 		}
+	}
 
-		if (!isCallback) {
+	bool FileSystem::startPrefetch(const String &manifest, FileSize budget) {
 
-			const FileInfo &info = get(path);
-			rename(info, npath, true);
+		List<FileAccessRecord> records;
 
-			if (info.isFolder())
-				foreachFile(path, [](FileSystem *f, const FileInfo &fii, void *np) -> void {
+		if (!FilePrefetcher::loadManifest(this, manifest, records))
+			return false;
 
-					const FileInfo fi = fii;
-					f->rename(fi, (const char*)np + String("/") + fi.name, false);
+		startPrefetch(std::move(records), budget);
+		return true;
+	}
 
-				}, true, (void*)npath.c_str());
+	void FileSystem::startPrefetch(List<FileAccessRecord> records, FileSize budget) {
 
-		}
+		auto next = std::make_shared<FilePrefetcher>(this, std::move(records), budget);
 
-		const FileInfo &info = get(npath);
-		onFileChange(info, FileChange::MOVE);
+		std::lock_guard<std::mutex> guard(prefetcherMutex);
+		prefetcher = std::move(next);
+		isPrefetching = true;
+	}
 
-		for (auto &cb : callbacks)
-			cb.second.first(this, info, FileChange::MOVE, cb.second.second);
+	void FileSystem::stopPrefetch() {
 
-		return true;
+		//Destroyed (and joined) outside of the lock, unless a read is still using it
+
+		std::shared_ptr<FilePrefetcher> last;
+
+		{
+			std::lock_guard<std::mutex> guard(prefetcherMutex);
+			last = std::move(prefetcher);
+			isPrefetching = false;
+		}
 	}
 
-	void FileSystem::lock() { mutex.lock(); }
-	void FileSystem::unlock() { mutex.unlock(); }
+	PrefetchStats FileSystem::getPrefetchStats() const {
+
+		std::lock_guard<std::mutex> guard(prefetcherMutex);
+		return prefetcher ? prefetcher->getStats() : PrefetchStats{};
+	}
 
-	void FileSystem::rename(const FileInfo &info, const String &path, bool setName) {
+	bool FileSystem::readPrefetched(const String &path, ListRef<const IoRegion> regions) {
 
-		auto &map = virtualFileLut;
-		auto &arr = virtualFiles;
+		if (!isPrefetching.load(std::memory_order_relaxed))
+			return false;
 
-		FileHandle id = map[info.path];
-		map.erase(info.path);
+		std::shared_ptr<FilePrefetcher> current;
 
-		arr[id].path = path;
-		map[path] = id;
+		{
+			std::lock_guard<std::mutex> guard(prefetcherMutex);
+			current = prefetcher;
+		}
 
-		if (setName)
-			arr[id].name = info.path.substr(info.path.find_last_of('/') + 1);
+		return current && current->take(path, regions);
 	}
 
-	bool FileSystem::read(const String &file, u8 *address, FileSize size, FileSize offset) {
+	void FileSystem::invalidate(const String &path, bool recursive) {
 
-		if (File *f = open(file, FileFlags::READ)) {
-			bool success = f->read(address, size, offset);
-			close(f);
-			return success;
+		if (!isPrefetching.load(std::memory_order_relaxed))
+			return;
+
+		std::shared_ptr<FilePrefetcher> current;
+
+		{
+			std::lock_guard<std::mutex> guard(prefetcherMutex);
+			current = prefetcher;
 		}
 
-		return false;
+		if (current)
+			current->invalidate(path, recursive);
 	}
 
 	bool FileSystem::read(const String &path, Buffer &buffer, FileSize size, FileSize offset) {
@@ -638,8 +2433,8 @@ namespace oic {
 
 		if (File *f = open(path, FileFlags::WRITE)) {
 
-			if(offset != usz_MAX)
-				f->resize(size);
+			if (offset != usz_MAX && offset + size > f->size())
+				f->reserve(offset + size);
 
 			bool success = f->write(address, size, offset);
 			close(f);
@@ -657,7 +2452,66 @@ namespace oic {
 		if (!size)
 			size = buffer.size() - bufferOffset;
 
-		return write(path, buffer.data() + bufferOffset, size, fileOffset);
+		if (fileOffset)
+			return write(path, buffer.data() + bufferOffset, size, fileOffset);
+
+		//Clear; the file is overwritten in place and cut off after the buffer
+
+		if (File *f = open(path, FileFlags::WRITE)) {
+
+			f->reserve(size);
+
+			bool success = f->write(buffer.data() + bufferOffset, size, 0) && f->resize(size);
+			close(f);
+			return success;
+		}
+
+		return false;
+	}
+
+	bool FileSystem::writeAtomic(const String &path, const u8 *address, FileSize size) {
+
+		String apath;
+
+		if (!resolvePath(path, apath)) {
+			System::log()->fatal("Invalid path");
+			return false;
+		}
+
+		//Virtual files are in memory, so readers can't see them being written
+
+		if (apath[0] != '.') {
+
+			if (!exists(apath) && !add(apath, false))
+				return false;
+
+			if (File *f = open(apath, FileFlags::WRITE)) {
+				bool success = f->write(address, size, 0) && f->resize(size);
+				close(f);
+				return success;
+			}
+
+			return false;
+		}
+
+		//Only the rename has to be locked; the data is on disk before that
+
+		String temp;
+
+		if (!writeTempLocal(apath, address, size, temp))
+			return false;
+
+		FileSystemWriteLock lock(this);
+		const bool existed = exists(apath);
+
+		if (!replaceLocal(apath, temp))
+			return false;
+
+		return existed ? update(apath) : add(apath, false, true);
+	}
+
+	bool FileSystem::writeAtomic(const String &path, const Buffer &buffer) {
+		return writeAtomic(path, buffer.data(), buffer.size());
 	}
 
 	bool FileSystem::writeNew(const String &path, const Buffer &buffer, FileSize size, usz bufferOffset, FileSize fileOffset) {
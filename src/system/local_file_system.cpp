@@ -1,6 +1,7 @@
 #include "system/local_file_system.hpp"
 #include "system/system.hpp"
 #include "system/log.hpp"
+#include "utils/timer.hpp"
 
 //64-bit types for Unix
 
@@ -9,23 +10,37 @@
 #endif
 
 #include <stdio.h>
+#include <algorithm>
+#include <filesystem>
 
 //Platform wrappers
 
 #ifdef _WIN32
 	#include <direct.h>
+	#include <io.h>
+	#define fileno _fileno
 	#define S_ISREG(m) (((m) & S_IFMT) == S_IFREG)
 #else
 	#include <sys/stat.h>
+	#include <sys/mman.h>
+	#include <sys/uio.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <limits.h>
 #endif
 
 #ifdef _WIN64
+	#define ftruncate(x, y) _chsize_s(x, y)
 	#define fseeko _fseeki64
 	#define stat _stat64
 #elif _WIN32
+	#define ftruncate(x, y) _chsize_s(x, y)
 	#define fseeko _fseek
 #else
-	#define _mkdir(x) mkdir(x, 0600)
+	#define _mkdir(x) mkdir(x, 0755)
+	#define _rmdir(x) rmdir(x)
+	#define _S_IREAD S_IRUSR
+	#define _S_IWRITE S_IWUSR
 	inline bool fopen_s(FILE **f, const c8 *path, const c8 *perm) { return !(*f = fopen(path, perm)); }
 #endif
 
@@ -33,13 +48,131 @@
 
 namespace oic {
 
+	#ifndef _WIN32
+
+		//Regions that are close enough are read in one call, the gap is read into a scratch buffer
+
+		static constexpr FileSize maxRegionGap = 4_KiB;
+
+		//Transfer a run of buffers at the offset, continuing partial transfers
+
+		static bool transferRun(i32 fd, List<iovec> &run, FileSize offset, bool isWrite) {
+
+			usz first{};
+
+			while (first < run.size()) {
+
+				const i32 count = i32(std::min(run.size() - first, usz(IOV_MAX)));
+
+				const ssize_t transferred = isWrite ?
+					pwritev(fd, run.data() + first, count, off_t(offset)) :
+					preadv(fd, run.data() + first, count, off_t(offset));
+
+				if (transferred < 0 && errno == EINTR)
+					continue;
+
+				if (transferred <= 0)
+					return false;
+
+				offset += FileSize(transferred);
+
+				for (usz left = usz(transferred); left; ) {
+
+					iovec &v = run[first];
+
+					if (left < v.iov_len) {
+						v.iov_base = (u8*) v.iov_base + left;
+						v.iov_len -= left;
+						break;
+					}
+
+					left -= v.iov_len;
+					++first;
+				}
+			}
+
+			run.clear();
+			return true;
+		}
+
+		//Sort the regions and transfer the adjacent (or nearby for reads) ones together
+		//Reads have to be within the file size and writes can't leave holes; the size is grown by writes
+
+		static bool transferRegions(i32 fd, ListRef<const IoRegion> regions, bool isWrite, FileSize &fileSize) {
+
+			List<const IoRegion*> sorted;
+			sorted.reserve(regions.size());
+
+			for (const IoRegion &region : regions)
+				if (region.size)
+					sorted.push_back(&region);
+
+			std::sort(sorted.begin(), sorted.end(), [](const IoRegion *a, const IoRegion *b) { return a->offset < b->offset; });
+
+			for (const IoRegion *region : sorted) {
+
+				if (isWrite ? region->offset > fileSize : region->offset + region->size > fileSize) {
+					System::log()->fatal(isWrite ? "File write out of bounds" : "File read is out of bounds");
+					return false;
+				}
+
+				if (isWrite)
+					fileSize = std::max(fileSize, region->offset + region->size);
+			}
+
+			List<iovec> run;
+			FileSize runOffset{}, runEnd{};
+
+			u8 gap[maxRegionGap];
+
+			for (const IoRegion *region : sorted) {
+
+				const bool canMerge = !run.empty() && region->offset >= runEnd && (
+					region->offset == runEnd || (!isWrite && region->offset - runEnd <= maxRegionGap)
+				);
+
+				if (!canMerge) {
+
+					if (!run.empty() && !transferRun(fd, run, runOffset, isWrite))
+						return false;
+
+					runOffset = region->offset;
+				}
+
+				else if (region->offset != runEnd)
+					run.push_back(iovec{ gap, usz(region->offset - runEnd) });
+
+				run.push_back(iovec{ region->data, usz(region->size) });
+				runEnd = region->offset + region->size;
+			}
+
+			return run.empty() || transferRun(fd, run, runOffset, isWrite);
+		}
+
+	#endif
+
 	class CFile : public File {
 
 	private:
 
 		FILE *file{};
 
+		void *mapped{};
+		usz mappedSize{};
+
+		//If the file was opened for writing; only read-only files are mapped
+		bool writable{};
+
+		//The position of the file, so sequential reads don't have to seek
+		mutable FileSize cursor{ usz_MAX };
+
 		virtual ~CFile() { 
+
+			#ifndef _WIN32
+				if (mapped)
+					munmap(mapped, mappedSize);
+			#endif
+
 			fclose(file); 
 			file = nullptr;
 		}
@@ -50,8 +183,12 @@ namespace oic {
 		
 			const char *accessFlags = "rb";
 
-			if (f.hasAccess(FileAccess::WRITE))
-				accessFlags = "a+b";
+			//Writes are done in place, so the file isn't truncated or appended to
+
+			if (f.hasAccess(FileAccess::WRITE)) {
+				accessFlags = "r+b";
+				writable = true;
+			}
 
 			do {
 
@@ -81,45 +218,186 @@ namespace oic {
 				return false;
 			}
 
-			fseeko(file, offset, 0);
-			return fread(v, 1, size, file);
+			if (cursor != offset)
+				fseeko(file, offset, 0);
+
+			const usz count = fread(v, 1, size, file);
+			cursor = count == size ? offset + size : usz_MAX;
+			return count;
 		}
 
 		bool write(const void *v, FileSize size, FileSize offset) final override {
 
-			if (offset != usz_MAX && offset > f.fileSize) {
+			if (offset == usz_MAX)
+				offset = f.fileSize;
+
+			if (offset > f.fileSize) {
 				System::log()->fatal("File write out of bounds");
 				return false;
 			}
 
 			hasWritten = true;
+			cursor = usz_MAX;
+
+			#ifdef _WIN32
 
-			if(offset != usz_MAX)
 				fseeko(file, offset, 0);
 
-			return fwrite(v, 1, size, file);
+				if (fwrite(v, 1, size, file) != size)
+					return false;
+
+				f.fileSize = std::max(f.fileSize, offset + size);
+				return true;
+
+			#else
+				const IoRegion region{ offset, size, (void*) v };
+				return transferRegions(fileno(file), { &region, 1 }, true, f.fileSize);
+			#endif
 		}
 
+		#ifndef _WIN32
+
+			bool readv(ListRef<const IoRegion> regions) const final override {
+
+				//Positional reads don't move the file, so the cursor stays valid
+
+				FileSize size = f.fileSize;
+				return transferRegions(fileno(file), regions, false, size);
+			}
+
+			bool writev(ListRef<const IoRegion> regions) final override {
+
+				//Reads are buffered, so the next read has to seek to drop the old data
+
+				hasWritten = true;
+				cursor = usz_MAX;
+
+				return transferRegions(fileno(file), regions, true, f.fileSize);
+			}
+
+		#endif
+
 		bool resize(FileSize size) final override {
 
 			if (f.fileSize == size)
 				return true;
 
-			//Recreate file
+			fflush(file);
 
-			fclose(file);
-			::remove(f.path.c_str());
-			fopen_s(&file, f.path.c_str(), "wb");
+			if (ftruncate(fileno(file), i64(size)))
+				return false;
 
-			//Update file system size
+			hasWritten = true;
+			cursor = usz_MAX;
+			f.fileSize = size;
+			return true;
+		}
+
+		bool reserve(FileSize size) final override {
+
+			#ifdef __linux__
+				if (size > f.fileSize)
+					fallocate(fileno(file), FALLOC_FL_KEEP_SIZE, 0, off_t(size));
+			#else
+				(void) size;
+			#endif
 
-			f.fileSize = 0;
+			return true;
+		}
+
+		ListRef<const u8> map() final override {
+
+			#ifndef _WIN32
+
+				if (mapped)
+					return { (const u8*) mapped, mappedSize };
+
+				//Files that are opened for writing can change size, so those are copied instead
+
+				if (f.fileSize && !writable) {
+
+					void *ptr = mmap(nullptr, f.fileSize, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+
+					if (ptr != MAP_FAILED) {
+
+						//Only hints, so failure is allowed
+
+						madvise(ptr, f.fileSize, MADV_SEQUENTIAL);
+						madvise(ptr, f.fileSize, MADV_WILLNEED);
+
+						mapped = ptr;
+						mappedSize = f.fileSize;
+						return { (const u8*) mapped, mappedSize };
+					}
+				}
+
+			#endif
+
+			return File::map();
+		}
+	};
+
+	//Writable virtual files are stored in a MemoryFileStore (dataExt points to their node)
+	//The node stays alive while the file is open, even if the file is removed in the meantime
+
+	class MemoryFile : public File {
+
+	private:
+
+		MemoryFileStore &store;
+		MemoryFileStore::Node *node;
+
+		virtual ~MemoryFile() {
+			if (node)
+				store.release(node);
+		}
+
+	public:
+
+		MemoryFile(FileSystem *fs, const FileInfo &info, MemoryFileStore &store, MemoryFileStore::Node *node):
+			File(fs, info), store(store), node(node)
+		{
+			isOpen = node;
+
+			if (!isOpen)
+				System::log()->fatal("File can't be opened");
+
+			else f.fileSize = store.size(node);
+		}
+
+		bool read(void *v, FileSize size, FileSize offset) const final override {
+			return store.read(node, v, size, offset);
+		}
+
+		bool write(const void *v, FileSize size, FileSize offset) final override {
+
+			if (offset == usz_MAX)
+				offset = f.fileSize;
+
+			if (!store.write(node, v, size, offset))
+				return false;
+
+			hasWritten = true;
+			f.fileSize = std::max(f.fileSize, offset + size);
+			return true;
+		}
+
+		bool resize(FileSize size) final override {
+
+			if (f.fileSize == size)
+				return true;
+
+			if (!store.resize(node, size))
+				return false;
+
+			hasWritten = true;
+			f.fileSize = size;
 			return true;
 		}
 	};
 
 	LocalFileSystem::LocalFileSystem(String localPath): 
-		FileSystem(FileAccess::READ), localPath(localPath) {}
+		FileSystem(FileAccess::READ_WRITE), localPath(localPath) {}
 
 	const String &LocalFileSystem::getLocalPath() const {
 		return localPath;
@@ -132,9 +410,28 @@ namespace oic {
 			return nullptr;
 		}
 
-		if (!info.isLocal()) 
+		if (!info.isLocal() && !info.hasAccess(FileAccess::WRITE))
 			return openVirtual(info);
 
+		//The node is retained while the file system is locked, so it can't be removed in between
+
+		if (!info.isLocal()) {
+
+			const bool locked = lockShared();
+			const FileHandle handle = find(info.path);
+
+			MemoryFileStore::Node *node = 
+				handle == invalidFileHandle ? nullptr : (MemoryFileStore::Node*) virtualFiles.metadata(handle).dataExt;
+
+			if (node)
+				memoryFiles.retain(node);
+
+			if (locked)
+				unlockShared();
+
+			return new MemoryFile(this, info, memoryFiles, node);
+		}
+
 		return new CFile(this, info, timeout, retry);
 	}
 
@@ -185,15 +482,420 @@ namespace oic {
 		return true;
 	}
 
+	bool LocalFileSystem::writeTempLocal(const String &path, const u8 *address, FileSize size, String &temp) {
+
+		//Renaming is only atomic within the same folder, so the temporary file is created next to the file
+		//The name is unique, so writers of the same file don't share it
+
+		temp = path + ".XXXXXX";
+
+		FILE *f{};
+
+		#ifdef _WIN32
+
+			if (_mktemp_s(temp.data(), temp.size() + 1) || fopen_s(&f, temp.c_str(), "wbx")) {
+				System::log()->fatal("Couldn't create temporary file");
+				return false;
+			}
+
+		#else
+
+			const i32 fd = mkstemp(temp.data());
+
+			if (fd < 0) {
+				System::log()->fatal("Couldn't create temporary file");
+				return false;
+			}
+
+			//The temporary file is only accessible by the owner, so it gets the permissions of the file it replaces
+			//New files get the permissions fopen would give them
+
+			struct stat original;
+
+			if (::stat(path.c_str(), &original))
+				original.st_mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH;
+
+			if (fchmod(fd, original.st_mode & 07777) || !(f = fdopen(fd, "wb"))) {
+				::close(fd);
+				::remove(temp.c_str());
+				System::log()->fatal("Couldn't create temporary file");
+				return false;
+			}
+
+		#endif
+
+		bool success = fwrite(address, 1, size, f) == size && !fflush(f);
+
+		#ifdef _WIN32
+			success &= !_commit(fileno(f));
+		#else
+			success &= !fsync(fileno(f));
+		#endif
+
+		fclose(f);
+
+		if (!success) {
+			::remove(temp.c_str());
+			System::log()->fatal("Couldn't write temporary file");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool LocalFileSystem::replaceLocal(const String &path, const String &temp) {
+
+		std::error_code error;
+		std::filesystem::rename(temp, path, error);
+
+		if (error) {
+			::remove(temp.c_str());
+			System::log()->fatal("Couldn't replace local file");
+			return false;
+		}
+
+		//The rename itself has to reach the disk too
+
+		#ifndef _WIN32
+
+			const usz folderEnd = path.find_last_of('/');
+			const i32 folder = ::open(path.substr(0, folderEnd).c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (folder >= 0) {
+				fsync(folder);
+				::close(folder);
+			}
+
+		#endif
+
+		return true;
+	}
+
 	void LocalFileSystem::onFileChange(const FileInfo &file, FileChange change) {
 
-		if (change == FileChange::DEL)
+		if (file.isLocal())
 			return;
 
-		if (!file.isLocal()) {
-			onVirtualFileChange(file, change);
+		//Writable virtual files get their data when they're added and release it when they're removed
+		//Removes are sent before the file is erased, so the info only has the path
+
+		const FileHandle handle = find(file.path);
+
+		if (handle == invalidFileHandle) {
+
+			if (change != FileChange::DEL)
+				onVirtualFileChange(file, change);
+
 			return;
 		}
+
+		const VirtualFileTable::Node &entry = virtualFiles.node(handle);
+		VirtualFileTable::Metadata &metadata = virtualFiles.metadata(handle);
+
+		if (!entry.isFolder() && entry.hasAccess(FileAccess::WRITE)) {
+
+			MemoryFileStore::Node *node = (MemoryFileStore::Node*) metadata.dataExt;
+
+			if (change == FileChange::DEL) {
+
+				if (node)
+					memoryFiles.release(node);
+
+				metadata.dataExt = nullptr;
+				return;
+			}
+
+			if (!node)
+				metadata.dataExt = node = memoryFiles.create();
+
+			metadata.fileSize = memoryFiles.size(node);
+		}
+
+		if (change != FileChange::DEL)
+			onVirtualFileChange(virtualFiles[handle], change);
+	}
+
+	void LocalFileSystem::setMemoryFileBudget(FileSize budget) {
+		memoryFiles.setBudget(budget);
+	}
+
+	MemoryFileStats LocalFileSystem::getMemoryFileStats() const {
+		return memoryFiles.getStats();
+	}
+
+	bool LocalFileSystem::copyShared(const FileInfo &file, const String &path) {
+
+		if (file.isLocal() || !file.dataExt || !file.hasAccess(FileAccess::WRITE))
+			return false;
+
+		const FileHandle handle = find(path);
+
+		if (handle == invalidFileHandle)
+			return false;
+
+		const VirtualFileTable::Node &target = virtualFiles.node(handle);
+		void *dataExt = virtualFiles.metadata(handle).dataExt;
+
+		if (target.isFolder() || !dataExt || !target.hasAccess(FileAccess::WRITE))
+			return false;
+
+		return memoryFiles.copy((MemoryFileStore::Node*) dataExt, (MemoryFileStore::Node*) file.dataExt);
+	}
+
+	void LocalFileSystem::setMetadataCache(ns ttl) {
+
+		std::lock_guard<std::mutex> guard(metadataMutex);
+
+		metadataTtl = ttl;
+		++metadataEpoch;
+
+		if (!ttl)
+			metadata.clear();
+	}
+
+	MetadataCacheStats LocalFileSystem::getMetadataCacheStats() const {
+		std::lock_guard<std::mutex> guard(metadataMutex);
+		return metadataStats;
+	}
+
+	void LocalFileSystem::invalidate(const String &path, bool recursive) {
+
+		FileSystem::invalidate(path, recursive);
+		closeOpenFiles(path, recursive);
+
+		std::lock_guard<std::mutex> guard(metadataMutex);
+
+		++metadataEpoch;
+
+		if (metadata.empty())
+			return;
+
+		auto it = metadata.find(path);
+		bool isFolder = true;
+
+		if (it != metadata.end()) {
+			isFolder = it->second.exists && (u8(it->second.flags) & u8(FileFlags::IS_FOLDER));
+			metadata.erase(it);
+			++metadataStats.invalidations;
+		}
+
+		//Children can only be cached if the path isn't a file
+
+		if (!recursive || !isFolder)
+			return;
+
+		for (it = metadata.begin(); it != metadata.end(); ) {
+
+			const String &key = it->first;
+
+			if (key.size() > path.size() && key[path.size()] == '/' && key.starts_with(path)) {
+				it = metadata.erase(it);
+				++metadataStats.invalidations;
+			}
+
+			else ++it;
+		}
+	}
+
+	struct LocalFileSystem::OpenFile {
+
+		i32 fd;
+		FileSize size;
+
+		#ifndef _WIN32
+			~OpenFile() { ::close(fd); }
+		#endif
+	};
+
+	void LocalFileSystem::setFileCache(usz maxFiles) {
+
+		std::lock_guard<std::mutex> guard(openFileMutex);
+
+		maxOpenFiles = maxFiles;
+
+		while (openFiles.size() > maxOpenFiles) {
+			openFileLut.erase(openFiles.back().path);
+			openFiles.pop_back();
+		}
+	}
+
+	void LocalFileSystem::closeOpenFiles(const String &path, bool recursive) {
+
+		std::lock_guard<std::mutex> guard(openFileMutex);
+
+		if (openFiles.empty())
+			return;
+
+		auto it = openFileLut.find(path);
+
+		//Only files are cached, so the path can't have children if it's cached
+
+		if (it != openFileLut.end()) {
+			openFiles.erase(it->second);
+			openFileLut.erase(it);
+			return;
+		}
+
+		if (!recursive)
+			return;
+
+		for (auto file = openFiles.begin(); file != openFiles.end(); ) {
+
+			const String &key = file->path;
+
+			if (key.size() > path.size() && key[path.size()] == '/' && key.starts_with(path)) {
+				openFileLut.erase(key);
+				file = openFiles.erase(file);
+			}
+
+			else ++file;
+		}
+	}
+
+	bool LocalFileSystem::readCached(const String &path, ListRef<const IoRegion> regions, bool &success) {
+
+		#ifdef _WIN32
+			return false;
+		#else
+
+			if (path[0] != '.')
+				return false;
+
+			std::shared_ptr<OpenFile> file;
+
+			{
+				std::lock_guard<std::mutex> guard(openFileMutex);
+
+				if (!maxOpenFiles)
+					return false;
+
+				auto it = openFileLut.find(path);
+
+				if (it != openFileLut.end()) {
+					openFiles.splice(openFiles.begin(), openFiles, it->second);
+					file = openFiles.front().file;
+				}
+
+				else {
+
+					const i32 fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+					if (fd < 0)
+						return false;
+
+					struct stat v;
+
+					if (fstat(fd, &v) || !S_ISREG(v.st_mode)) {
+						::close(fd);
+						return false;
+					}
+
+					file = std::shared_ptr<OpenFile>(new OpenFile{ fd, FileSize(v.st_size) });
+
+					openFiles.push_front(CachedFile{ path, file });
+					openFileLut[path] = openFiles.begin();
+
+					if (openFiles.size() > maxOpenFiles) {
+						openFileLut.erase(openFiles.back().path);
+						openFiles.pop_back();
+					}
+				}
+			}
+
+			//The file stays open until this read is done, even if it's closed by the cache in the meantime
+
+			FileSize size = file->size;
+			success = transferRegions(file->fd, regions, false, size);
+			return true;
+
+		#endif
+	}
+
+	bool LocalFileSystem::prefetchLocal(const String &path, FileSize size, FileSize offset) {
+
+		#ifdef _WIN32
+			return false;
+		#else
+
+			const i32 fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0)
+				return false;
+
+			//Only starts the reads; the pages stay cached after the file is closed
+
+			const bool success = !posix_fadvise(fd, off_t(offset), off_t(size), POSIX_FADV_WILLNEED);
+			::close(fd);
+			return success;
+
+		#endif
+	}
+
+	bool LocalFileSystem::statLocal(const String &apath, CachedStat &result) const {
+
+		std::unique_lock<std::mutex> lock(metadataMutex);
+
+		const ns ttl = metadataTtl;
+		const ns now = ttl ? Timer::now() : 0;
+
+		if (ttl) {
+
+			auto it = metadata.find(apath);
+
+			if (it != metadata.end() && (it->second.isWatched || now - it->second.time < ttl)) {
+				++metadataStats.hits;
+				result = it->second;
+				return result.exists;
+			}
+
+			++metadataStats.misses;
+		}
+
+		//The file can change while it's queried; the result is outdated if it was invalidated in the meantime
+
+		const u64 epoch = metadataEpoch;
+		lock.unlock();
+
+		struct stat v;
+		result = {};
+		result.time = now;
+		result.exists = !stat(apath.c_str(), &v);
+
+		if (result.exists) {
+
+			const bool isFile = S_ISREG(v.st_mode);
+			u8 flags{};
+
+			if (!isFile)
+				flags |= u8(FileFlags::IS_FOLDER);
+
+			if (v.st_mode & _S_IREAD)
+				flags |= u8(FileFlags::READ);
+
+			if (v.st_mode & _S_IWRITE)
+				flags |= u8(FileFlags::WRITE);
+
+			result.modificationTime = v.st_mtime;
+			result.fileSize = isFile ? FileSize(v.st_size) : 0;
+			result.flags = FileFlags(flags);
+		}
+
+		//Files that don't exist are only cached if they're watched, since nothing else tells when they're created
+
+		if (ttl) {
+
+			result.isWatched = isWatched(apath);
+
+			if (result.exists || result.isWatched) {
+
+				lock.lock();
+
+				if (epoch == metadataEpoch)
+					metadata[apath] = result;
+			}
+		}
+
+		return result.exists;
 	}
 
 	const FileInfo LocalFileSystem::local(const String &path) const {
@@ -205,60 +907,37 @@ namespace oic {
 			return {};
 		}
 
-		struct stat v;
+		CachedStat v;
 
-		if (stat(path.c_str(), &v)) {
+		if (!statLocal(apath, v)) {
 			oic::System::log()->fatal("Local file not found");
 			return {};
 		}
 
-		const bool isFile = S_ISREG(v.st_mode);
-		u8 flags{};
-
-		if (!isFile)
-			flags |= u8(FileFlags::IS_FOLDER);
-
-		if (v.st_mode & _S_IREAD)
-			flags |= u8(FileFlags::READ);
-
-		if (v.st_mode & _S_IWRITE)
-			flags |= u8(FileFlags::WRITE);
-
 		return FileInfo {
-			path, path.substr(path.find_last_of('/') + 1),
-			v.st_mtime, nullptr,
-			isFile ? FileSize(v.st_size) : 0,
-			0, 0, 0, 0, FileFlags(flags)
+			apath, apath.substr(apath.find_last_of('/') + 1),
+			v.modificationTime, nullptr,
+			v.fileSize,
+			0, 0, 0, 0, v.flags
 		};
 	}
 
 	bool LocalFileSystem::hasLocal(const String &path) const {
 
 		String apath;
+		CachedStat v;
 
-		if (!resolvePath(path, apath))
-			return false;
-
-		struct stat v;
-
-		if (stat(path.c_str(), &v))
-			return false;
-
-		return true;
+		return resolvePath(path, apath) && statLocal(apath, v);
 	}
 
 	bool LocalFileSystem::hasLocalRegion(const String &path, FileSize size, FileSize offset) const {
 
 		String apath;
+		CachedStat v;
 
-		if (!resolvePath(path, apath))
-			return false;
-
-		struct stat v;
-
-		if (stat(path.c_str(), &v))
+		if (!resolvePath(path, apath) || !statLocal(apath, v))
 			return false;
 
-		return usz(offset) + size <= usz(v.st_size) * bool(S_ISREG(v.st_mode));
+		return usz(offset) + size <= usz(v.fileSize);
 	}
 }
\ No newline at end of file
@@ -0,0 +1,368 @@
+#include "system/memory_file_store.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+namespace oic {
+
+	struct MemoryFileStore::Node {
+
+		List<Chunk> chunks;
+		FileSize size{};
+		usz refs{ 1 };
+
+		std::list<Node*>::iterator it;
+
+		//The temporary file that has the spilled chunks (in order); those chunks are null until they're loaded back
+		String spillPath;
+		usz spilledChunks{};
+	};
+
+	MemoryFileStore::MemoryFileStore(FileSize budget): budget(budget) {}
+
+	MemoryFileStore::~MemoryFileStore() {
+
+		for (Node *node : nodes) {
+
+			if (!node->spillPath.empty())
+				::remove(node->spillPath.c_str());
+
+			delete node;
+		}
+	}
+
+	MemoryFileStore::Chunk MemoryFileStore::allocate() {
+
+		//Chunks are only referenced by nodes, so they're always released while the store is locked
+
+		stats.memory += chunkSize;
+		stats.maxMemory = std::max(stats.maxMemory, stats.memory);
+		++stats.chunks;
+
+		return Chunk(new u8[chunkSize](), [this](u8 *data) {
+			delete[] data;
+			stats.memory -= chunkSize;
+			--stats.chunks;
+		});
+	}
+
+	MemoryFileStore::Node *MemoryFileStore::create() {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		Node *node = new Node();
+		nodes.push_front(node);
+		node->it = nodes.begin();
+
+		++stats.files;
+		return node;
+	}
+
+	void MemoryFileStore::retain(Node *node) {
+		std::lock_guard<std::mutex> guard(mutex);
+		++node->refs;
+	}
+
+	void MemoryFileStore::release(Node *node) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (--node->refs)
+			return;
+
+		if (!node->spillPath.empty()) {
+			::remove(node->spillPath.c_str());
+			stats.spilledBytes -= node->spilledChunks * chunkSize;
+			--stats.spilledFiles;
+		}
+
+		nodes.erase(node->it);
+		--stats.files;
+		delete node;
+	}
+
+	bool MemoryFileStore::copy(Node *dst, Node *src) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (dst == src)
+			return true;
+
+		if (!touch(src))
+			return false;
+
+		//The old data of the destination is replaced, so it doesn't have to be loaded back
+
+		if (!dst->spillPath.empty()) {
+			::remove(dst->spillPath.c_str());
+			stats.spilledBytes -= dst->spilledChunks * chunkSize;
+			--stats.spilledFiles;
+			dst->spillPath.clear();
+			dst->spilledChunks = 0;
+		}
+
+		nodes.splice(nodes.begin(), nodes, dst->it);
+
+		//Only the chunk references are copied; chunks are copied once either file writes to them
+
+		dst->chunks = src->chunks;
+		dst->size = src->size;
+		return true;
+	}
+
+	FileSize MemoryFileStore::size(Node *node) const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return node->size;
+	}
+
+	bool MemoryFileStore::read(Node *node, void *v, FileSize size, FileSize offset) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (offset + size > node->size) {
+			System::log()->fatal("File read is out of bounds");
+			return false;
+		}
+
+		if (!touch(node))
+			return false;
+
+		for (u8 *dst = (u8*) v; size; ) {
+
+			const FileSize start = offset % chunkSize;
+			const FileSize count = std::min(size, chunkSize - start);
+
+			std::memcpy(dst, node->chunks[usz(offset / chunkSize)].get() + start, usz(count));
+
+			dst += count;
+			offset += count;
+			size -= count;
+		}
+
+		trim(node);
+		return true;
+	}
+
+	bool MemoryFileStore::write(Node *node, const void *v, FileSize size, FileSize offset) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (offset > node->size) {
+			System::log()->fatal("File write out of bounds");
+			return false;
+		}
+
+		if (!touch(node) || (offset + size > node->size && !resizeLocked(node, offset + size)))
+			return false;
+
+		for (const u8 *src = (const u8*) v; size; ) {
+
+			const FileSize start = offset % chunkSize;
+			const FileSize count = std::min(size, chunkSize - start);
+
+			Chunk &chunk = node->chunks[usz(offset / chunkSize)];
+
+			makeUnique(chunk);
+			std::memcpy(chunk.get() + start, src, usz(count));
+
+			src += count;
+			offset += count;
+			size -= count;
+		}
+
+		trim(node);
+		return true;
+	}
+
+	bool MemoryFileStore::resize(Node *node, FileSize size) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (!touch(node) || !resizeLocked(node, size))
+			return false;
+
+		trim(node);
+		return true;
+	}
+
+	bool MemoryFileStore::resizeLocked(Node *node, FileSize size) {
+
+		const usz count = usz((size + chunkSize - 1) / chunkSize);
+		const FileSize end = size % chunkSize;
+
+		//The end of the last chunk is cleared when it's cut off, so growing the file again reads zeros
+
+		if (size < node->size) {
+
+			node->chunks.resize(count);
+
+			if (end) {
+
+				Chunk &last = node->chunks.back();
+
+				makeUnique(last);
+				std::memset(last.get() + end, 0, usz(chunkSize - end));
+			}
+		}
+
+		//Only the chunk references can move, the data that's already written stays where it is
+
+		else {
+
+			node->chunks.reserve(count);
+
+			while (node->chunks.size() < count)
+				node->chunks.push_back(allocate());
+		}
+
+		node->size = size;
+		return true;
+	}
+
+	void MemoryFileStore::makeUnique(Chunk &chunk) {
+
+		if (chunk.use_count() == 1)
+			return;
+
+		Chunk copy = allocate();
+		std::memcpy(copy.get(), chunk.get(), usz(chunkSize));
+		chunk = std::move(copy);
+	}
+
+	bool MemoryFileStore::touch(Node *node) {
+
+		nodes.splice(nodes.begin(), nodes, node->it);
+
+		return node->spillPath.empty() || reload(node);
+	}
+
+	void MemoryFileStore::setBudget(FileSize newBudget) {
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		budget = newBudget;
+		trim(nullptr);
+	}
+
+	MemoryFileStats MemoryFileStore::getStats() const {
+		std::lock_guard<std::mutex> guard(mutex);
+		return stats;
+	}
+
+	void MemoryFileStore::trim(const Node *keep) {
+
+		if (!budget)
+			return;
+
+		//Shared chunks are only freed once every file that has them is spilled
+
+		for (auto it = nodes.rbegin(); it != nodes.rend() && stats.memory > budget; ++it)
+			if (*it != keep)
+				spill(*it);
+	}
+
+	bool MemoryFileStore::spill(Node *node) {
+
+		//Shared chunks would stay in memory anyway, so only the chunks that are unique to the file are spilled
+
+		if (!node->spillPath.empty())
+			return false;
+
+		const usz count = usz(std::count_if(node->chunks.begin(), node->chunks.end(), [](const Chunk &chunk) {
+			return chunk.use_count() == 1;
+		}));
+
+		if (!count)
+			return false;
+
+		std::error_code error;
+		const std::filesystem::path folder = std::filesystem::temp_directory_path(error);
+
+		if (error)
+			return false;
+
+		const String path = (
+			folder / ("oic_memory_" + std::to_string(uintptr_t(this)) + "_" + std::to_string(nextSpill++))
+		).string();
+
+		FILE *f = fopen(path.c_str(), "wb");
+
+		if (!f) {
+			System::log()->warn("Couldn't spill memory file to disk");
+			return false;
+		}
+
+		bool success = true;
+
+		for (const Chunk &chunk : node->chunks)
+			if (chunk.use_count() == 1 && success)
+				success = fwrite(chunk.get(), 1, usz(chunkSize), f) == chunkSize;
+
+		success &= !fclose(f);
+
+		if (!success) {
+			::remove(path.c_str());
+			System::log()->warn("Couldn't spill memory file to disk");
+			return false;
+		}
+
+		for (Chunk &chunk : node->chunks)
+			if (chunk.use_count() == 1)
+				chunk.reset();
+
+		node->spillPath = path;
+		node->spilledChunks = count;
+
+		stats.spilledBytes += count * chunkSize;
+		++stats.spilledFiles;
+		++stats.spills;
+		return true;
+	}
+
+	bool MemoryFileStore::reload(Node *node) {
+
+		FILE *f = fopen(node->spillPath.c_str(), "rb");
+
+		if (!f) {
+			System::log()->fatal("Spilled memory file is missing");
+			return false;
+		}
+
+		//Loaded into new chunks first, so a failed load leaves the file spilled
+
+		List<Chunk> chunks;
+		chunks.reserve(node->spilledChunks);
+
+		bool success = true;
+
+		for (usz i = 0; i < node->spilledChunks && success; ++i) {
+			chunks.push_back(allocate());
+			success = fread(chunks.back().get(), 1, usz(chunkSize), f) == chunkSize;
+		}
+
+		fclose(f);
+
+		if (!success) {
+			System::log()->fatal("Couldn't load spilled memory file");
+			return false;
+		}
+
+		usz i{};
+
+		for (Chunk &chunk : node->chunks)
+			if (!chunk)
+				chunk = std::move(chunks[i++]);
+
+		::remove(node->spillPath.c_str());
+		node->spillPath.clear();
+
+		stats.spilledBytes -= node->spilledChunks * chunkSize;
+		node->spilledChunks = 0;
+
+		--stats.spilledFiles;
+		++stats.reloads;
+		return true;
+	}
+
+}
@@ -0,0 +1,317 @@
+#include "system/overlay_file_system.hpp"
+#include <algorithm>
+
+namespace oic {
+
+	String OverlayFileSystem::Layer::toLayer(const String &path) const {
+		return path.size() == 1 ? root : root + path.substr(1);
+	}
+
+	bool OverlayFileSystem::Layer::fromLayer(StringView path, String &result) const {
+
+		if (path.size() < root.size() || path.substr(0, root.size()) != root)
+			return false;
+
+		if (path.size() == root.size()) {
+			result = "~";
+			return true;
+		}
+
+		if (path[root.size()] != '/')
+			return false;
+
+		result = "~";
+		result += path.substr(root.size());
+		return true;
+	}
+
+	OverlayFileSystem::OverlayFileSystem(): FileSystem(FileAccess::READ) {
+		initLut();
+	}
+
+	OverlayFileSystem::~OverlayFileSystem() {
+
+		stopPrefetch();
+
+		for (auto &layer : layers)
+			layer->source->removeFileChangeBatchCallback(onLayerChange, layer->root, layer.get());
+	}
+
+	usz OverlayFileSystem::mount(FileSystem *source, const String &root) {
+
+		String aroot;
+
+		if (!source->resolvePath(root, aroot) || !source->exists(aroot) || !source->get(aroot).isFolder()) {
+			System::log()->warn("Overlay layer has to be a folder: ", root);
+			return usz_MAX;
+		}
+
+		lock();
+
+		Layer *layer = layers.emplace_back(new Layer{ this, source, aroot }).get();
+		layer->isMounted = true;
+
+		const usz index = layers.size() - 1;
+
+		unlock();
+
+		//Watched before it's merged, so changes in between aren't lost
+
+		source->addFileChangeBatchCallback(onLayerChange, aroot, layer);
+
+		//Only the paths of the new layer can resolve differently
+
+		List<String> paths;
+
+		source->foreachFile(aroot, [](FileSystem*, const FileInfo &info, void *paths) {
+			((List<String>*) paths)->push_back(info.path);
+		}, true, &paths);
+
+		lock();
+
+		String path;
+
+		for (const String &lpath : paths)
+			if (layer->fromLayer(lpath, path))
+				resolve(path, false);
+
+		unlock();
+		return index;
+	}
+
+	bool OverlayFileSystem::unmount(usz i) {
+
+		if (i >= layers.size())
+			return false;
+
+		Layer *layer = layers[i].get();
+		layer->source->removeFileChangeBatchCallback(onLayerChange, layer->root, layer);
+
+		lock();
+		layer->isMounted = false;
+
+		//Only the paths that came from the layer can resolve differently
+
+		List<String> paths;
+		paths.reserve(layer->entries);
+
+		for (FileHandle handle = 0; handle < virtualFiles.size(); ++handle)
+			if (virtualFiles.metadata(handle).dataExt == layer)
+				paths.push_back(String(virtualFiles.path(handle)));
+
+		for (const String &path : paths)
+			resolve(path, false);
+
+		layers.erase(layers.begin() + i);
+		unlock();
+		return true;
+	}
+
+	List<OverlayLayerStats> OverlayFileSystem::getLayerStats() const {
+
+		FileSystemReadLock lock(this);
+		List<OverlayLayerStats> stats;
+		stats.reserve(layers.size());
+
+		for (auto &layer : layers)
+			stats.push_back(OverlayLayerStats{ layer->entries, layer->hits.load() });
+
+		return stats;
+	}
+
+	void OverlayFileSystem::resolve(const String &path, bool recursive, const Layer *removed) {
+
+		const bool isRoot = path.size() == 1;
+
+		//Later layers hide earlier layers
+
+		Layer *provider{};
+		FileInfo info;
+
+		for (auto it = layers.rbegin(); it != layers.rend(); ++it) {
+
+			Layer *layer = it->get();
+
+			if (!layer->isMounted || layer == removed)
+				continue;
+
+			//Locked, so the layer can't remove the file in between
+
+			const String lpath = layer->toLayer(path);
+			FileSystemReadLock sourceLock(layer->source);
+
+			if (layer->source->exists(lpath)) {
+				info = layer->source->get(lpath);
+				provider = layer;
+				break;
+			}
+		}
+
+		//A file that's gone or changed between file and folder is removed with its children
+
+		FileHandle handle = find(path);
+
+		if (
+			!isRoot && handle != invalidFileHandle &&
+			(!provider || virtualFiles.node(handle).isFolder() != info.isFolder())
+		) {
+			removeEntry(handle);
+			handle = invalidFileHandle;
+		}
+
+		if (!provider && !isRoot)
+			return;
+
+		const FileSize fileSize = info.isFolder() ? 0 : info.fileSize;
+
+		if (handle == invalidFileHandle) {
+
+			const usz slash = path.find_last_of('/');
+			const String parentPath = path.substr(0, slash);
+			const FileHandle parent = find(parentPath);
+
+			//The parent resolves its children when it's added
+
+			if (parent == invalidFileHandle) {
+				resolve(parentPath, true);
+				return;
+			}
+
+			if (!virtualFiles.node(parent).isFolder())
+				return;
+
+			insertVirtual(FileInfo{
+				path, path.substr(slash + 1),
+				info.modificationTime, provider, fileSize, parent, 0, 0, 0,
+				info.isFolder() ? FileFlags::VIRTUAL_FOLDER : FileFlags::VIRTUAL_FILE
+			});
+
+			++provider->entries;
+			add(path, info.isFolder(), true);
+
+			recursive = true;
+		}
+
+		else if (!isRoot) {
+
+			VirtualFileTable::Metadata &entry = virtualFiles.metadata(handle);
+
+			const bool changed =
+				entry.dataExt != provider || entry.modificationTime != info.modificationTime || entry.fileSize != fileSize;
+
+			if (entry.dataExt != provider) {
+				--((Layer*) entry.dataExt)->entries;
+				++provider->entries;
+				entry.dataExt = provider;
+			}
+
+			entry.modificationTime = info.modificationTime;
+			entry.fileSize = fileSize;
+
+			if (changed && !info.isFolder())
+				update(path);
+		}
+
+		if (!recursive || (!isRoot && !info.isFolder()))
+			return;
+
+		//The children of every layer that has the folder, and the current children (which might have to be removed)
+
+		List<String> names;
+
+		for (FileHandle child : getChildren(find(path)))
+			names.push_back(String(virtualFiles.name(child)));
+
+		for (auto &layer : layers) {
+
+			if (!layer->isMounted || layer.get() == removed)
+				continue;
+
+			const String lpath = layer->toLayer(path);
+			FileSystemReadLock sourceLock(layer->source);
+
+			if (!layer->source->exists(lpath) || !layer->source->get(lpath).isFolder())
+				continue;
+
+			layer->source->foreachFile(lpath, [](FileSystem*, const FileInfo &child, void *names) {
+				((List<String>*) names)->push_back(child.path.substr(child.path.find_last_of('/') + 1));
+			}, false, &names);
+		}
+
+		std::sort(names.begin(), names.end());
+		names.erase(std::unique(names.begin(), names.end()), names.end());
+
+		for (const String &name : names)
+			resolve(path + "/" + name, true, removed);
+	}
+
+	void OverlayFileSystem::removeEntry(FileHandle handle) {
+
+		//Copied, since removing the children modifies them
+
+		const List<FileHandle> children = getChildren(handle);
+
+		for (auto it = children.rbegin(); it != children.rend(); ++it)
+			removeEntry(*it);
+
+		remove(String(virtualFiles.path(handle)), true);
+
+		if (Layer *layer = (Layer*) virtualFiles.metadata(handle).dataExt)
+			--layer->entries;
+
+		eraseVirtual(handle);
+	}
+
+	void OverlayFileSystem::onLayerChange(FileSystem*, const List<FileChangeEvent> &changes, void *data) {
+
+		Layer *layer = (Layer*) data;
+		OverlayFileSystem *overlay = layer->overlay;
+
+		overlay->lock();
+
+		if (layer->isMounted) {
+
+			String path;
+
+			for (const FileChangeEvent &change : changes) {
+
+				//Updates don't change the children, but other changes could've replaced a whole folder
+				//Removes are sent before the file is removed, so the layer isn't checked for them
+
+				if (layer->fromLayer(change.info.path, path))
+					overlay->resolve(
+						path, change.change != FileChange::UPDATE, change.change == FileChange::DEL ? layer : nullptr
+					);
+
+				if (!change.oldPath.empty() && layer->fromLayer(change.oldPath, path))
+					overlay->resolve(path, true);
+			}
+		}
+
+		overlay->unlock();
+	}
+
+	File *OverlayFileSystem::open(const FileInfo &info, ns maxTimeout, ns retryTimeout) {
+
+		if (info.isFolder()) {
+			System::log()->fatal("Can't open a folder");
+			return nullptr;
+		}
+
+		if (!info.isVirtual() || !info.dataExt) {
+			System::log()->fatal("Overlays only have merged files");
+			return nullptr;
+		}
+
+		Layer *layer = (Layer*) info.dataExt;
+		++layer->hits;
+
+		return layer->source->open(layer->toLayer(info.path), FileFlags::READ, maxTimeout, retryTimeout);
+	}
+
+	const FileInfo OverlayFileSystem::local(const String&) const {
+		System::log()->fatal("Overlays don't have local files");
+		return {};
+	}
+
+}
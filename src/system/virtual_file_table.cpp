@@ -0,0 +1,185 @@
+#include "system/file_system.hpp"
+#include <cstring>
+
+namespace oic {
+
+	VirtualFileTable::VirtualFileTable(): lut(0, Hash{ this }, Equal{ this }) {}
+
+	void VirtualFileTable::reserve(usz files, usz pathBytes) {
+		nodes.reserve(files);
+		metadatas.reserve(files);
+		generations.reserve(files);
+		arena.reserve(pathBytes);
+		lut.reserve(files);
+	}
+
+	FileHandle VirtualFileTable::push(const FileInfo &info) {
+		const FileHandle handle = size();
+		insert(handle, info);
+		return handle;
+	}
+
+	FileHandle VirtualFileTable::pushUnique(const FileInfo &info) {
+
+		const FileHandle handle = size();
+		const usz pathOffset = arena.size();
+
+		nodes.push_back(Node{
+			append(info.path), u32(info.path.size()), u32(info.path.size() - info.path.find_last_of('/') - 1),
+			info.parent, info.folderHint, info.fileHint, info.fileEnd,
+			info.flags
+		});
+
+		if (lut.insert(handle).second) {
+			metadatas.push_back(Metadata{ info.modificationTime, info.dataExt, info.fileSize });
+			generations.push_back(0);
+			return handle;
+		}
+
+		nodes.pop_back();
+		arena.resize(pathOffset);
+		return invalidFileHandle;
+	}
+
+	void VirtualFileTable::insert(FileHandle handle, const FileInfo &info) {
+
+		if (handle == size()) {
+			nodes.push_back({});
+			metadatas.push_back({});
+			generations.push_back(0);
+		}
+
+		//The name is always the end of the path
+
+		const usz slash = info.path.find_last_of('/');
+		const usz nameLength = slash == String::npos ? info.path.size() : info.path.size() - slash - 1;
+
+		nodes[handle] = Node{
+			append(info.path), u32(info.path.size()), u32(nameLength),
+			info.parent, info.folderHint, info.fileHint, info.fileEnd,
+			info.flags
+		};
+
+		metadatas[handle] = Metadata{ info.modificationTime, info.dataExt, info.fileSize };
+
+		if (info.isVirtual())
+			lut.insert(handle);
+	}
+
+	void VirtualFileTable::erase(FileHandle handle) {
+
+		Node &n = nodes[handle];
+
+		if (n.isVirtual())
+			lut.erase(handle);
+
+		unusedBytes += n.pathLength;
+
+		n = {};
+		metadatas[handle] = {};
+		++generations[handle];
+
+		if (unusedBytes > arena.size() / 2)
+			compact();
+	}
+
+	void VirtualFileTable::rename(FileHandle handle, StringView path) {
+
+		Node &n = nodes[handle];
+
+		//The handle is hashed by its path, so it has to be removed before the path changes
+
+		const bool isVirtual = n.isVirtual();
+
+		if (isVirtual)
+			lut.erase(handle);
+
+		unusedBytes += n.pathLength;
+
+		const usz slash = path.find_last_of('/');
+
+		n.pathOffset = append(path);
+		n.pathLength = u32(path.size());
+		n.nameLength = u32(slash == StringView::npos ? path.size() : path.size() - slash - 1);
+
+		if (isVirtual)
+			lut.insert(handle);
+
+		if (unusedBytes > arena.size() / 2)
+			compact();
+	}
+
+	FileHandle VirtualFileTable::find(StringView path) const {
+		auto it = lut.find(path);
+		return it == lut.end() ? invalidFileHandle : *it;
+	}
+
+	void VirtualFileTable::get(FileHandle handle, FileInfo &info) const {
+
+		const Node &n = nodes[handle];
+		const Metadata &m = metadatas[handle];
+
+		//Resized and copied instead of assigned, since assign checks if the source overlaps the string
+
+		const StringView filePath = path(handle), fileName = name(handle);
+
+		info.path.resize(filePath.size());
+		std::memcpy(info.path.data(), filePath.data(), filePath.size());
+
+		info.name.resize(fileName.size());
+		std::memcpy(info.name.data(), fileName.data(), fileName.size());
+
+		info.modificationTime = m.modificationTime;
+		info.dataExt = m.dataExt;
+		info.fileSize = m.fileSize;
+
+		info.parent = n.parent;
+		info.folderHint = n.folderHint;
+		info.fileHint = n.fileHint;
+		info.fileEnd = n.fileEnd;
+		info.flags = n.flags;
+	}
+
+	usz VirtualFileTable::memoryUsage() const {
+
+		//Every element of the look up table is a node with the handle and its cached hash
+
+		return
+			nodes.capacity() * sizeof(Node) + metadatas.capacity() * sizeof(Metadata) + generations.capacity() * sizeof(u32) +
+			arena.capacity() +
+			lut.bucket_count() * sizeof(void*) + lut.size() * (sizeof(void*) + sizeof(usz) + sizeof(FileHandle));
+	}
+
+	u32 VirtualFileTable::append(StringView path) {
+
+		const usz offset = arena.size();
+
+		if (offset + path.size() > u32_MAX)
+			System::log()->fatal("Virtual file paths exceed the size of the path arena");
+
+		arena.append(path);
+		return u32(offset);
+	}
+
+	void VirtualFileTable::compact() {
+
+		//The paths stay the same, so the look up table doesn't have to be rebuilt
+
+		String compacted;
+		compacted.reserve(arena.size() - unusedBytes);
+
+		for (Node &n : nodes) {
+
+			if (!n.pathLength)
+				continue;
+
+			const usz offset = compacted.size();
+			compacted.append(arena.data() + n.pathOffset, n.pathLength);
+			n.pathOffset = u32(offset);
+		}
+
+		arena = std::move(compacted);
+		unusedBytes = 0;
+	}
+
+}
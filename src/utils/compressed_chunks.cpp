@@ -0,0 +1,165 @@
+#include "utils/compressed_chunks.hpp"
+#include "utils/lz4.hpp"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <thread>
+
+namespace oic {
+
+	//The seek table of valid data; only checks the bounds of the table itself
+
+	static bool getTable(ListRef<const u8> compressed, CompressedChunks::Header &header, usz &chunks, const u8 *&table, const u8 *&data) {
+
+		if (compressed.size() < sizeof(header))
+			return false;
+
+		std::memcpy(&header, compressed.begin(), sizeof(header));
+
+		if (header.magic != CompressedChunks::magic || !header.chunkSize)
+			return false;
+
+		chunks = usz((header.size + header.chunkSize - 1) / header.chunkSize);
+
+		if ((compressed.size() - sizeof(header)) / sizeof(u64) < chunks + 1)
+			return false;
+
+		table = compressed.begin() + sizeof(header);
+		data = table + (chunks + 1) * sizeof(u64);
+		return true;
+	}
+
+	List<u8> CompressedChunks::compress(ListRef<const u8> data, u32 chunkSize) {
+
+		const usz chunks = (data.size() + chunkSize - 1) / chunkSize;
+		const usz tableSize = sizeof(Header) + (chunks + 1) * sizeof(u64);
+
+		List<u8> result(tableSize);
+		result.reserve(tableSize + data.size());
+
+		const Header header{ magic, chunkSize, data.size() };
+		std::memcpy(result.data(), &header, sizeof(header));
+
+		List<u64> offsets(chunks + 1);
+		List<u8> block(chunkSize);
+
+		for (usz i = 0; i < chunks; ++i) {
+
+			const usz start = i * chunkSize, length = std::min(usz(chunkSize), data.size() - start);
+			const u8 *chunk = data.begin() + start;
+
+			//Only smaller blocks are stored, so uncompressed chunks can be detected by their size
+
+			const usz compressed = length > 1 ? Lz4::compress({ chunk, length }, { block.data(), length - 1 }) : 0;
+
+			if (compressed)
+				result.insert(result.end(), block.data(), block.data() + compressed);
+
+			else result.insert(result.end(), chunk, chunk + length);
+
+			offsets[i + 1] = result.size() - tableSize;
+		}
+
+		std::memcpy(result.data() + sizeof(Header), offsets.data(), offsets.size() * sizeof(u64));
+		return result;
+	}
+
+	u64 CompressedChunks::size(ListRef<const u8> compressed) {
+
+		Header header;
+		usz chunks;
+		const u8 *table, *data;
+
+		if (!getTable(compressed, header, chunks, table, data))
+			return 0;
+
+		return header.size;
+	}
+
+	bool CompressedChunks::read(ListRef<const u8> compressed, void *output, u64 size, u64 offset, usz threads) {
+
+		Header header;
+		usz chunks;
+		const u8 *table, *data;
+
+		if (!getTable(compressed, header, chunks, table, data) || offset + size > header.size)
+			return false;
+
+		if (!size)
+			return true;
+
+		const usz dataSize = usz(compressed.end() - data), chunkSize = header.chunkSize;
+		const usz first = usz(offset / chunkSize), last = usz((offset + size - 1) / chunkSize) + 1;
+
+		//Chunks that are fully read are decompressed in place, others through a scratch buffer
+
+		auto decompress = [=](usz begin, usz end) -> bool {
+
+			List<u8> scratch;
+
+			for (usz i = begin; i < end; ++i) {
+
+				u64 from, to;
+				std::memcpy(&from, table + i * sizeof(u64), sizeof(u64));
+				std::memcpy(&to, table + (i + 1) * sizeof(u64), sizeof(u64));
+
+				if (from > to || to > dataSize)
+					return false;
+
+				const u64 chunkStart = u64(i) * chunkSize;
+				const usz length = usz(std::min(u64(chunkSize), header.size - chunkStart));
+
+				const u64 start = std::max(offset, chunkStart), stop = std::min(offset + size, chunkStart + length);
+				u8 *dst = (u8*) output + (start - offset);
+
+				const ListRef<const u8> block = { data + from, usz(to - from) };
+
+				if (block.size() == length)
+					std::memcpy(dst, block.begin() + (start - chunkStart), usz(stop - start));
+
+				else if (start == chunkStart && stop == chunkStart + length) {
+					if (!Lz4::decompress(block, { dst, length }))
+						return false;
+				}
+
+				else {
+
+					scratch.resize(length);
+
+					if (!Lz4::decompress(block, { scratch.data(), length }))
+						return false;
+
+					std::memcpy(dst, scratch.data() + (start - chunkStart), usz(stop - start));
+				}
+			}
+
+			return true;
+		};
+
+		if (!threads)
+			threads = std::max(usz(std::thread::hardware_concurrency()), usz(1));
+
+		threads = std::min(threads, last - first);
+
+		if (threads <= 1)
+			return decompress(first, last);
+
+		//Every thread decompresses a contiguous range of chunks
+
+		const usz perThread = (last - first + threads - 1) / threads;
+
+		List<std::future<bool>> workers;
+		workers.reserve(threads - 1);
+
+		for (usz i = first + perThread; i < last; i += perThread)
+			workers.push_back(std::async(std::launch::async, decompress, i, std::min(i + perThread, last)));
+
+		bool success = decompress(first, std::min(first + perThread, last));
+
+		for (auto &worker : workers)
+			success &= worker.get();
+
+		return success;
+	}
+
+}
@@ -0,0 +1,397 @@
+#include "utils/inflate.hpp"
+#include <cstring>
+
+namespace oic {
+
+	static constexpr u16 lengthBase[] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+
+	static constexpr u8 lengthExtra[] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+
+	static constexpr u16 distanceBase[] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+	};
+
+	static constexpr u8 distanceExtra[] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+	};
+
+	static constexpr u8 codeLengthOrder[] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	static constexpr u32 maxBits = 15, fastBits = 9;
+
+	//Canonical huffman code; short codes are decoded with one lookup, longer codes bit by bit
+
+	struct Huffman {
+
+		u16 count[maxBits + 1];
+		u16 symbol[288];
+
+		//Symbol << 4 | length, 0 if the code is longer than fastBits
+		u16 fast[1 << fastBits];
+
+		bool build(const u8 *lengths, u32 n) {
+
+			std::memset(count, 0, sizeof(count));
+			std::memset(fast, 0, sizeof(fast));
+
+			for (u32 i = 0; i < n; ++i)
+				++count[lengths[i]];
+
+			if (count[0] == n)
+				return true;
+
+			//Over subscribed codes are invalid
+
+			i32 left = 1;
+
+			for (u32 len = 1; len <= maxBits; ++len) {
+
+				left = (left << 1) - count[len];
+
+				if (left < 0)
+					return false;
+			}
+
+			u16 offsets[maxBits + 1]{};
+
+			for (u32 len = 1; len < maxBits; ++len)
+				offsets[len + 1] = u16(offsets[len] + count[len]);
+
+			for (u32 i = 0; i < n; ++i)
+				if (lengths[i])
+					symbol[offsets[lengths[i]]++] = u16(i);
+
+			//Codes are stored msb first, but the stream is read lsb first
+
+			u32 code{}, index{};
+
+			for (u32 len = 1; len <= fastBits; ++len) {
+
+				for (u32 i = 0; i < count[len]; ++i, ++code, ++index) {
+
+					u32 reversed{};
+
+					for (u32 b = 0; b < len; ++b)
+						reversed |= ((code >> b) & 1) << (len - 1 - b);
+
+					for (u32 k = reversed; k < (1u << fastBits); k += 1u << len)
+						fast[k] = u16(symbol[index] << 4 | len);
+				}
+
+				code <<= 1;
+			}
+
+			return true;
+		}
+	};
+
+	struct InflateState {
+
+		const u8 *in;
+		usz inSize, inPos{};
+
+		u64 bitBuffer{};
+		u32 bitCount{};
+
+		u8 *out;
+		usz outSize, outPos{};
+
+		inline void refill() {
+			while (bitCount <= 56 && inPos < inSize) {
+				bitBuffer |= u64(in[inPos++]) << bitCount;
+				bitCount += 8;
+			}
+		}
+
+		inline bool bits(u32 n, u32 &value) {
+
+			if (bitCount < n) {
+
+				refill();
+
+				if (bitCount < n)
+					return false;
+			}
+
+			value = u32(bitBuffer & ((u64(1) << n) - 1));
+			bitBuffer >>= n;
+			bitCount -= n;
+			return true;
+		}
+
+		inline bool decode(const Huffman &h, u32 &value) {
+
+			if (bitCount < maxBits)
+				refill();
+
+			const u16 entry = h.fast[bitBuffer & ((1u << fastBits) - 1)];
+			const u32 length = entry & 0xF;
+
+			if (entry && length <= bitCount) {
+				value = entry >> 4;
+				bitBuffer >>= length;
+				bitCount -= length;
+				return true;
+			}
+
+			i32 code{}, first{}, index{};
+
+			for (u32 len = 1; len <= maxBits && len <= bitCount; ++len) {
+
+				code |= i32((bitBuffer >> (len - 1)) & 1);
+
+				const i32 count = h.count[len];
+
+				if (code - count < first) {
+					value = h.symbol[index + (code - first)];
+					bitBuffer >>= len;
+					bitCount -= len;
+					return true;
+				}
+
+				index += count;
+				first += count;
+				first <<= 1;
+				code <<= 1;
+			}
+
+			return false;
+		}
+
+		bool stored() {
+
+			//Stored blocks start at the next byte
+
+			bitBuffer >>= bitCount & 7;
+			bitCount &= ~7u;
+
+			u32 length, inverse;
+
+			if (!bits(16, length) || !bits(16, inverse) || length != (~inverse & 0xFFFF))
+				return false;
+
+			//Return the bytes that were read ahead
+
+			inPos -= bitCount / 8;
+			bitBuffer = 0;
+			bitCount = 0;
+
+			if (inSize - inPos < length || outSize - outPos < length)
+				return false;
+
+			std::memcpy(out + outPos, in + inPos, length);
+			inPos += length;
+			outPos += length;
+			return true;
+		}
+
+		bool codes(const Huffman &lengths, const Huffman &distances) {
+
+			while (true) {
+
+				u32 symbol;
+
+				if (!decode(lengths, symbol))
+					return false;
+
+				if (symbol < 256) {
+
+					if (outPos == outSize)
+						return false;
+
+					out[outPos++] = u8(symbol);
+					continue;
+				}
+
+				if (symbol == 256)
+					return true;
+
+				symbol -= 257;
+
+				if (symbol >= 29)
+					return false;
+
+				u32 extra, length, distance;
+
+				if (!bits(lengthExtra[symbol], extra))
+					return false;
+
+				length = lengthBase[symbol] + extra;
+
+				if (!decode(distances, symbol) || symbol >= 30 || !bits(distanceExtra[symbol], extra))
+					return false;
+
+				distance = distanceBase[symbol] + extra;
+
+				if (distance > outPos || outSize - outPos < length)
+					return false;
+
+				//Copies can overlap the bytes they produce
+
+				u8 *dst = out + outPos, *src = dst - distance;
+
+				if (distance >= length)
+					std::memcpy(dst, src, length);
+
+				else for (u32 i = 0; i < length; ++i)
+					dst[i] = src[i];
+
+				outPos += length;
+			}
+		}
+
+		bool fixed() {
+
+			static const Huffman *tables = []() {
+
+				static Huffman result[2];
+				u8 lengths[288];
+
+				u32 i = 0;
+
+				for (; i < 144; ++i) lengths[i] = 8;
+				for (; i < 256; ++i) lengths[i] = 9;
+				for (; i < 280; ++i) lengths[i] = 7;
+				for (; i < 288; ++i) lengths[i] = 8;
+
+				result[0].build(lengths, 288);
+
+				for (i = 0; i < 30; ++i) lengths[i] = 5;
+
+				result[1].build(lengths, 30);
+				return result;
+			}();
+
+			return codes(tables[0], tables[1]);
+		}
+
+		bool dynamic() {
+
+			u32 literals, distances, codeLengths;
+
+			if (!bits(5, literals) || !bits(5, distances) || !bits(4, codeLengths))
+				return false;
+
+			literals += 257;
+			distances += 1;
+			codeLengths += 4;
+
+			if (literals > 286 || distances > 30)
+				return false;
+
+			u8 lengths[286 + 30]{};
+
+			for (u32 i = 0; i < codeLengths; ++i) {
+
+				u32 length;
+
+				if (!bits(3, length))
+					return false;
+
+				lengths[codeLengthOrder[i]] = u8(length);
+			}
+
+			Huffman codeLengthCode, lengthCode, distanceCode;
+
+			if (!codeLengthCode.build(lengths, 19))
+				return false;
+
+			//Code lengths of both codes are run length encoded together
+
+			for (u32 i = 0; i < literals + distances; ) {
+
+				u32 symbol;
+
+				if (!decode(codeLengthCode, symbol))
+					return false;
+
+				if (symbol < 16) {
+					lengths[i++] = u8(symbol);
+					continue;
+				}
+
+				u8 repeated{};
+				u32 count;
+
+				if (symbol == 16) {
+
+					if (!i || !bits(2, count))
+						return false;
+
+					repeated = lengths[i - 1];
+					count += 3;
+				}
+
+				else if (symbol == 17) {
+
+					if (!bits(3, count))
+						return false;
+
+					count += 3;
+				}
+
+				else {
+
+					if (!bits(7, count))
+						return false;
+
+					count += 11;
+				}
+
+				if (i + count > literals + distances)
+					return false;
+
+				std::memset(lengths + i, repeated, count);
+				i += count;
+			}
+
+			//The end of block code has to exist
+
+			if (!lengths[256])
+				return false;
+
+			if (!lengthCode.build(lengths, literals) || !distanceCode.build(lengths + literals, distances))
+				return false;
+
+			return codes(lengthCode, distanceCode);
+		}
+	};
+
+	bool Inflate::decompress(ListRef<const u8> input, ListRef<u8> output) {
+
+		InflateState state{ input.begin(), input.size(), 0, 0, 0, output.begin(), output.size() };
+
+		u32 last{};
+
+		while (!last) {
+
+			u32 type;
+
+			if (!state.bits(1, last) || !state.bits(2, type))
+				return false;
+
+			bool success;
+
+			switch (type) {
+				case 0:		success = state.stored();	break;
+				case 1:		success = state.fixed();	break;
+				case 2:		success = state.dynamic();	break;
+				default:	return false;
+			}
+
+			if (!success)
+				return false;
+		}
+
+		return state.outPos == state.outSize;
+	}
+
+}
@@ -0,0 +1,230 @@
+#include "utils/lz4.hpp"
+#include <bit>
+#include <cstring>
+
+namespace oic {
+
+	//The last match has to start 12 bytes before the end and the last 5 bytes are always literals
+
+	static constexpr usz minMatch = 4, matchStartLimit = 12, lastLiterals = 5, maxOffset = 0xFFFF;
+	static constexpr u32 hashBits = 12;
+
+	static inline u32 read32(const u8 *ptr) {
+		u32 v;
+		std::memcpy(&v, ptr, sizeof(v));
+		return v;
+	}
+
+	static inline u64 read64(const u8 *ptr) {
+		u64 v;
+		std::memcpy(&v, ptr, sizeof(v));
+		return v;
+	}
+
+	static inline u32 hash(u32 sequence) {
+		return (sequence * 2654435761u) >> (32 - hashBits);
+	}
+
+	//Lengths of 15 and above are continued in bytes of up to 255
+
+	static inline u8 *writeLength(u8 *op, usz length) {
+
+		for (; length >= 255; length -= 255)
+			*op++ = 255;
+
+		*op++ = u8(length);
+		return op;
+	}
+
+	static inline bool readLength(const u8 *&ip, const u8 *ipEnd, usz &length) {
+
+		u8 b;
+
+		do {
+
+			if (ip == ipEnd)
+				return false;
+
+			b = *ip++;
+			length += b;
+
+		} while (b == 255);
+
+		return true;
+	}
+
+	//Writes literals and a match (or only literals if it's the last sequence)
+
+	static inline bool writeSequence(
+		u8 *&op, const u8 *opEnd, const u8 *literals, usz literalLength, usz offset, usz matchLength
+	) {
+
+		const usz worstCase = 1 + literalLength / 255 + 1 + literalLength + 2 + matchLength / 255 + 1;
+
+		if (usz(opEnd - op) < worstCase)
+			return false;
+
+		const usz matchToken = matchLength ? matchLength - minMatch : 0;
+		u8 *token = op++;
+
+		*token = u8((literalLength < 15 ? literalLength : 15) << 4);
+
+		if (literalLength >= 15)
+			op = writeLength(op, literalLength - 15);
+
+		std::memcpy(op, literals, literalLength);
+		op += literalLength;
+
+		if (!matchLength)
+			return true;
+
+		*op++ = u8(offset);
+		*op++ = u8(offset >> 8);
+
+		*token |= u8(matchToken < 15 ? matchToken : 15);
+
+		if (matchToken >= 15)
+			op = writeLength(op, matchToken - 15);
+
+		return true;
+	}
+
+	usz Lz4::compress(ListRef<const u8> input, ListRef<u8> output) {
+
+		const u8 *in = input.begin();
+		const usz n = input.size();
+
+		u8 *op = output.begin();
+		const u8 *opEnd = output.end();
+
+		usz anchor{};
+
+		if (n > matchStartLimit) {
+
+			u32 table[1 << hashBits]{};
+
+			const usz limit = n - matchStartLimit, matchLimit = n - lastLiterals;
+
+			for (usz i = 0; i < limit; ) {
+
+				const u32 sequence = read32(in + i);
+				const u32 h = hash(sequence);
+
+				usz candidate = table[h];
+				table[h] = u32(i);
+
+				//Data that doesn't match is skipped faster the longer it doesn't match
+
+				if (candidate >= i || i - candidate > maxOffset || read32(in + candidate) != sequence) {
+					i += 1 + ((i - anchor) >> 6);
+					continue;
+				}
+
+				while (i > anchor && candidate && in[i - 1] == in[candidate - 1]) {
+					--i;
+					--candidate;
+				}
+
+				//Matches are extended a word at a time (little endian, so the first difference is the lowest bit)
+
+				usz length = minMatch;
+
+				for (; i + length + sizeof(u64) <= matchLimit; length += sizeof(u64)) {
+
+					const u64 difference = read64(in + i + length) ^ read64(in + candidate + length);
+
+					if (difference) {
+						length += usz(std::countr_zero(difference)) / 8;
+						break;
+					}
+				}
+
+				while (i + length < matchLimit && in[i + length] == in[candidate + length])
+					++length;
+
+				if (!writeSequence(op, opEnd, in + anchor, i - anchor, i - candidate, length))
+					return 0;
+
+				i += length;
+				anchor = i;
+			}
+		}
+
+		if (!writeSequence(op, opEnd, in + anchor, n - anchor, 0, 0))
+			return 0;
+
+		return usz(op - output.begin());
+	}
+
+	bool Lz4::decompress(ListRef<const u8> input, ListRef<u8> output) {
+
+		const u8 *ip = input.begin(), *ipEnd = input.end();
+		u8 *op = output.begin(), *opEnd = output.end();
+
+		while (ip != ipEnd) {
+
+			const u8 token = *ip++;
+
+			usz literals = token >> 4;
+
+			if (literals == 15 && !readLength(ip, ipEnd, literals))
+				return false;
+
+			//Short literals are copied as one block if both buffers have room for it
+
+			if (literals <= 16 && ipEnd - ip >= 16 && opEnd - op >= 16)
+				std::memcpy(op, ip, 16);
+
+			else if (usz(ipEnd - ip) < literals || usz(opEnd - op) < literals)
+				return false;
+
+			else std::memcpy(op, ip, literals);
+
+			ip += literals;
+			op += literals;
+
+			//The last sequence doesn't have a match
+
+			if (ip == ipEnd)
+				break;
+
+			if (ipEnd - ip < 2)
+				return false;
+
+			const usz offset = usz(ip[0]) | usz(ip[1]) << 8;
+			ip += 2;
+
+			usz length = token & 0xF;
+
+			if (length == 15 && !readLength(ip, ipEnd, length))
+				return false;
+
+			length += minMatch;
+
+			if (!offset || offset > usz(op - output.begin()) || usz(opEnd - op) < length)
+				return false;
+
+			//Matches can overlap the bytes they produce; far enough apart, they can be copied in blocks
+			//Blocks can write past the match if there's room, since those bytes are overwritten later
+
+			const u8 *src = op - offset;
+			const usz room = usz(opEnd - op);
+
+			if (offset >= 16 && room >= length + 16)
+				for (usz i = 0; i < length; i += 16)
+					std::memcpy(op + i, src + i, 16);
+
+			else if (offset >= 8 && room >= length + 8)
+				for (usz i = 0; i < length; i += 8)
+					std::memcpy(op + i, src + i, 8);
+
+			else for (usz i = 0; i < length; ++i)
+				op[i] = src[i];
+
+			op += length;
+		}
+
+		return op == opEnd;
+	}
+
+}
@@ -0,0 +1,2272 @@
+#include "system/file_system.hpp"
+#include "utils/timer.hpp"
+#include "utils/compressed_chunks.hpp"
+#include "system/overlay_file_system.hpp"
+#include "system/file_prefetcher.hpp"
+#include "system/memory_file_store.hpp"
+#include "system/async_file_io.hpp"
+#include "system/archive_file_system.hpp"
+#include "system/file_stream.hpp"
+
+#ifdef _WIN32
+	#include "system/windows_file_system.hpp"
+	using PlatformFileSystem = oic::WFileSystem;
+#else
+	#include "system/linux_file_system.hpp"
+	using PlatformFileSystem = oic::LFileSystem;
+#endif
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <ctime>
+#include <exception>
+#include <future>
+#include <new>
+#include <random>
+#include <stdexcept>
+
+using namespace oic;
+
+//Every heap allocation is counted, so lookups can be checked to not allocate
+//The size is stored in front of the allocation, so the memory in use is known too (e.g. to check a stream's windows)
+
+static constexpr usz allocationHeader = 16;
+static std::atomic<usz> allocations{}, allocatedMemory{};
+
+void *operator new(std::size_t size) {
+
+	allocations.fetch_add(1, std::memory_order_relaxed);
+
+	if (u8 *ptr = (u8*) std::malloc(size + allocationHeader)) {
+		*(usz*) ptr = size;
+		allocatedMemory.fetch_add(size, std::memory_order_relaxed);
+		return ptr + allocationHeader;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+
+	if (!ptr)
+		return;
+
+	u8 *start = (u8*) ptr - allocationHeader;
+	allocatedMemory.fetch_sub(*(usz*) start, std::memory_order_relaxed);
+	std::free(start);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+
+//The other forms have to use the same header, since they can be freed by each other (and sanitizers replace them too)
+
+void *operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try { return operator new(size); }
+	catch (...) { return nullptr; }
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void *ptr, const std::nothrow_t&) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, const std::nothrow_t&) noexcept { operator delete(ptr); }
+
+#ifndef _WIN32
+
+//Linux doesn't have a System yet, so the benchmark has a minimal one that prints to the console
+//Fatal errors throw like they do on Windows, so a failed check fails the benchmark
+
+namespace oic {
+
+	System *System::system = nullptr;
+
+	class BenchmarkLog : public Log {
+
+	public:
+
+		void print(LogLevel level, const String &str) final override {
+
+			fputs(str.c_str(), level >= LogLevel::WARN ? stderr : stdout);
+
+			if (level == LogLevel::FATAL)
+				throw std::runtime_error(str);
+		}
+
+		StackTrace captureStackTrace(usz) final override { return {}; }
+		void printStackTrace(const StackTrace&) final override {}
+	};
+
+	class BenchmarkSystem : public System {
+
+	public:
+
+		BenchmarkSystem(): System(nullptr, nullptr, nullptr, new BenchmarkLog()) {}
+		~BenchmarkSystem() { delete nativeLog; }
+
+	protected:
+
+		void sleep(ns time) final override { std::this_thread::sleep_for(std::chrono::nanoseconds(time)); }
+	};
+}
+
+#endif
+
+//!A file system that only has a writable virtual tree
+//Used to benchmark the virtual file table without touching the disk
+class BenchFileSystem : public FileSystem {
+
+public:
+
+	BenchFileSystem(): FileSystem(FileAccess::READ_WRITE) { initLut(); }
+
+	File *open(const FileInfo&, ns, ns) override { return nullptr; }
+
+	const FileInfo local(const String&) const override { return {}; }
+	bool hasLocal(const String&) const final override { return false; }
+	bool hasLocalRegion(const String&, FileSize, FileSize) const final override { return false; }
+
+	List<String> localDirectories(const String&) const final override { return {}; }
+	List<String> localFileObjects(const String&) const override { return {}; }
+	List<String> localFiles(const String&) const final override { return {}; }
+
+protected:
+
+	bool makeLocal(const String&, bool) final override { return false; }
+	bool delLocal(const String&) final override { return false; }
+	bool writeTempLocal(const String&, const u8*, FileSize, String&) final override { return false; }
+	bool replaceLocal(const String&, const String&) final override { return false; }
+
+	void initFiles() final override {}
+	void startFileWatcher(const String&) final override {}
+	void endFileWatcher(const String&) final override {}
+
+};
+
+//A file system where every read waits like cold storage would
+
+class SlowFileSystem : public BenchFileSystem {
+
+	class SlowFile : public File {
+
+	public:
+
+		SlowFile(FileSystem *fs, const FileInfo &info): File(fs, info) {}
+
+		bool read(void *v, FileSize size, FileSize) const final override {
+			std::this_thread::sleep_for(std::chrono::nanoseconds(latency));
+			std::memset(v, 0x55, size);
+			return true;
+		}
+
+		bool write(const void*, FileSize, FileSize) final override { return false; }
+		bool resize(FileSize) final override { return false; }
+	};
+
+public:
+
+	static constexpr ns latency = 200_mus;
+
+	~SlowFileSystem() { stopPrefetch(); }
+
+	void addFile(const String &path, FileSize size) {
+		add(path, false);
+		virtualFiles.metadata(find(path)).fileSize = size;
+	}
+
+	File *open(const FileInfo &info, ns, ns) final override {
+		return info.isFolder() ? nullptr : new SlowFile(this, info);
+	}
+};
+
+//The virtual files like they were stored before the tree; one list where the children of a folder are contiguous
+//Every add or remove shifts the list, renumbers the hints and parents of every entry and the lookup of the shifted ones
+
+class FlatVirtualTable {
+
+public:
+
+	FlatVirtualTable() {
+		entries.push_back(Entry{ "~", 0, 1, 1, 1 });
+		lut["~"] = 0;
+	}
+
+	void add(const String &path, bool isFolder) {
+
+		if (lut.find(path) != lut.end())
+			return;
+
+		const String parentPath = path.substr(0, path.find_last_of('/'));
+
+		if (lut.find(parentPath) == lut.end())
+			add(parentPath, true);
+
+		const FileHandle parent = lut[parentPath];
+		const FileHandle handle = isFolder ? entries[parent].fileHint : entries[parent].fileEnd;
+
+		//Every folder whose children come after the new entry moves
+
+		for (FileHandle i = 0; i < FileHandle(entries.size()); ++i) {
+
+			Entry &entry = entries[i];
+
+			if (i != parent && entry.folderHint >= handle) {
+				++entry.folderHint;
+				++entry.fileHint;
+				++entry.fileEnd;
+			}
+
+			entry.parent += FileHandle(entry.parent >= handle);
+		}
+
+		entries[parent].fileHint += FileHandle(isFolder);
+		++entries[parent].fileEnd;
+
+		//The children of a new folder are stored after every other entry
+
+		const FileHandle end = FileHandle(entries.size() + 1);
+		entries.insert(entries.begin() + handle, Entry{ path, parent, end, end, end });
+
+		for (FileHandle i = handle; i < FileHandle(entries.size()); ++i)
+			lut[entries[i].path] = i;
+	}
+
+	//Only for files and empty folders
+	void remove(const String &path) {
+
+		const auto it = lut.find(path);
+		const FileHandle handle = it->second;
+
+		Entry &parent = entries[entries[handle].parent];
+		parent.fileHint -= FileHandle(handle < parent.fileHint);
+		--parent.fileEnd;
+
+		lut.erase(it);
+		entries.erase(entries.begin() + handle);
+
+		//The children of the parent start at or before the removed entry, so only the folders after it move
+
+		for (FileHandle i = 0; i < FileHandle(entries.size()); ++i) {
+
+			Entry &entry = entries[i];
+
+			if (entry.folderHint > handle) {
+				--entry.folderHint;
+				--entry.fileHint;
+				--entry.fileEnd;
+			}
+
+			entry.parent -= FileHandle(entry.parent > handle);
+
+			if (i >= handle)
+				lut[entry.path] = i;
+		}
+	}
+
+	inline usz size() const { return entries.size(); }
+
+private:
+
+	struct Entry {
+		String path;
+		FileHandle parent, folderHint, fileHint, fileEnd;
+	};
+
+	List<Entry> entries;
+	PathMap<FileHandle> lut;
+};
+
+//Adds and removes 100k virtual files spread over 100 folders
+//The list the virtual files were stored in before is only timed with 10k files, since every change walks all entries
+
+static void benchmarkVirtualAddRemove() {
+
+	static constexpr usz folders = 100, filesPerFolder = 1000, flatFilesPerFolder = 100;
+
+	auto run = [](auto &fs, usz files, usz &entries) {
+
+		List<String> paths;
+		paths.reserve(folders * files);
+
+		for (usz i = 0; i < folders; ++i)
+			for (usz j = 0; j < files; ++j)
+				paths.push_back(Log::concat("~/bench/", i, "/", j, ".bin"));
+
+		ns start = Timer::now();
+
+		for (const String &path : paths)
+			fs.add(path, false);
+
+		const ns addTime = Timer::getElapsed(start);
+		entries = fs.size();
+
+		start = Timer::now();
+
+		for (auto it = paths.rbegin(); it != paths.rend(); ++it)
+			fs.remove(*it);
+
+		return Pair<ns, ns>{ addTime, Timer::getElapsed(start) };
+	};
+
+	//Sized like the flat table, so both can be run through the same function
+
+	struct TreeTable : BenchFileSystem {
+		inline usz size() const { return virtualSize(); }
+	};
+
+	usz entries{}, flatEntries{}, smallEntries{};
+
+	TreeTable tree, smallTree;
+	FlatVirtualTable flat;
+
+	const Pair<ns, ns> treeTime = run(tree, filesPerFolder, entries);
+	const Pair<ns, ns> smallTreeTime = run(smallTree, flatFilesPerFolder, smallEntries);
+	const Pair<ns, ns> flatTime = run(flat, flatFilesPerFolder, flatEntries);
+
+	if (tree.size() != 1 + 1 + folders || flat.size() != 1 + 1 + folders || smallEntries != flatEntries)
+		System::log()->fatal("Virtual add benchmark didn't add or remove every file");
+
+	System::log()->performance(
+		"Virtual add: ", folders * filesPerFolder, " files (", entries, " entries) in ", treeTime.first / 1_ms, "ms; ",
+		"remove in ", treeTime.second / 1_ms, "ms"
+	);
+
+	System::log()->performance(
+		"Virtual add of ", folders * flatFilesPerFolder, " files (", flatEntries, " entries): ",
+		"before (flat list) ", flatTime.first / 1_ms, "ms, remove ", flatTime.second / 1_ms, "ms; ",
+		"after (tree) ", smallTreeTime.first / 1_mus, "us, remove ", smallTreeTime.second / 1_mus, "us"
+	);
+}
+
+//Lookups from 1 to 32 threads while a watcher keeps modifying the file system
+//Exclusive readers lock the file system like every access did before shared locks existed
+//Shared readers can't starve the watcher, so it has to get at least a batch in every 32ms
+
+static void benchmarkContention(bool exclusiveReaders) {
+
+	static constexpr usz files = 10000, lookupsPerCheck = 64;
+	static constexpr ns duration = 200_ms, minBatchInterval = 32_ms;
+
+	BenchFileSystem fs;
+
+	List<String> paths;
+	paths.reserve(files);
+
+	for (usz i = 0; i < files; ++i) {
+		paths.push_back(Log::concat("~/contention/", i % 100, "/", i, ".bin"));
+		fs.add(paths.back(), false);
+	}
+
+	for (usz threads = 1; threads <= 32; threads <<= 1) {
+
+		std::atomic<bool> running = true;
+		std::atomic<usz> lookups = 0, changes = 0;
+		ns maxWait{};
+
+		//Watcher; applies a batch of changes every millisecond
+
+		auto watcher = std::async(std::launch::async, [&]() {
+
+			for (usz i = 0; running; ++i) {
+
+				{
+					const ns start = Timer::now();
+					FileSystemWriteLock lock(&fs);
+					maxWait = std::max(maxWait, Timer::getElapsed(start));
+
+					for (usz j = 0; j < 8; ++j) {
+						const String path = Log::concat("~/contention/watched/", i, "_", j, ".bin");
+						fs.add(path, false);
+						fs.remove(path);
+					}
+				}
+
+				changes += 16;
+				System::wait(1_ms);
+			}
+		});
+
+		List<std::future<void>> readers;
+		readers.reserve(threads);
+
+		for (usz t = 0; t < threads; ++t)
+			readers.push_back(std::async(std::launch::async, [&, t]() {
+
+				usz i = t * 7919, count{};
+				const ns start = Timer::now();
+
+				auto lookup = [&fs](const String &path) {
+					if (!fs.exists(path) || fs.get(path).fileSize)
+						System::log()->fatal("Contention benchmark lookup failed");
+				};
+
+				while (Timer::getElapsed(start) < duration) {
+
+					for (usz j = 0; j < lookupsPerCheck; ++j, ++i) {
+
+						const String &path = paths[i % files];
+
+						if (exclusiveReaders) {
+							FileSystemWriteLock lock(&fs);
+							lookup(path);
+						}
+
+						else {
+							FileSystemReadLock lock(&fs);
+							lookup(path);
+						}
+					}
+
+					count += lookupsPerCheck;
+				}
+
+				lookups += count;
+			}));
+
+		//The watcher is stopped before a failed reader is reported, otherwise it would never be joined
+
+		std::exception_ptr error;
+
+		for (auto &reader : readers)
+			try {
+				reader.get();
+			} catch (...) {
+				if (!error)
+					error = std::current_exception();
+			}
+
+		running = false;
+		watcher.get();
+
+		if (error)
+			std::rethrow_exception(error);
+
+		System::log()->performance(
+			exclusiveReaders ? "Exclusive" : "Shared", " lookups with ", threads, " threads: ",
+			lookups * 1_s / duration / 1000, "k/s (", changes.load(), " watcher changes, ",
+			maxWait / 1_mus, "us max watcher wait)"
+		);
+
+		if (!exclusiveReaders && changes < duration / minBatchInterval * 16)
+			System::log()->fatal("Contention benchmark watcher was starved by the readers");
+	}
+}
+
+//Decompression of 64 MiB of text-like data stored as compressed chunks (like add_virtual_files COMPRESS)
+//Full reads with 1 thread and all threads, then random 4 KiB reads that only decompress 1 or 2 chunks
+
+static void benchmarkDecompression() {
+
+	static constexpr usz size = 64_MiB, randomReads = 10000, randomSize = 4_KiB;
+
+	static constexpr const c8 *words[] = {
+		"file", "system", "virtual", "folder", "path", "watch", "callback", "read", "write", "chunk",
+		"the", "of", "and", "to", "in", "is", "that", "for", "it", "with"
+	};
+
+	std::mt19937 random(42);
+
+	List<u8> data;
+	data.reserve(size + 16);
+
+	while (data.size() < size) {
+
+		const c8 *word = words[random() % std::size(words)];
+		data.insert(data.end(), word, word + std::strlen(word));
+
+		data.push_back(random() % 12 ? ' ' : '\n');
+	}
+
+	data.resize(size);
+
+	ns start = Timer::now();
+	const List<u8> compressed = CompressedChunks::compress({ data.data(), data.size() });
+	const ns compressTime = Timer::getElapsed(start);
+
+	List<u8> output(size);
+
+	for (usz threads : { usz(1), usz(0) }) {
+
+		start = Timer::now();
+
+		if (!CompressedChunks::read({ compressed.data(), compressed.size() }, output.data(), size, 0, threads) || output != data)
+			System::log()->fatal("Decompression benchmark read failed");
+
+		const ns readTime = Timer::getElapsed(start);
+
+		System::log()->performance(
+			"Decompress ", size / 1_MiB, " MiB to ", compressed.size() / 1_KiB, " KiB (compressed in ",
+			compressTime / 1_ms, "ms) with ", threads ? "1 thread" : "all threads", ": ",
+			readTime / 1_ms, "ms (", size * 1_s / (readTime ? readTime : 1) / 1_MiB, " MiB/s)"
+		);
+	}
+
+	start = Timer::now();
+
+	for (usz i = 0; i < randomReads; ++i) {
+
+		const usz offset = random() % (size - randomSize);
+
+		if (!CompressedChunks::read({ compressed.data(), compressed.size() }, output.data(), randomSize, offset))
+			System::log()->fatal("Decompression benchmark read failed");
+	}
+
+	const ns randomTime = Timer::getElapsed(start);
+
+	System::log()->performance(
+		"Decompress ", randomReads, " random ", randomSize / 1_KiB, " KiB reads: ",
+		randomTime / 1_ms, "ms (", randomTime / randomReads / 1_mus, "us per read)"
+	);
+}
+
+//Saves of 1000 files like an editor does it (temporary file, writes, move onto the file, attribute update)
+//With a change window, every save is coalesced into a single change that's delivered in one batch
+
+static void benchmarkChangeBursts() {
+
+	static constexpr usz files = 1000;
+
+	for (ns window : { ns(0), ns(5_ms) }) {
+
+		BenchFileSystem fs;
+		usz counts[2]{};
+
+		fs.add("~/bench", true);
+
+		fs.addFileChangeBatchCallback(
+			[](FileSystem*, const List<FileChangeEvent> &events, void *data) {
+				usz *counts = (usz*) data;
+				++counts[0];
+				counts[1] += events.size();
+			},
+			"~/bench", counts
+		);
+
+		fs.setChangeWindow(window);
+
+		ns start = Timer::now();
+
+		for (usz i = 0; i < files; ++i) {
+
+			const String path = Log::concat("~/bench/", i, ".txt"), temp = path + "~";
+
+			fs.add(temp, false);
+			fs.update(temp);
+			fs.update(temp);
+			fs.mov(temp, path);
+			fs.update(path);
+		}
+
+		fs.flushChanges();
+
+		const ns time = Timer::getElapsed(start);
+
+		System::log()->performance(
+			"Change bursts of ", files, " saves with a ", window / 1_ms, "ms window: ",
+			counts[0], " callbacks with ", counts[1], " changes in ", time / 1_ms, "ms"
+		);
+	}
+}
+
+//Lookups of 100k paths in an overlay of 4 layers (every layer patches a quarter of the files of the layer below),
+//compared to checking every layer for every lookup
+
+static void benchmarkOverlay() {
+
+	static constexpr usz layerCount = 4, folders = 100, filesPerFolder = 1000;
+
+	List<std::unique_ptr<BenchFileSystem>> layers;
+	List<String> paths;
+
+	for (usz i = 0; i < folders; ++i)
+		for (usz j = 0; j < filesPerFolder; ++j)
+			paths.push_back(Log::concat("~/data/", i, "/", j, ".bin"));
+
+	for (usz l = 0; l < layerCount; ++l) {
+
+		BenchFileSystem *layer = layers.emplace_back(new BenchFileSystem()).get();
+
+		for (usz i = 0; i < paths.size(); i += usz(1) << (2 * l))
+			layer->add(paths[i], false);
+	}
+
+	OverlayFileSystem overlay;
+
+	ns start = Timer::now();
+
+	for (auto &layer : layers)
+		overlay.mount(layer.get());
+
+	const ns mountTime = Timer::getElapsed(start);
+
+	usz found{};
+	start = Timer::now();
+
+	for (const String &path : paths)
+		found += overlay.find(path) != invalidFileHandle;
+
+	const ns overlayTime = Timer::getElapsed(start);
+
+	start = Timer::now();
+
+	for (const String &path : paths)
+		for (auto it = layers.rbegin(); it != layers.rend(); ++it)
+			if ((*it)->exists(path)) {
+				(*it)->get(path);
+				break;
+			}
+
+	const ns probeTime = Timer::getElapsed(start);
+
+	//Opens are counted as hits of the layer the file is resolved to
+
+	for (const String &path : paths)
+		overlay.view(path);
+
+	//A change to a layer only resolves the changed path again
+
+	start = Timer::now();
+
+	layers.back()->add("~/data/0/new.bin", false);
+	layers.back()->remove(paths[0]);
+
+	const ns changeTime = Timer::getElapsed(start);
+
+	if (
+		found != paths.size() || !overlay.exists("~/data/0/new.bin") ||
+		overlay.get(paths[0]).dataExt != overlay.get(paths[16]).dataExt
+	)
+		System::log()->fatal("Overlay benchmark resolved the wrong files");
+
+	System::log()->performance(
+		"Overlay of ", layerCount, " layers mounted in ", mountTime / 1_ms, "ms; ",
+		paths.size(), " lookups in ", overlayTime / 1_ms, "ms (checking every layer: ", probeTime / 1_ms, "ms); ",
+		"2 layer changes in ", changeTime / 1_mus, "us"
+	);
+
+	const List<OverlayLayerStats> stats = overlay.getLayerStats();
+
+	for (usz l = 0; l < stats.size(); ++l)
+		System::log()->performance("Overlay layer ", l, ": ", stats[l].entries, " entries, ", stats[l].hits, " hits");
+}
+
+//Startup that reads 2000 files in order and processes each of them for about as long as a read takes
+//The first run records the reads, the next one prefetches them from the manifest while processing
+
+static void benchmarkPrefetch() {
+
+	static constexpr usz files = 2000, fileSize = 16_KiB;
+
+	SlowFileSystem fs;
+	List<String> paths;
+
+	for (usz i = 0; i < files; ++i) {
+		paths.push_back(Log::concat("~/assets/", i % 20, "/", i, ".bin"));
+		fs.addFile(paths.back(), fileSize);
+	}
+
+	List<u8> data(fileSize);
+	volatile u64 checksum{};
+
+	auto startup = [&]() {
+
+		const ns start = Timer::now();
+
+		for (const String &path : paths) {
+
+			if (!fs.read(path, data.data(), fileSize, 0))
+				System::log()->fatal("Prefetch benchmark read failed");
+
+			const ns processed = Timer::now() + SlowFileSystem::latency;
+
+			while (Timer::now() < processed)
+				checksum = checksum + data[checksum % fileSize];
+		}
+
+		return Timer::getElapsed(start);
+	};
+
+	fs.startAccessTrace();
+	const ns coldTime = startup();
+	const List<FileAccessRecord> manifest = fs.stopAccessTrace();
+
+	fs.startPrefetch(manifest, 4_MiB);
+	const ns prefetchTime = startup();
+	const PrefetchStats stats = fs.getPrefetchStats();
+	fs.stopPrefetch();
+
+	System::log()->performance(
+		"Startup of ", files, " reads: ", coldTime / 1_ms, "ms without a manifest, ",
+		prefetchTime / 1_ms, "ms with a manifest of ", manifest.size(), " reads (",
+		stats.hits, " hits, ", stats.misses, " misses, ", stats.skipped, " skipped, ",
+		stats.maxCachedBytes / 1_KiB, " KiB max cached)"
+	);
+
+	//Reading a region that isn't in the manifest doesn't stop the other regions of the file from being prefetched
+	//The budget only fits one region, so the second one is read after the first is taken
+
+	PlatformFileSystem memory;
+
+	const String partial = "~/prefetch/partial.bin", changed = "~/prefetch/changed.bin";
+	List<u8> contents(fileSize * 3), result(fileSize);
+
+	for (usz i = 0; i < contents.size(); ++i)
+		contents[i] = u8(i * 7 + (i >> 10));
+
+	if (
+		!memory.add(partial, false) || !memory.write(partial, contents.data(), contents.size(), 0) ||
+		!memory.add(changed, false) || !memory.write(changed, contents.data(), fileSize, 0)
+	)
+		System::log()->fatal("Prefetch benchmark couldn't write its memory files");
+
+	auto waitPrefetched = [&memory](usz count) {
+
+		const ns end = Timer::now() + 1_s;
+
+		while (memory.getPrefetchStats().prefetched < count && Timer::now() < end)
+			std::this_thread::yield();
+
+		if (memory.getPrefetchStats().prefetched < count)
+			System::log()->fatal("Prefetch benchmark didn't prefetch region ", count);
+	};
+
+	auto check = [&](const String &path, FileSize offset, const u8 *expected, const c8 *what) {
+		if (!memory.read(path, result.data(), fileSize, offset) || std::memcmp(result.data(), expected, fileSize))
+			System::log()->fatal("Prefetch benchmark read the wrong data ", what);
+	};
+
+	memory.startPrefetch({ { partial, 0, fileSize }, { partial, fileSize, fileSize } }, fileSize);
+
+	waitPrefetched(1);
+	check(partial, fileSize * 2, contents.data() + fileSize * 2, "outside of the manifest");
+	check(partial, 0, contents.data(), "from the first region");
+
+	waitPrefetched(2);
+	check(partial, fileSize, contents.data() + fileSize, "from the second region");
+
+	const PrefetchStats partialStats = memory.getPrefetchStats();
+
+	//A file that's written after it's prefetched is read again
+
+	memory.startPrefetch({ { changed, 0, fileSize } }, fileSize);
+	waitPrefetched(1);
+
+	if (!memory.write(changed, contents.data() + fileSize, fileSize, 0))
+		System::log()->fatal("Prefetch benchmark couldn't change its memory file");
+
+	check(changed, 0, contents.data() + fileSize, "after the file changed");
+
+	const PrefetchStats changedStats = memory.getPrefetchStats();
+	memory.stopPrefetch();
+
+	if (partialStats.hits != 2 || partialStats.misses != 1 || changedStats.hits || changedStats.cachedBytes)
+		System::log()->fatal("Prefetch benchmark used the cache for regions that weren't prefetched or that changed");
+}
+
+//Memory of the virtual file table per entry, and traversing / looking up the entries
+
+static void benchmarkVirtualTable() {
+
+	static constexpr usz folders = 1000, files = 200, runs = 10;
+
+	BenchFileSystem fs;
+
+	for (usz i = 0; i < folders; ++i)
+		for (usz j = 0; j < files; ++j)
+			fs.add("~/assets/folder_" + std::to_string(i) + "/texture_file_" + std::to_string(j) + ".png", false);
+
+	const usz entries = fs.virtualSize();
+	const usz memory = fs.getVirtualFiles().memoryUsage();
+
+	ns traversalTime = 1_s, lookupTime = 1_s;
+	usz visited{}, found{};
+
+	for (usz k = 0; k < runs; ++k) {
+
+		ns start = Timer::now();
+		visited = 0;
+
+		fs.foreachFile("~", [](FileSystem*, const FileInfo &info, void *visited) {
+			*(usz*)visited += usz(!info.name.empty());
+		}, true, &visited);
+
+		traversalTime = std::min(traversalTime, Timer::getElapsed(start));
+
+		start = Timer::now();
+		found = 0;
+
+		for (usz i = 0; i < folders; i += 7)
+			for (usz j = 0; j < files; j += 3)
+				found += fs.exists("~/assets/folder_" + std::to_string(i) + "/texture_file_" + std::to_string(j) + ".png");
+
+		lookupTime = std::min(lookupTime, Timer::getElapsed(start));
+	}
+
+	if (visited + 1 != entries)
+		System::log()->fatal("Traversal didn't visit every file");
+
+	//Lookups of normalized paths don't allocate; the info is copied into one that already fits the longest path
+
+	List<String> paths;
+
+	for (usz i = 0; i < folders; i += 7)
+		paths.push_back("~/assets/folder_" + std::to_string(i) + "/texture_file_" + std::to_string(files - 1) + ".png");
+
+	FileInfo info;
+	fs.getVirtualFiles().get(fs.find(paths.back()), info);
+
+	const usz allocationsBefore = allocations.load();
+
+	for (const String &path : paths) {
+
+		const FileHandle handle = fs.find(path);
+
+		if (handle == invalidFileHandle || !fs.exists(path) || !fs.isValid(fs.getId(path)) || fs.regionExists(path, 1, 0))
+			System::log()->fatal("Virtual table lookup failed");
+
+		fs.getVirtualFiles().get(handle, info);
+	}
+
+	const usz lookupAllocations = allocations.load() - allocationsBefore;
+
+	if (lookupAllocations)
+		System::log()->fatal("Virtual table lookups allocated ", lookupAllocations, " times");
+
+	System::log()->performance(
+		"Virtual table of ", entries, " entries: ", memory / entries, " bytes per entry; ",
+		"traversal in ", traversalTime / 1_mus, "us, ", found, " lookups in ", lookupTime / 1_mus, "us; ",
+		paths.size(), " lookups of normalized paths without allocating"
+	);
+}
+
+//Appends to a chunked file vs a contiguous buffer, copies that share chunks and spilling beyond the budget
+
+static void benchmarkMemoryFiles() {
+
+	static constexpr FileSize fileSize = 64_MiB, writeSize = 4_KiB;
+	static constexpr usz copies = 64;
+
+	List<u8> block(writeSize, 0x55);
+
+	ns start = Timer::now();
+	Buffer contiguous;
+
+	for (FileSize i = 0; i < fileSize; i += writeSize)
+		contiguous.insert(contiguous.end(), block.begin(), block.end());
+
+	const ns contiguousTime = Timer::getElapsed(start);
+
+	MemoryFileStore store;
+	MemoryFileStore::Node *file = store.create();
+
+	start = Timer::now();
+
+	for (FileSize i = 0; i < fileSize; i += writeSize)
+		store.write(file, block.data(), writeSize, i);
+
+	const ns chunkedTime = Timer::getElapsed(start);
+
+	//Copies only share the chunks; a write only copies the chunk it touches
+
+	List<MemoryFileStore::Node*> nodes;
+
+	start = Timer::now();
+
+	for (usz i = 0; i < copies; ++i) {
+		nodes.push_back(store.create());
+		store.copy(nodes.back(), file);
+		store.write(nodes.back(), block.data(), writeSize, i * writeSize);
+	}
+
+	const ns copyTime = Timer::getElapsed(start);
+	const MemoryFileStats shared = store.getStats();
+
+	if (shared.memory != fileSize + copies * MemoryFileStore::chunkSize)
+		System::log()->fatal("Copies didn't share their chunks");
+
+	//Every copy has its own chunk now, so spilling them frees a chunk each; the original stays in memory
+
+	store.write(file, block.data(), writeSize, 0);
+
+	start = Timer::now();
+	store.setBudget(fileSize);
+	const ns spillTime = Timer::getElapsed(start);
+
+	const MemoryFileStats spilled = store.getStats();
+
+	Buffer result(writeSize);
+	start = Timer::now();
+
+	for (MemoryFileStore::Node *node : nodes)
+		store.read(node, result.data(), writeSize, 0);
+
+	const ns reloadTime = Timer::getElapsed(start);
+
+	if (std::memcmp(result.data(), block.data(), writeSize))
+		System::log()->fatal("Reloaded memory file is corrupt");
+
+	for (MemoryFileStore::Node *node : nodes)
+		store.release(node);
+
+	store.release(file);
+
+	System::log()->performance(
+		"Appending ", fileSize / 1_MiB, " MiB in ", writeSize / 1_KiB, " KiB writes: ",
+		contiguousTime / 1_mus, "us contiguous, ", chunkedTime / 1_mus, "us chunked; ",
+		copies, " copies with a write each: ", copyTime / 1_mus, "us, ",
+		shared.memory / 1_MiB, " MiB in memory (", shared.maxMemory / 1_MiB, " MiB max)"
+	);
+
+	System::log()->performance(
+		"Budget of ", fileSize / 1_MiB, " MiB: ", spilled.spills, " spills in ", spillTime / 1_mus, "us, ",
+		spilled.memory / 1_MiB, " MiB in memory, ", spilled.spilledBytes / 1_MiB, " MiB on disk; ",
+		nodes.size(), " reads in ", reloadTime / 1_mus, "us (", store.getStats().reloads, " reloads)"
+	);
+
+	//A written memory file that's removed while it's open can still be closed
+
+	PlatformFileSystem fs;
+	fs.add("~/memory.bin", false);
+
+	File *open = fs.open("~/memory.bin", FileFlags::READ_WRITE);
+
+	if (!open || !open->write(block.data(), writeSize, 0))
+		System::log()->fatal("Memory file benchmark couldn't write its file");
+
+	fs.remove("~/memory.bin");
+	fs.close(open);
+}
+
+static void benchmarkBatchImport() {
+
+	static constexpr usz files = 50000;
+
+	BenchFileSystem fs;
+
+	struct Counter {
+		usz calls, changes;
+	} counter{};
+
+	fs.addFileChangeBatchCallback([](FileSystem*, const List<FileChangeEvent> &changes, void *data) {
+		Counter &c = *(Counter*)data;
+		++c.calls;
+		c.changes += changes.size();
+	}, "~/import", &counter);
+
+	//All files in one folder, like an asset folder that's reloaded
+
+	List<String> paths;
+	paths.reserve(files);
+
+	for (usz i = 0; i < files; ++i)
+		paths.push_back(Log::concat("~/import/", i, ".bin"));
+
+	//One call per file; removed in the order they were added
+
+	ns start = Timer::now();
+
+	for (const String &path : paths)
+		fs.add(path, false);
+
+	const ns addTime = Timer::getElapsed(start);
+	const usz addCalls = counter.calls;
+
+	start = Timer::now();
+
+	for (const String &path : paths)
+		fs.remove(path);
+
+	const ns removeTime = Timer::getElapsed(start);
+
+	//The same changes in one batch each
+
+	counter = {};
+
+	FileSystem::Batch batch(&fs);
+	start = Timer::now();
+
+	for (const String &path : paths)
+		batch.add(path, false);
+
+	if (!batch.apply())
+		System::log()->fatal("Couldn't apply batch");
+
+	const ns batchAddTime = Timer::getElapsed(start);
+	const usz entries = fs.virtualSize();
+
+	start = Timer::now();
+
+	for (const String &path : paths)
+		batch.remove(path);
+
+	if (!batch.apply())
+		System::log()->fatal("Couldn't apply batch");
+
+	const ns batchRemoveTime = Timer::getElapsed(start);
+
+	System::log()->performance(
+		"Import: ", files, " files; add in ", addTime / 1_ms, "ms (", addCalls, " callbacks), remove in ", removeTime / 1_ms, "ms; ",
+		"batch add in ", batchAddTime / 1_ms, "ms (", entries, " entries), batch remove in ", batchRemoveTime / 1_ms, "ms ",
+		"(", counter.calls, " callbacks for ", counter.changes, " changes)"
+	);
+}
+
+//Looks up files by id instead of path, while other files are added and removed
+
+static void benchmarkFileIds() {
+
+	static constexpr usz files = 20000, runs = 10;
+
+	BenchFileSystem fs;
+
+	List<String> paths;
+	paths.reserve(files);
+
+	for (usz i = 0; i < files; ++i)
+		paths.push_back(Log::concat("~/assets/folder_", i % 100, "/texture_file_", i, ".png"));
+
+	FileSystem::Batch batch(&fs);
+
+	for (const String &path : paths)
+		batch.add(path, false);
+
+	batch.apply();
+
+	List<FileId> ids;
+	ids.reserve(files);
+
+	for (const String &path : paths)
+		ids.push_back(fs.getId(path));
+
+	//Ids stay valid while other files come and go
+
+	for (usz i = 0; i < files; i += 2)
+		batch.add(Log::concat("~/assets/folder_", i % 100, "/other_", i, ".png"), false);
+
+	batch.apply();
+
+	for (usz i = 0; i < files; i += 2)
+		batch.remove(Log::concat("~/assets/folder_", i % 100, "/other_", i, ".png"));
+
+	batch.apply();
+
+	ns pathTime = 1_s, idTime = 1_s;
+	FileSize total{};
+
+	for (usz k = 0; k < runs; ++k) {
+
+		ns start = Timer::now();
+
+		for (const String &path : paths)
+			total += fs.get(path).name.size();
+
+		pathTime = std::min(pathTime, Timer::getElapsed(start));
+		start = Timer::now();
+
+		for (FileId id : ids)
+			total -= fs.get(id).name.size();
+
+		idTime = std::min(idTime, Timer::getElapsed(start));
+	}
+
+	if (total)
+		System::log()->fatal("Files by id don't match the files by path");
+
+	//The slots of removed files are reused, but the old ids stay invalid
+
+	for (usz i = 0; i < files; i += 2)
+		batch.remove(paths[i]);
+
+	batch.apply();
+
+	for (usz i = 0; i < files; i += 2)
+		batch.add(Log::concat("~/assets/folder_", i % 100, "/new_", i, ".png"), false);
+
+	batch.apply();
+
+	usz valid{};
+
+	for (FileId id : ids)
+		valid += fs.isValid(id);
+
+	if (valid != files / 2)
+		System::log()->fatal("Removed files still have valid ids");
+
+	System::log()->performance(
+		"File ids: ", files, " files by path in ", pathTime / 1_mus, "us, by id in ", idTime / 1_mus, "us; ",
+		valid, " ids valid after removing half"
+	);
+}
+
+//Moves folders between folders; the time should only depend on the size of the moved folders
+
+static void benchmarkFolderMoves() {
+
+	static constexpr usz folders = 500, files = 200, moved = 100;
+
+	BenchFileSystem fs;
+	FileSystem::Batch batch(&fs);
+
+	for (usz i = 0; i < folders; ++i)
+		for (usz j = 0; j < files; ++j)
+			batch.add(Log::concat("~/assets/folder_", i, "/texture_file_", j, ".png"), false);
+
+	batch.add("~/archive", true);
+	batch.apply();
+
+	const usz entries = fs.virtualSize();
+
+	ns start = Timer::now();
+
+	for (usz i = 0; i < moved; ++i)
+		fs.mov(Log::concat("~/assets/folder_", i), Log::concat("~/archive/folder_", i));
+
+	const ns moveTime = Timer::getElapsed(start);
+
+	start = Timer::now();
+
+	for (usz i = 0; i < moved; ++i)
+		batch.mov(Log::concat("~/archive/folder_", i), Log::concat("~/assets/folder_", i));
+
+	batch.apply();
+
+	const ns batchTime = Timer::getElapsed(start);
+
+	if (!fs.exists(Log::concat("~/assets/folder_0/texture_file_", files - 1, ".png")) || fs.exists("~/archive/folder_0"))
+		System::log()->fatal("Moved folders are missing their children");
+
+	//A file that's moved away and back in one batch is still listed once
+
+	batch.mov("~/assets/folder_0/texture_file_0.png", "~/archive/texture_file_0.png");
+	batch.mov("~/archive/texture_file_0.png", "~/assets/folder_0/texture_file_0.png");
+	batch.apply();
+
+	if (fs.get("~/assets/folder_0").getFiles() != files || fs.get("~/archive").getFiles())
+		System::log()->fatal("Folder moves benchmark listed a moved file twice");
+
+	System::log()->performance(
+		"Folder moves: ", moved, " folders of ", files, " files (", entries, " entries) in ", moveTime / 1_mus, "us; ",
+		"moved back in one batch in ", batchTime / 1_mus, "us"
+	);
+}
+
+//Finds shaders next to a million other files, with a query and by matching every file
+
+static void benchmarkQuery() {
+
+	static constexpr usz folders = 1000, files = 1000, shaderFolders = 10, shaders = 20, runs = 10;
+
+	BenchFileSystem fs;
+	FileSystem::Batch batch(&fs);
+
+	for (usz i = 0; i < folders; ++i)
+		for (usz j = 0; j < files; ++j)
+			batch.add(Log::concat("~/assets/folder_", i, "/texture_file_", j, ".png"), false);
+
+	for (usz i = 0; i < shaderFolders; ++i)
+		for (usz j = 0; j < shaders; ++j) {
+			batch.add(Log::concat("~/shaders/pass_", i, "/shader_", j, ".frag"), false);
+			batch.add(Log::concat("~/shaders/pass_", i, "/shader_", j, ".vert"), false);
+		}
+
+	batch.apply();
+
+	const usz entries = fs.virtualSize();
+
+	ns queryTime = 1_s, wildcardTime = 1_s, matchTime = 1_s;
+	usz found{}, wildcardFound{};
+
+	struct Search {
+		usz found;
+	} search{};
+
+	for (usz k = 0; k < runs; ++k) {
+
+		ns start = Timer::now();
+		found = fs.query("~/shaders/**/*.frag").size();
+		queryTime = std::min(queryTime, Timer::getElapsed(start));
+
+		//Without a literal prefix, every folder is entered, but only the names in them are matched
+
+		start = Timer::now();
+		wildcardFound = fs.query("~/*/folder_1[0-9]/texture_file_?.png").size();
+		wildcardTime = std::min(wildcardTime, Timer::getElapsed(start));
+
+		start = Timer::now();
+		search.found = 0;
+
+		fs.foreachFile("~", [](FileSystem*, const FileInfo &info, void *data) {
+			if (info.path.starts_with("~/shaders/") && info.name.ends_with(".frag"))
+				++((Search*)data)->found;
+		}, true, &search);
+
+		matchTime = std::min(matchTime, Timer::getElapsed(start));
+	}
+
+	if (found != shaderFolders * shaders || search.found != found || wildcardFound != 100)
+		System::log()->fatal("Query didn't find every file");
+
+	//Queries always see the current tree
+
+	fs.mov("~/shaders/pass_0", "~/assets/pass_0");
+
+	if (fs.query("~/shaders/**/*.frag").size() != found - shaders || fs.query("~/**/pass_0/*.frag").size() != shaders)
+		System::log()->fatal("Query doesn't match the moved files");
+
+	System::log()->performance(
+		"Query of ", entries, " entries: ", found, " shaders in ", queryTime / 1_mus, "us (matching every file: ",
+		matchTime / 1_mus, "us); ", wildcardFound, " files without a literal prefix in ", wildcardTime / 1_mus, "us"
+	);
+}
+
+//Random 4 KiB reads of a local file from one submitting thread, keeping a number of reads in flight
+//Compares the platform implementation (io_uring on Linux) to the thread pool; the deepest queue has more reads than io_uring slots
+
+static void benchmarkAsyncReads() {
+
+	static constexpr FileSize fileSize = 64_MiB, readSize = 4_KiB;
+	static constexpr usz reads = 20000;
+	static constexpr usz depths[] = { 1, 4, 16, 64, 256, 1024 };
+
+	PlatformFileSystem fs;
+
+	const String path = "./ocore_benchmark/async.bin";
+
+	{
+		List<u8> data(fileSize);
+
+		for (usz i = 0; i < fileSize; ++i)
+			data[i] = u8(i * 31);
+
+		if (!fs.add("./ocore_benchmark", true) || !fs.writeAtomic(path, data.data(), data.size()))
+			System::log()->fatal("Async read benchmark couldn't create its file");
+	}
+
+	List<u8> destination(depths[std::size(depths) - 1] * readSize);
+	std::mt19937_64 random(4);
+
+	auto run = [&](AsyncFileIO *io, usz depth) {
+
+		List<FileRequest> requests;
+		List<FileCompletion> completions;
+		usz submitted{}, completed{};
+
+		auto request = [&](usz slot) {
+			const FileSize offset = (random() % (fileSize / readSize)) * readSize;
+			requests.push_back(FileRequest{ path, nullptr, destination.data() + slot * readSize, readSize, offset, (void*) slot });
+			++submitted;
+		};
+
+		const ns start = Timer::now();
+
+		for (usz i = 0; i < depth; ++i)
+			request(i);
+
+		io->submit({ requests.data(), requests.size() });
+
+		while (completed < reads) {
+
+			completions.clear();
+			requests.clear();
+			io->wait(completions);
+
+			for (const FileCompletion &completion : completions) {
+
+				const usz slot = usz(completion.userData);
+
+				if (!completion.success || destination[slot * readSize + 1] != u8(destination[slot * readSize] + 31))
+					System::log()->fatal("Async read benchmark read failed");
+
+				++completed;
+
+				if (submitted < reads)
+					request(slot);
+			}
+
+			if (!requests.empty())
+				io->submit({ requests.data(), requests.size() });
+		}
+
+		const ns time = Timer::getElapsed(start);
+		const AsyncFileStats stats = io->getStats();
+
+		return Pair<ns, usz>{ time, stats.maxQueueDepth };
+	};
+
+	for (usz native = 0; native < 2; ++native)
+		for (usz depth : depths) {
+
+			AsyncFileIO *io = native ? AsyncFileIO::create(&fs) : new AsyncFileIO(&fs);
+			const Pair<ns, usz> result = run(io, depth);
+			delete io;
+
+			System::log()->performance(
+				"Async ", reads, " random 4 KiB reads at queue depth ", depth, native ? " (native)" : " (thread pool)", ": ",
+				result.first / 1_ms, "ms (", reads * 1_s / std::max(result.first, ns(1)), " reads/s, ",
+				readSize * reads * 1_s / std::max(result.first, ns(1)) / 1_MiB, " MiB/s, max queue depth ", result.second, ")"
+			);
+		}
+
+	//A read that throws in a worker (this one logs that the file doesn't exist) has to complete as failed
+
+	{
+		AsyncFileIO io(&fs, 1);
+
+		const FileRequest missing{ "./ocore_benchmark/missing.bin", nullptr, destination.data(), readSize, 0, nullptr };
+		io.submit({ &missing, 1 });
+
+		List<FileCompletion> completions;
+		io.wait(completions);
+
+		if (completions.size() != 1 || completions[0].success)
+			System::log()->fatal("Async read benchmark didn't fail the read of a missing file");
+	}
+
+	fs.remove(path);
+	fs.remove("./ocore_benchmark");
+}
+
+//A local tree of folders where every listing waits like a network share would
+
+class SlowTreeFileSystem : public BenchFileSystem {
+
+public:
+
+	static constexpr usz folders = 20, subfolders = 20, files = 25;
+	static constexpr ns latency = 1_ms;
+
+	//Listing this folder fails, as if it was removed while traversing
+	String removed;
+
+	const FileInfo local(const String &path) const final override {
+
+		const bool isFolder = !path.ends_with(".bin");
+
+		return FileInfo{
+			path, path.substr(path.find_last_of('/') + 1), 0, nullptr, 0, 0, 0, 0, 0,
+			isFolder ? FileFlags(u8(FileFlags::READ) | u8(FileFlags::IS_FOLDER)) : FileFlags::READ
+		};
+	}
+
+	List<String> localFileObjects(const String &path) const final override {
+
+		std::this_thread::sleep_for(std::chrono::nanoseconds(latency));
+
+		if (path == removed)
+			throw std::runtime_error("Folder was removed");
+
+		const usz depth = usz(std::count(path.begin(), path.end(), '/'));
+		List<String> children;
+
+		if (depth < 3)
+			for (usz i = 0, j = depth == 1 ? folders : subfolders; i < j; ++i)
+				children.push_back(Log::concat(path, "/", i));
+
+		else for (usz i = 0; i < files; ++i)
+			children.push_back(Log::concat(path, "/", i, ".bin"));
+
+		return children;
+	}
+};
+
+//Parallel traversal of a large tree where listing every folder waits on the disk
+//Idle workers wait for folders instead of spinning, so they shouldn't use cpu time while the others wait
+
+static void benchmarkSlowTraversal() {
+
+	using Tree = SlowTreeFileSystem;
+
+	static constexpr usz threadCounts[] = { 1, 4, 16 };
+	static constexpr usz expected = Tree::folders * Tree::subfolders * (Tree::files + 1) + Tree::folders;
+
+	Tree fs;
+
+	for (usz threads : threadCounts) {
+
+		std::atomic<usz> count = 0;
+
+		const ns start = Timer::now();
+		const std::clock_t cpuStart = std::clock();
+
+		fs.foreachFileParallel("./tree", [](FileSystem*, const FileInfo&, void *data) {
+			++*(std::atomic<usz>*) data;
+		}, &count, threads);
+
+		const ns time = Timer::getElapsed(start);
+		const ns cpuTime = ns(std::clock() - cpuStart) * 1_s / CLOCKS_PER_SEC;
+
+		if (count != expected)
+			System::log()->fatal("Slow traversal benchmark missed files");
+
+		System::log()->performance(
+			"Traversal of ", expected, " entries (", Tree::folders * Tree::subfolders + Tree::folders + 1,
+			" folders of ", Tree::latency / 1_mus, "us each) with ", threads, " threads: ",
+			time / 1_mus, "us (", cpuTime / 1_mus, "us cpu)"
+		);
+	}
+
+	//A worker that fails has to stop the traversal and the error has to reach the caller
+
+	fs.removed = "./tree/7/3";
+
+	bool threw{};
+
+	try {
+		fs.foreachFileParallel("./tree", [](FileSystem*, const FileInfo&, void*) {}, nullptr, 16);
+	} catch (const std::runtime_error&) {
+		threw = true;
+	}
+
+	if (!threw)
+		System::log()->fatal("Slow traversal benchmark didn't report the failing folder");
+}
+
+//Local files created and removed through the file system while the metadata cache is on
+//Every change has to be visible right away, then cached lookups are compared to stat
+
+static void benchmarkMetadataCache() {
+
+	static constexpr usz files = 1000, lookups = 100000;
+
+	PlatformFileSystem fs;
+	fs.setMetadataCache(10_s);
+
+	const String folder = "./ocore_benchmark/metadata";
+
+	const ns start = Timer::now();
+
+	for (usz i = 0; i < files; ++i) {
+
+		const String path = Log::concat(folder, "/", i, ".bin");
+
+		if (!fs.add(path, false) || !fs.exists(path))
+			System::log()->fatal("Metadata cache benchmark add isn't visible");
+
+		if (!fs.remove(path) || fs.exists(path))
+			System::log()->fatal("Metadata cache benchmark remove isn't visible");
+	}
+
+	const ns changeTime = Timer::getElapsed(start);
+
+	auto lookup = [&]() {
+
+		const ns lookupStart = Timer::now();
+
+		for (usz i = 0; i < lookups; ++i)
+			if (!fs.get(folder).isFolder())
+				System::log()->fatal("Metadata cache benchmark lookup failed");
+
+		return Timer::getElapsed(lookupStart);
+	};
+
+	const ns cachedTime = lookup();
+	const MetadataCacheStats stats = fs.getMetadataCacheStats();
+
+	fs.setMetadataCache(0);
+	const ns statTime = lookup();
+
+	fs.remove(folder);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"Metadata cache: ", files, " local files added and removed in ", changeTime / 1_mus, "us; ",
+		lookups, " lookups in ", cachedTime / 1_mus, "us cached (", stats.hits, " hits, ", stats.misses, " misses, ",
+		stats.invalidations, " invalidations), ", statTime / 1_mus, "us with stat"
+	);
+}
+
+//Opening a ZIP archive of 100k stored files in 1000 folders (parsing the central directory)
+
+static void benchmarkArchiveOpen() {
+
+	static constexpr usz folders = 1000, files = 100, runs = 10;
+	static constexpr usz entries = folders * files;
+
+	//Little endian records, like the archive file system reads them
+
+	List<u8> archive, directory;
+
+	auto put = [](List<u8> &out, u64 v, usz bytes) {
+		for (usz i = 0; i < bytes; ++i)
+			out.push_back(u8(v >> (i * 8)));
+	};
+
+	for (usz i = 0; i < entries; ++i) {
+
+		const String name = Log::concat("assets/", i / files, "/", i, ".bin");
+		const u64 localHeader = archive.size();
+
+		put(archive, 0x04034B50, 4);
+		put(archive, 20, 2); put(archive, 0, 2); put(archive, 0, 2);		//Version, flags, stored
+		put(archive, 0, 4); put(archive, 0, 4);								//Time and date, crc
+		put(archive, 4, 4); put(archive, 4, 4);								//Sizes
+		put(archive, name.size(), 2); put(archive, 0, 2);
+		archive.insert(archive.end(), name.begin(), name.end());
+		put(archive, i, 4);
+
+		put(directory, 0x02014B50, 4);
+		put(directory, 20, 2); put(directory, 20, 2); put(directory, 0, 2); put(directory, 0, 2);
+		put(directory, 0, 4); put(directory, 0, 4);
+		put(directory, 4, 4); put(directory, 4, 4);
+		put(directory, name.size(), 2); put(directory, 0, 2); put(directory, 0, 2);	//Name, extra, comment
+		put(directory, 0, 2); put(directory, 0, 2); put(directory, 0, 4);			//Disk, attributes
+		put(directory, localHeader, 4);
+		directory.insert(directory.end(), name.begin(), name.end());
+	}
+
+	const u64 directoryOffset = archive.size();
+	archive.insert(archive.end(), directory.begin(), directory.end());
+
+	//100k entries don't fit in the end record, so the ZIP64 end record and its locator are used
+
+	const u64 end64 = archive.size();
+
+	put(archive, 0x06064B50, 4);
+	put(archive, 44, 8);
+	put(archive, 45, 2); put(archive, 45, 2); put(archive, 0, 4); put(archive, 0, 4);
+	put(archive, entries, 8); put(archive, entries, 8);
+	put(archive, directory.size(), 8); put(archive, directoryOffset, 8);
+
+	put(archive, 0x07064B50, 4);
+	put(archive, 0, 4); put(archive, end64, 8); put(archive, 1, 4);
+
+	put(archive, 0x06054B50, 4);
+	put(archive, 0, 4);
+	put(archive, 0xFFFF, 2); put(archive, 0xFFFF, 2);
+	put(archive, 0xFFFFFFFF, 4); put(archive, 0xFFFFFFFF, 4);
+	put(archive, 0, 2);
+
+	ns best = ns(-1);
+	usz found{};
+
+	for (usz i = 0; i < runs; ++i) {
+
+		const ns start = Timer::now();
+		ArchiveFileSystem fs({ archive.data(), archive.size() });
+		best = std::min(best, Timer::getElapsed(start));
+
+		found = fs.virtualSize();
+
+		if (!fs.valid() || !fs.exists("~/assets/999/99999.bin"))
+			System::log()->fatal("Archive open benchmark couldn't find its files");
+	}
+
+	System::log()->performance(
+		"Archive of ", entries, " files (", archive.size() / 1_KiB, " KiB): opened in ", best / 1_mus, "us (",
+		found, " entries)"
+	);
+
+	//A corrupt ZIP64 record has to be rejected (these log why), instead of overflowing offsets or reserving its count
+
+	auto corrupt = [&](usz offset, u64 value) {
+
+		List<u8> copy = archive;
+
+		for (usz i = 0; i < 8; ++i)
+			copy[end64 + offset + i] = u8(value >> (i * 8));
+
+		try {
+			ArchiveFileSystem fs({ copy.data(), copy.size() });
+		} catch (const std::runtime_error&) {
+			return;
+		}
+
+		System::log()->fatal("Archive open benchmark accepted a corrupt archive");
+	};
+
+	corrupt(48, u64_MAX - 15);		//Directory offset
+	corrupt(32, u64(1) << 60);		//Entry count
+}
+
+//Loads a local file by reading it into a buffer and through a view that maps it; both have to match what was written
+//Mapping a file that's open for writing and viewing a memory file have to show the same data as a read
+
+static void benchmarkViews() {
+
+	static constexpr FileSize fileSize = 32_MiB, region = 4_KiB;
+	static constexpr usz runs = 10;
+
+	PlatformFileSystem fs;
+
+	const String path = "./ocore_benchmark/view.bin";
+	List<u8> data(fileSize);
+
+	for (usz i = 0; i < fileSize; ++i)
+		data[i] = u8(i * 7 + (i >> 12));
+
+	if (!fs.add("./ocore_benchmark", true) || !fs.writeAtomic(path, data.data(), data.size()))
+		System::log()->fatal("View benchmark couldn't create its file");
+
+	ns readTime = 1_s, viewTime = 1_s;
+
+	for (usz i = 0; i < runs; ++i) {
+
+		ns start = Timer::now();
+
+		{
+			Buffer buffer;
+
+			if (!fs.read(path, buffer) || buffer.size() != fileSize || std::memcmp(buffer.data(), data.data(), fileSize))
+				System::log()->fatal("View benchmark read the wrong data");
+		}
+
+		readTime = std::min(readTime, Timer::getElapsed(start));
+		start = Timer::now();
+
+		{
+			const FileView view = fs.view(path);
+
+			if (!view.valid() || view.size() != fileSize || std::memcmp(view.begin(), data.data(), fileSize))
+				System::log()->fatal("View benchmark viewed the wrong data");
+		}
+
+		viewTime = std::min(viewTime, Timer::getElapsed(start));
+	}
+
+	//A region written through the open file is part of its map
+
+	if (File *file = fs.open(path, FileFlags::READ_WRITE)) {
+
+		if (!file->write(data.data(), region, region))
+			System::log()->fatal("View benchmark couldn't write its file");
+
+		const ListRef<const u8> map = file->map();
+
+		if (map.size() != fileSize || std::memcmp(map.begin() + region, data.data(), region))
+			System::log()->fatal("View benchmark map doesn't have the written region");
+
+		fs.close(file);
+	}
+
+	else System::log()->fatal("View benchmark couldn't open its file");
+
+	//Memory files are viewed without copying too
+
+	const String memoryPath = "~/view.bin";
+
+	if (!fs.add(memoryPath, false) || !fs.write(memoryPath, data.data(), region * 4, 0))
+		System::log()->fatal("View benchmark couldn't write its memory file");
+
+	{
+		const FileView view = fs.view(memoryPath);
+
+		if (!view.valid() || view.size() != region * 4 || std::memcmp(view.begin(), data.data(), region * 4))
+			System::log()->fatal("View benchmark viewed the wrong memory file data");
+	}
+
+	fs.remove(memoryPath);
+	fs.remove(path);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"Loading ", fileSize / 1_MiB, " MiB: ", readTime / 1_mus, "us through read, ", viewTime / 1_mus, "us through a view"
+	);
+}
+
+//Creates, moves and removes local files outside of the file system; the watcher has to report every change
+//The time is measured from the change on disk until its callback ran
+
+static void benchmarkLocalWatcher() {
+
+	static constexpr usz files = 100;
+	static constexpr ns timeout = 1_s;
+
+	struct Changes {
+		std::mutex mutex;
+		std::condition_variable signal;
+		List<FileChangeEvent> events;
+	} changes;
+
+	PlatformFileSystem fs;
+
+	const String folder = "./ocore_benchmark/watched";
+
+	if (!fs.add(folder, true))
+		System::log()->fatal("Local watcher benchmark couldn't create its folder");
+
+	fs.addFileChangeBatchCallback([](FileSystem*, const List<FileChangeEvent> &events, void *data) {
+
+		Changes *changes = (Changes*) data;
+
+		{
+			std::lock_guard<std::mutex> guard(changes->mutex);
+			changes->events.insert(changes->events.end(), events.begin(), events.end());
+		}
+
+		changes->signal.notify_all();
+
+	}, folder, &changes);
+
+	//Other changes of the path (e.g. the write after creating a file) are skipped
+
+	auto wait = [&changes](FileChange change, const String &path, const String &oldPath, ns start) {
+
+		std::unique_lock<std::mutex> lock(changes.mutex);
+
+		const bool found = changes.signal.wait_for(lock, std::chrono::nanoseconds(timeout), [&]() {
+
+			for (const FileChangeEvent &event : changes.events)
+				if (event.change == change && event.info.path == path && event.oldPath == oldPath)
+					return true;
+
+			return false;
+		});
+
+		if (!found)
+			System::log()->fatal("Local watcher benchmark missed a change of ", path);
+
+		changes.events.clear();
+		return Timer::getElapsed(start);
+	};
+
+	ns addTime{}, moveTime{}, removeTime{};
+
+	for (usz i = 0; i < files; ++i) {
+
+		const String path = Log::concat(folder, "/", i, ".txt"), moved = Log::concat(folder, "/", i, "_moved.txt");
+
+		ns start = Timer::now();
+
+		if (FILE *file = std::fopen(path.c_str(), "wb"))
+			std::fclose(file);
+
+		else System::log()->fatal("Local watcher benchmark couldn't create a file");
+
+		addTime += wait(FileChange::ADD, path, "", start);
+
+		start = Timer::now();
+		std::rename(path.c_str(), moved.c_str());
+		moveTime += wait(FileChange::MOVE, moved, path, start);
+
+		start = Timer::now();
+		std::remove(moved.c_str());
+		removeTime += wait(FileChange::DEL, moved, "", start);
+	}
+
+	fs.removeFileChangeCallback(folder);
+
+	fs.remove(folder);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"Local watcher: ", files, " files; average latency of adding ", addTime / files / 1_mus, "us, ",
+		"moving ", moveTime / files / 1_mus, "us, removing ", removeTime / files / 1_mus, "us"
+	);
+}
+
+//Writes a file through a stream in small pieces and reads it back the same way
+//The file is many windows long, but the stream may only keep its windows in memory
+
+static void benchmarkFileStream() {
+
+	static constexpr FileSize fileSize = 16_MiB;
+	static constexpr usz window = 64_KiB, piece = 1000;
+
+	PlatformFileSystem fs;
+
+	const String path = "./ocore_benchmark/stream.bin";
+
+	if (!fs.add("./ocore_benchmark", true) || !fs.add(path, false))
+		System::log()->fatal("File stream benchmark couldn't create its file");
+
+	auto expected = [](FileSize i) { return u8(i * 13 + (i >> 16)); };
+
+	Buffer buffer(piece);
+	usz writeMemory{}, readMemory{};
+
+	ns start = Timer::now();
+
+	{
+		const usz before = allocatedMemory.load();
+		FileStream stream(&fs, path, FileFlags::READ_WRITE, window);
+
+		for (FileSize offset = 0; offset < fileSize; offset += piece) {
+
+			const usz size = usz(std::min(FileSize(piece), fileSize - offset));
+
+			for (usz i = 0; i < size; ++i)
+				buffer[i] = expected(offset + i);
+
+			if (!stream.write(buffer.data(), size))
+				System::log()->fatal("File stream benchmark couldn't write");
+
+			writeMemory = std::max(writeMemory, allocatedMemory.load() - before);
+		}
+
+		if (!stream.flush())
+			System::log()->fatal("File stream benchmark couldn't flush");
+	}
+
+	const ns writeTime = Timer::getElapsed(start);
+	start = Timer::now();
+
+	{
+		const usz before = allocatedMemory.load();
+		FileStream stream(&fs, path, FileFlags::READ, window);
+
+		if (stream.size() != fileSize)
+			System::log()->fatal("File stream benchmark wrote the wrong size");
+
+		for (FileSize offset = 0; offset < fileSize; offset += piece) {
+
+			const usz size = usz(std::min(FileSize(piece), fileSize - offset));
+
+			if (stream.read(buffer.data(), size) != size)
+				System::log()->fatal("File stream benchmark couldn't read");
+
+			for (usz i = 0; i < size; ++i)
+				if (buffer[i] != expected(offset + i))
+					System::log()->fatal("File stream benchmark read the wrong data at ", offset + i);
+
+			readMemory = std::max(readMemory, allocatedMemory.load() - before);
+		}
+
+		if (!stream.eof())
+			System::log()->fatal("File stream benchmark didn't reach the end");
+	}
+
+	const ns readTime = Timer::getElapsed(start);
+
+	//Two windows for reading or one for writing; the rest is the file and the background read
+
+	if (writeMemory > window + 16_KiB || readMemory > 2 * window + 16_KiB)
+		System::log()->fatal("File stream benchmark used more memory than its windows");
+
+	fs.remove(path);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"File stream of ", fileSize / 1_MiB, " MiB in ", piece, " byte pieces with a ", window / 1_KiB, " KiB window: ",
+		"write in ", writeTime / 1_mus, "us (", writeMemory / 1_KiB, " KiB in memory), ",
+		"read in ", readTime / 1_mus, "us (", readMemory / 1_KiB, " KiB in memory)"
+	);
+}
+
+//Reads many regions of a file in one call and with one call per region
+//The regions are out of order, with gaps below and above the 4 KiB that reads are merged over, and some overlap
+
+static void benchmarkVectoredReads() {
+
+	static constexpr FileSize fileSize = 32_MiB;
+	static constexpr usz regionCount = 4000, runs = 10;
+
+	PlatformFileSystem fs;
+
+	const String path = "./ocore_benchmark/vectored.bin";
+	List<u8> data(fileSize);
+
+	for (usz i = 0; i < fileSize; ++i)
+		data[i] = u8(i * 29 + (i >> 10));
+
+	if (!fs.add("./ocore_benchmark", true) || !fs.writeAtomic(path, data.data(), data.size()))
+		System::log()->fatal("Vectored read benchmark couldn't create its file");
+
+	static constexpr FileSize gaps[] = { 0, 1, 100, 4_KiB - 1, 4_KiB, 4_KiB + 1, 16_KiB, 0, 0 };
+
+	List<IoRegion> regions;
+	FileSize offset{};
+
+	for (usz i = 0; i < regionCount; ++i) {
+
+		const FileSize size = 1 + (i * 97) % 2000;
+		regions.push_back(IoRegion{ offset, size, nullptr });
+
+		//Every 16th region starts inside the previous one
+
+		offset += i % 16 == 15 ? size / 2 : size + gaps[i % std::size(gaps)];
+	}
+
+	if (offset > fileSize)
+		System::log()->fatal("Vectored read benchmark regions don't fit in its file");
+
+	std::shuffle(regions.begin(), regions.end(), std::mt19937_64(10));
+
+	FileSize total{};
+
+	for (IoRegion &region : regions)
+		total += region.size;
+
+	Buffer destination(total);
+	u8 *next = destination.data();
+
+	for (IoRegion &region : regions) {
+		region.data = next;
+		next += region.size;
+	}
+
+	auto check = [&](const c8 *what) {
+
+		for (const IoRegion &region : regions)
+			if (std::memcmp(region.data, data.data() + region.offset, region.size))
+				System::log()->fatal("Vectored read benchmark ", what, " read the wrong data at ", region.offset);
+
+		std::memset(destination.data(), 0, destination.size());
+	};
+
+	ns vectoredTime = 1_s, fileTime = 1_s, separateTime = 1_s;
+
+	for (usz i = 0; i < runs; ++i) {
+
+		ns start = Timer::now();
+
+		if (!fs.read(path, { regions.data(), regions.size() }))
+			System::log()->fatal("Vectored read benchmark couldn't read");
+
+		vectoredTime = std::min(vectoredTime, Timer::getElapsed(start));
+		check("file system");
+
+		start = Timer::now();
+
+		if (File *file = fs.open(path, FileFlags::READ)) {
+
+			const bool success = file->readv({ regions.data(), regions.size() });
+			fs.close(file);
+
+			if (!success)
+				System::log()->fatal("Vectored read benchmark couldn't read the file");
+		}
+
+		fileTime = std::min(fileTime, Timer::getElapsed(start));
+		check("open file");
+
+		start = Timer::now();
+
+		for (const IoRegion &region : regions)
+			if (!fs.read(path, (u8*) region.data, region.size, region.offset))
+				System::log()->fatal("Vectored read benchmark couldn't read a region");
+
+		separateTime = std::min(separateTime, Timer::getElapsed(start));
+		check("separate");
+	}
+
+	fs.remove(path);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"Vectored read of ", regionCount, " regions (", total / 1_KiB, " KiB): ", vectoredTime / 1_mus, "us in one read, ",
+		fileTime / 1_mus, "us through the open file, ", separateTime / 1_mus, "us with a read per region"
+	);
+}
+
+//Small reads of a few hot files with and without the open file cache
+//A file changed through the file system (a write, a replace or an update after another process wrote it)
+//has to be read again instead of served from the file that's still open
+
+static void benchmarkFileCache() {
+
+	static constexpr usz files = 8, reads = 20000;
+	static constexpr FileSize fileSize = 64_KiB, readSize = 256;
+
+	PlatformFileSystem fs;
+
+	if (!fs.add("./ocore_benchmark", true))
+		System::log()->fatal("File cache benchmark couldn't create its folder");
+
+	List<String> paths;
+	List<u8> data(fileSize);
+
+	for (usz i = 0; i < fileSize; ++i)
+		data[i] = u8(i * 3);
+
+	for (usz i = 0; i < files; ++i) {
+
+		paths.push_back(Log::concat("./ocore_benchmark/cached_", i, ".bin"));
+
+		if (!fs.writeAtomic(paths.back(), data.data(), data.size()))
+			System::log()->fatal("File cache benchmark couldn't create its files");
+	}
+
+	u8 result[readSize];
+
+	auto run = [&]() {
+
+		const ns start = Timer::now();
+
+		for (usz i = 0; i < reads; ++i) {
+
+			const FileSize offset = (i * 4099) % (fileSize - readSize);
+
+			if (!fs.read(paths[i % files], result, readSize, offset) || std::memcmp(result, data.data() + offset, readSize))
+				System::log()->fatal("File cache benchmark read the wrong data");
+		}
+
+		return Timer::getElapsed(start);
+	};
+
+	const ns uncachedTime = run();
+
+	fs.setFileCache(files);
+	const ns cachedTime = run();
+
+	//Every change of the first file is read back while it's cached
+
+	const String &path = paths[0];
+
+	auto expect = [&](FileSize size, u8 value, const c8 *change) {
+
+		Buffer buffer;
+
+		if (!fs.read(path, buffer) || buffer.size() != size || buffer[size - 1] != value)
+			System::log()->fatal("File cache benchmark read an old file after ", change);
+	};
+
+	data[fileSize - 1] = 1;
+
+	if (!fs.write(path, data.data() + fileSize - 1, 1, fileSize - 1))
+		System::log()->fatal("File cache benchmark couldn't write");
+
+	expect(fileSize, 1, "a write");
+
+	data.push_back(2);
+
+	if (!fs.write(path, data.data() + fileSize, 1, fileSize))
+		System::log()->fatal("File cache benchmark couldn't append");
+
+	expect(fileSize + 1, 2, "an append");
+
+	data.push_back(3);
+
+	if (!fs.writeAtomic(path, data.data(), data.size()))
+		System::log()->fatal("File cache benchmark couldn't replace");
+
+	expect(fileSize + 2, 3, "a replace");
+
+	if (FILE *file = std::fopen(path.c_str(), "ab")) {
+		std::fputc(4, file);
+		std::fclose(file);
+	}
+
+	fs.update(path);
+	expect(fileSize + 3, 4, "an update");
+
+	for (const String &file : paths)
+		fs.remove(file);
+
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"File cache: ", reads, " reads of ", readSize, " bytes from ", files, " files in ",
+		uncachedTime / 1_mus, "us without and ", cachedTime / 1_mus, "us with the cache"
+	);
+}
+
+//Updates a small region of a large file in place, compared to writing the whole file again
+//The bytes around the region have to stay, resizing has to keep the data before the new size,
+//and a reader may only ever see the old or the new file while it's being replaced
+
+static void benchmarkRangedWrites() {
+
+	static constexpr FileSize fileSize = 64_MiB, region = 4_KiB, atomicSize = 256_KiB;
+	static constexpr usz writes = 100, replaces = 200;
+
+	PlatformFileSystem fs;
+
+	const String path = "./ocore_benchmark/ranged.bin";
+	List<u8> data(fileSize);
+
+	for (usz i = 0; i < fileSize; ++i)
+		data[i] = u8(i * 11 + (i >> 14));
+
+	if (!fs.add("./ocore_benchmark", true) || !fs.writeAtomic(path, data.data(), data.size()))
+		System::log()->fatal("Ranged write benchmark couldn't create its file");
+
+	List<u8> block(region, 0xAB);
+	std::mt19937_64 random(12);
+
+	ns start = Timer::now();
+
+	for (usz i = 0; i < writes; ++i) {
+
+		const FileSize offset = random() % (fileSize - region);
+
+		if (!fs.write(path, block.data(), region, offset))
+			System::log()->fatal("Ranged write benchmark couldn't write");
+
+		std::memcpy(data.data() + offset, block.data(), region);
+	}
+
+	const ns rangedTime = Timer::getElapsed(start) / writes;
+
+	start = Timer::now();
+
+	if (!fs.write(path, data))
+		System::log()->fatal("Ranged write benchmark couldn't write the file");
+
+	const ns wholeTime = Timer::getElapsed(start);
+
+	auto check = [&](FileSize size, const c8 *what) {
+
+		Buffer buffer;
+
+		if (!fs.read(path, buffer) || buffer.size() != size || std::memcmp(buffer.data(), data.data(), size))
+			System::log()->fatal("Ranged write benchmark found the wrong data after ", what);
+	};
+
+	check(fileSize, "ranged writes");
+
+	//Shrinking and growing keeps the data before the new size; the grown part is zero
+
+	if (File *file = fs.open(path, FileFlags::READ_WRITE)) {
+
+		const bool success = file->resize(fileSize / 2) && file->resize(fileSize / 2 + region);
+		fs.close(file);
+
+		if (!success)
+			System::log()->fatal("Ranged write benchmark couldn't resize");
+	}
+
+	std::memset(data.data() + fileSize / 2, 0, region);
+	check(fileSize / 2 + region, "resizing");
+
+	//Replaced between two files of the same size that are filled with a single value
+
+	List<u8> contents[2] = { List<u8>(atomicSize, 'a'), List<u8>(atomicSize, 'b') };
+	std::atomic<bool> replacing = true;
+	std::atomic<usz> torn{}, seen{};
+
+	if (!fs.writeAtomic(path, contents[0].data(), atomicSize))
+		System::log()->fatal("Ranged write benchmark couldn't replace its file");
+
+	auto reader = std::async(std::launch::async, [&]() {
+
+		Buffer buffer;
+
+		while (replacing) {
+
+			if (!fs.read(path, buffer) || buffer.size() != atomicSize || std::count(buffer.begin(), buffer.end(), buffer[0]) != atomicSize)
+				++torn;
+
+			++seen;
+		}
+	});
+
+	for (usz i = 0; i < replaces; ++i)
+		if (!fs.writeAtomic(path, contents[i & 1].data(), atomicSize))
+			System::log()->fatal("Ranged write benchmark couldn't replace its file");
+
+	replacing = false;
+	reader.get();
+
+	if (torn)
+		System::log()->fatal("Ranged write benchmark read ", torn, " files that were partly replaced");
+
+	fs.remove(path);
+	fs.remove("./ocore_benchmark");
+
+	System::log()->performance(
+		"Ranged writes of ", region / 1_KiB, " KiB into ", fileSize / 1_MiB, " MiB: ", rangedTime / 1_mus, "us each, ",
+		wholeTime / 1_mus, "us to write the whole file; ", replaces, " atomic replaces while reading ", seen.load(), " times"
+	);
+}
+
+//Reads the files that CMake embeds into the benchmark (configure_virtual_files); only Linux builds embed them
+//Both are the same numbered lines, once stored plain and once as compressed chunks (COMPRESS)
+
+static void benchmarkEmbeddedFiles() {
+
+#ifdef OCORE_BENCHMARK_VIRTUAL_FILES
+
+	static constexpr usz regions = 1000;
+
+	PlatformFileSystem fs;
+
+	String expected;
+
+	for (usz i = 0; i < 200; ++i)
+		for (usz j = 0; j < 1000; ++j)
+			expected += std::to_string(i) + "." + std::to_string(j) + "\n";
+
+	//The index has to list both files with their uncompressed size
+
+	const String files[] = { "~/benchmark/plain/numbers.txt", "~/benchmark/compressed/numbers.txt" };
+	const List<FileId> listed = fs.query("~/benchmark/**");
+
+	for (const String &file : files) {
+
+		const auto it = std::find_if(listed.begin(), listed.end(), [&](FileId id) { return fs.get(id).path == file; });
+
+		if (it == listed.end())
+			System::log()->fatal("Embedded file benchmark didn't find ", file, " in the index");
+
+		const FileInfo info = fs.get(*it);
+
+		if (info.isFolder() || !info.isVirtual() || info.fileSize != expected.size())
+			System::log()->fatal("Embedded file benchmark found the wrong info for ", file);
+	}
+
+	ns times[2][2]{};
+	std::mt19937_64 random(14);
+
+	for (usz k = 0; k < 2; ++k) {
+
+		Buffer buffer;
+		ns start = Timer::now();
+
+		if (!fs.read(files[k], buffer) || buffer.size() != expected.size() || std::memcmp(buffer.data(), expected.data(), expected.size()))
+			System::log()->fatal("Embedded file benchmark read the wrong data from ", files[k]);
+
+		times[k][0] = Timer::getElapsed(start);
+
+		//Partial reads of up to 100 KiB, so some of them cross chunks
+
+		start = Timer::now();
+
+		for (usz i = 0; i < regions; ++i) {
+
+			const FileSize size = 1 + random() % 100_KiB;
+			const FileSize offset = random() % (expected.size() - size + 1);
+
+			if (!fs.read(files[k], buffer, size, offset) || buffer.size() != size || std::memcmp(buffer.data(), expected.data() + offset, size))
+				System::log()->fatal("Embedded file benchmark read the wrong region from ", files[k]);
+		}
+
+		times[k][1] = Timer::getElapsed(start) / regions;
+	}
+
+	System::log()->performance(
+		"Embedded files of ", expected.size() / 1_KiB, " KiB: full read in ", times[0][0] / 1_mus, "us plain and ",
+		times[1][0] / 1_mus, "us compressed; partial reads in ", times[0][1] / 1_mus, "us plain and ", times[1][1] / 1_mus, "us compressed"
+	);
+
+#endif
+}
+
+int main() {
+
+	#ifndef _WIN32
+		BenchmarkSystem system;
+	#endif
+
+	try {
+		benchmarkVirtualAddRemove();
+		benchmarkContention(false);
+		benchmarkContention(true);
+		benchmarkDecompression();
+		benchmarkChangeBursts();
+		benchmarkOverlay();
+		benchmarkPrefetch();
+		benchmarkMemoryFiles();
+		benchmarkVirtualTable();
+		benchmarkBatchImport();
+		benchmarkFileIds();
+		benchmarkFolderMoves();
+		benchmarkQuery();
+		benchmarkMetadataCache();
+		benchmarkAsyncReads();
+		benchmarkSlowTraversal();
+		benchmarkArchiveOpen();
+		benchmarkViews();
+		benchmarkLocalWatcher();
+		benchmarkFileStream();
+		benchmarkVectoredReads();
+		benchmarkFileCache();
+		benchmarkRangedWrites();
+		benchmarkEmbeddedFiles();
+	} catch (const std::exception&) {
+		return 1;
+	}
+
+	return 0;
+}
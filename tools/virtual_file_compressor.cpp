@@ -0,0 +1,54 @@
+#include "utils/compressed_chunks.hpp"
+#include <cstdio>
+
+using namespace oic;
+
+//Compresses a file into CompressedChunks at build time; used by add_virtual_files(COMPRESS)
+//Usage: ocore_compressor <input> <output>
+
+int main(int argc, char **argv) {
+
+	if (argc != 3) {
+		std::fprintf(stderr, "Usage: ocore_compressor <input> <output>\n");
+		return 1;
+	}
+
+	List<u8> data;
+
+	if (FILE *input = std::fopen(argv[1], "rb")) {
+
+		u8 block[64 * 1024];
+
+		for (usz read; (read = std::fread(block, 1, sizeof(block), input)) != 0; )
+			data.insert(data.end(), block, block + read);
+
+		const bool failed = std::ferror(input);
+		std::fclose(input);
+
+		if (failed) {
+			std::fprintf(stderr, "Couldn't read %s\n", argv[1]);
+			return 1;
+		}
+	}
+
+	else {
+		std::fprintf(stderr, "Couldn't open %s\n", argv[1]);
+		return 1;
+	}
+
+	const List<u8> compressed = CompressedChunks::compress({ data.data(), data.size() });
+
+	FILE *output = std::fopen(argv[2], "wb");
+
+	if (!output || std::fwrite(compressed.data(), 1, compressed.size(), output) != compressed.size()) {
+
+		std::fprintf(stderr, "Couldn't write %s\n", argv[2]);
+
+		if (output)
+			std::fclose(output);
+
+		return 1;
+	}
+
+	return std::fclose(output) ? 1 : 0;
+}